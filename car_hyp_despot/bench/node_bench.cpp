@@ -0,0 +1,194 @@
+/*
+ * Microbenchmark of search tree nodes: builds full trees with the node
+ * allocation schemes of DESPOT (heap, memory pool, search arena), touches the
+ * hot fields of every node as a search trial would, and frees the trees.
+ * Particles are split among observations without stepping a model, so it
+ * needs neither ROS nor a problem definition.
+ *
+ * usage: node_bench [depth] [num_actions] [num_obs] [num_particles] [repeats]
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <despot/core/node.h>
+#include <despot/solver/despot.h>
+#include <despot/util/arena.h>
+#include <despot/util/util.h>
+
+using namespace std;
+using namespace despot;
+
+enum AllocMode {
+	HEAP,
+	POOL,
+	ARENA
+};
+
+static const char* mode_names[] = { "heap", "pool", "arena" };
+
+static const size_t NODE_ALIGNMENT = 64; // As in DESPOT::NewNode
+
+struct TreeShape {
+	int depth;
+	int num_actions;
+	int num_obs;
+	vector<ACT_TYPE> actions;
+};
+
+template<class T, class... Args>
+static T* NewNode(AllocMode mode, MemoryPool<T>& pool, Arena& arena,
+		Args&&... args) {
+	if (mode == ARENA) {
+		T* node = new (arena.Allocate(sizeof(T), NODE_ALIGNMENT))
+			T(std::forward<Args>(args)...);
+		node->SetInArena();
+		node->UseArena(&arena);
+		return node;
+	}
+	if (mode == POOL)
+		return pool.Construct(std::forward<Args>(args)...);
+	return new T(std::forward<Args>(args)...);
+}
+
+/*
+ * Stands in for stepping a particle: spreads the particles of a node over
+ * the observations differently at every action and depth.
+ */
+static unsigned ObsHash(int state_id, int action, int depth) {
+	unsigned h = (unsigned) state_id * 2654435761u
+		^ (unsigned) (action + 1) * 40503u ^ (unsigned) (depth + 1) * 97u;
+	h ^= h >> 13;
+	h *= 0x5bd1e995u;
+	h ^= h >> 15;
+	return h;
+}
+
+/*
+ * Expands vnode down to the tree depth and returns the number of nodes
+ * created below it.
+ */
+static int Expand(VNode* vnode, const TreeShape& shape, AllocMode mode,
+		Arena& arena) {
+	if (vnode->depth() == shape.depth)
+		return 0;
+
+	int num_nodes = 0;
+	const vector<State*>& particles = vnode->particles();
+	vnode->legal_actions(shape.actions);
+	vnode->children().resize(shape.num_actions, NULL);
+	vector<vector<State*> > partitions(shape.num_obs);
+	vector<vector<int> > partition_ids(shape.num_obs);
+	for (int a = 0; a < shape.num_actions; a++) {
+		QNode* qnode = NewNode(mode, DESPOT::qnode_pool_, arena, vnode, a);
+		vnode->children()[a] = qnode;
+		num_nodes++;
+
+		for (int o = 0; o < shape.num_obs; o++) {
+			partitions[o].clear();
+			partition_ids[o].clear();
+		}
+		for (int i = 0; i < particles.size(); i++) {
+			State* particle = particles[i];
+			int obs = ObsHash(particle->state_id, a, vnode->depth())
+				% shape.num_obs;
+			partitions[obs].push_back(particle);
+			partition_ids[obs].push_back(particle->scenario_id);
+		}
+
+		for (int o = 0; o < shape.num_obs; o++) {
+			if (partitions[o].empty())
+				continue;
+			VNode* child = NewNode(mode, DESPOT::vnode_pool_, arena,
+				partitions[o], partition_ids[o], vnode->depth() + 1, qnode, o);
+			child->lower_bound(0);
+			child->upper_bound(1);
+			qnode->children()[o] = child;
+			num_nodes += 1 + Expand(child, shape, mode, arena);
+		}
+	}
+	return num_nodes;
+}
+
+/*
+ * Walks the tree reading the fields a trial reads at every node, and
+ * returns their sum so that the walk is not optimized away.
+ */
+static double Visit(VNode* vnode) {
+	double sum = vnode->lower_bound() + vnode->upper_bound() + vnode->Weight();
+	for (ACT_TYPE a : vnode->legal_actions()) {
+		QNode* qnode = vnode->Child(a);
+		FlatMap<OBS_TYPE, VNode*>& children = qnode->children();
+		for (FlatMap<OBS_TYPE, VNode*>::iterator it = children.begin();
+				it != children.end(); it++)
+			sum += Visit(it->second);
+	}
+	return sum;
+}
+
+static void Free(VNode* root, AllocMode mode, Arena& arena) {
+	if (mode == ARENA) {
+		root->~VNode();
+		arena.Reset();
+	} else if (mode == POOL)
+		DESPOT::vnode_pool_.Destroy(root);
+	else
+		delete root;
+}
+
+int main(int argc, char* argv[]) {
+	TreeShape shape;
+	shape.depth = (argc > 1) ? atoi(argv[1]) : 4;
+	shape.num_actions = (argc > 2) ? atoi(argv[2]) : 3;
+	shape.num_obs = (argc > 3) ? atoi(argv[3]) : 4;
+	int num_particles = (argc > 4) ? atoi(argv[4]) : 500;
+	int repeats = (argc > 5) ? atoi(argv[5]) : 20;
+	for (ACT_TYPE a = 0; a < shape.num_actions; a++)
+		shape.actions.push_back(a);
+
+	vector<State> states(num_particles);
+	vector<State*> particles(num_particles);
+	vector<int> particle_ids(num_particles);
+	for (int i = 0; i < num_particles; i++) {
+		states[i].state_id = i;
+		states[i].scenario_id = i;
+		states[i].weight = 1.0 / num_particles;
+		particles[i] = &states[i];
+		particle_ids[i] = i;
+	}
+
+	cout << "sizeof(VNode) = " << sizeof(VNode) << ", sizeof(QNode) = "
+		<< sizeof(QNode) << endl;
+	cout << "depth " << shape.depth << ", " << shape.num_actions << " actions, "
+		<< shape.num_obs << " observations, " << num_particles << " particles, "
+		<< repeats << " repeats" << endl;
+
+	Arena arena;
+	for (int mode = HEAP; mode <= ARENA; mode++) {
+		double build_time = 0, visit_time = 0, free_time = 0, checksum = 0;
+		long num_nodes = 0;
+		for (int r = 0; r < repeats; r++) {
+			double start = get_time_second();
+			VNode* root = NewNode((AllocMode) mode, DESPOT::vnode_pool_, arena,
+				particles, particle_ids);
+			num_nodes += 1 + Expand(root, shape, (AllocMode) mode, arena);
+			build_time += get_time_second() - start;
+
+			start = get_time_second();
+			checksum += Visit(root);
+			visit_time += get_time_second() - start;
+
+			start = get_time_second();
+			Free(root, (AllocMode) mode, arena);
+			free_time += get_time_second() - start;
+		}
+
+		cout << mode_names[mode] << ": " << num_nodes / repeats << " nodes, build "
+			<< num_nodes / build_time / 1e6 << "M nodes/s, visit "
+			<< num_nodes / visit_time / 1e6 << "M nodes/s, free "
+			<< num_nodes / free_time / 1e6 << "M nodes/s (checksum "
+			<< checksum / repeats << ")" << endl;
+	}
+	return 0;
+}
@@ -14,8 +14,8 @@
 #include <despot/util/util.h>
 #include <despot/random_streams.h>
 #include <despot/util/logging.h>
-
-#include <despot/GPUcore/msg_queue.h>
+#include <despot/util/atomic_float.h>
+#include <despot/util/profiled_mutex.h>
 
 
 #undef LOG
@@ -24,7 +24,9 @@ if (despot::logging::level() < despot::logging::ERROR || despot::logging::level(
 else despot::logging::stream(lv)
 #include <despot/util/logging.h>
 
+using namespace std;
 namespace despot {
+using namespace Globals;
 
 class Shared_QNode;
 
@@ -33,19 +35,22 @@ class Shared_QNode;
  * =============================================================================*/
 
 /**
- * A belief/value/AND node in the search tree. Protected by mutex for sharing among multiple CPU threads
+ * A belief/value/AND node in the search tree. Protected by mutex for sharing among multiple CPU threads.
+ * The mutex guards expansion and selection; bounds and virtual losses are atomic and backed up without it.
  */
 class Shared_VNode:public VNode {
 protected:
-	mutable std::mutex _mutex;
+	mutable ProfiledMutex _mutex;
+	std::atomic<bool> expanded_; // Set once the child table is complete
 public:
-	float exploration_bonus;
+	AtomicFloat<float> exploration_bonus;
 	std::atomic<int> visit_count_;
 	mutable bool is_waiting_;
 
-	std::mutex& GetMutex(){return _mutex;}
+	ProfiledMutex& GetMutex(){return _mutex;}
 	void lock(){_mutex.lock();}
 	void unlock(){_mutex.unlock();}
+	Shared_VNode();
 	Shared_VNode(std::vector<State*>& particles, std::vector<int> particleIDs,int depth = 0, Shared_QNode* parent = NULL,
 		OBS_TYPE edge = (OBS_TYPE)-1);
 	Shared_VNode(Belief* belief, int depth = 0, Shared_QNode* parent = NULL, OBS_TYPE edge =
@@ -80,6 +85,9 @@ public:
 	double utility_upper_bound() const;
 
 	bool IsLeaf();
+	/* Mark the children as built; lock-free readers check IsExpanded before walking them */
+	void MarkExpanded(){expanded_.store(true, std::memory_order_release);}
+	bool IsExpanded() const {return expanded_.load(std::memory_order_acquire);}
 
 	void Add(double val);
 	void count(int c);
@@ -110,14 +118,15 @@ public:
  */
 class Shared_QNode:public QNode  {
 protected:
-	mutable std::mutex _mutex;
+	mutable ProfiledMutex _mutex;
 public:
-	float exploration_bonus;
+	AtomicFloat<float> exploration_bonus;
 	std::atomic<int> visit_count_;
-	std::mutex& GetMutex(){return _mutex;}
+	ProfiledMutex& GetMutex(){return _mutex;}
 
 	void lock(){_mutex.lock();}
 	void unlock(){_mutex.unlock();}
+	Shared_QNode();
 	Shared_QNode(Shared_VNode* parent, ACT_TYPE edge);
 	Shared_QNode(int count, double value);
 	~Shared_QNode();
@@ -152,8 +161,6 @@ public:
 
 
 
-extern MsgQueque<Shared_VNode> Expand_queue, Print_queue;
-
 #define EMPTY_LB_VALUE -10000.0
 #define EMPTY_UB_VALUE -9900.0
 
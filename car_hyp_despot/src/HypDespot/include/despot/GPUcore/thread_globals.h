@@ -88,6 +88,11 @@ public:
 
 //Thread ID mapping
 
+/*
+ * Search workers register their index once when they start; MapThread
+ * returns the index registered by the calling thread (0 if it never
+ * registered). Both only accept the calling thread's own id.
+ */
 void AddMappedThread(std::thread::id the_id, int mapped_id);
 int MapThread(std::thread::id the_id);
 void AddActiveThread();
@@ -153,6 +158,7 @@ void sleep_ms(int milliseconds); // cross-platform sleep function
 /* For printing debugging information in the search process of HP-DESPOT */
 #define FIX_SCENARIO 0 // 0: normal mode, 1: read scenarios and particles from files, 2: run and export scenarios and particles as files
 #define DoPrintCPU false
+#define CHECK_THREAD_MAP false // true: assert that every thread calling MapThread registered with AddMappedThread
 #define PRINT_ID 49
 #define ACTION_ID 0
 
@@ -31,6 +31,7 @@ struct Config {
 	int despot_thread_gap;
 	int expanstion_switch_thresh;
 	double time_scale;
+	bool reuse_tree; // Start each search from the subtree of the executed action and observation
 
 	Config() :
 		search_depth(90),
@@ -57,7 +58,8 @@ struct Config {
 	    experiment_mode(false),
 		despot_thread_gap(10000000),
 		expanstion_switch_thresh(2),
-		time_scale(1.0)
+		time_scale(1.0),
+		reuse_tree(false)
 	{
 		rollout_type = "INDEPENDENT";
 	}
@@ -86,6 +88,7 @@ struct Config {
 		printf("=> despot_thread_gap=%d\n", despot_thread_gap);
 		printf("=> expanstion_switch_thresh=%d\n", expanstion_switch_thresh);
 		printf("=> time_scale=%f\n", time_scale);
+		printf("=> reuse_tree=%d\n", reuse_tree);
 	}
 };
 
@@ -5,11 +5,43 @@
 #include <despot/util/util.h>
 #include <despot/random_streams.h>
 #include <despot/util/logging.h>
+#include <despot/util/flat_map.h>
+#include <despot/util/arena.h>
+#include <despot/util/atomic_float.h>
 
 namespace despot {
 
 class QNode;
 
+/* =============================================================================
+ * VNodeExtras struct
+ * =============================================================================*/
+
+/**
+ * Fields of a VNode that the CPU search loop does not touch: GPU particles,
+ * AEMS and POMCP statistics, and lets_drive priors. They live
+ * out of line so that hot nodes stay small; a node without any of them set
+ * pays for a single pointer.
+ */
+struct VNodeExtras {
+	Dvc_State* GPU_particles; // Used in GPUDESPOT
+	int num_GPU_particles; // Used in GPUDESPOT
+	Belief* belief; // Used in AEMS
+	double likelihood; // Used in AEMS
+
+	// For POMCP
+	int count; // Number of visits on the node
+	double value; // Value of the node
+
+	// lets_drive
+	std::map<ACT_TYPE, double> prior_action_probs;
+	std::vector<double> prior_steer_probs;
+	double prior_value;
+	bool prior_initialized;
+
+	VNodeExtras();
+};
+
 /* =============================================================================
  * VNode class
  * =============================================================================*/
@@ -19,46 +51,40 @@ class QNode;
  */
 class VNode: public MemoryObject {
 protected:
-  std::vector<State*> particles_; // Used in DESPOT
-    std::vector<int> particleIDs_; //Used in GPUDESPOT
-    Dvc_State* GPU_particles_; // Used in GPUDESPOT
-	Belief* belief_; // Used in AEMS
+	// Fields read on every visit of the search come first, so that a node's
+	// bounds, weight and child tables share the leading cache lines. Bounds
+	// are atomic so that concurrent backups need no lock.
+	AtomicFloat<double> lower_bound_;
+	AtomicFloat<double> upper_bound_;
+
+public:
+	AtomicFloat<double> utility_upper_bound_;
+	double weight_;
+	VNode* vstar;
+
+protected:
+	ValuedAction default_move_; // Value and action given by default policy
 	int depth_;
 	QNode* parent_;
 	OBS_TYPE edge_;
 
-	std::vector<QNode*> children_;
+	ArenaVector<QNode*> children_;
+	ArenaVector<ACT_TYPE> legal_actions_;
 
-	ValuedAction default_move_; // Value and action given by default policy
-	double lower_bound_;
-	double upper_bound_;
+	std::vector<State*> particles_; // Used in DESPOT
+	std::vector<int> particleIDs_; // Set at every expansion, used in GPUDESPOT
 
-	// For POMCP
-	int count_; // Number of visits on the node
-	double value_; // Value of the node
+	VNodeExtras* extras_; // Rarely used fields, allocated on first write
 
-public:
-	VNode* vstar;
-	double likelihood; // Used in AEMS
-	double utility_upper_bound_;
-
-	double weight_;
-  	int num_GPU_particles_;  // Used in GPUDESPOT
+	VNodeExtras& extras();
 
 // lets_drive
 protected:
-  	const double DUMMY_VALUE = 10000000;
-  	std::map<ACT_TYPE, double> prior_action_probs_;
-  	std::vector<double> prior_steer_probs_;
-
-  	std::vector<ACT_TYPE> legal_actions_;
-
-  	double prior_value_;
-
-  	bool prior_initialized_;
+  	static constexpr double DUMMY_VALUE = 10000000;
+  	friend struct VNodeExtras;
 
 public:
-  	double prior_action_probs(int i){return prior_action_probs_[i];}
+  	double prior_action_probs(int i){return extras().prior_action_probs[i];}
   	void prior_action_probs(int i, double v){
 //  		if (prior_action_probs_.size() > i)
 //  			prior_action_probs_[i]=v;
@@ -67,48 +93,49 @@ public:
 //  		else
 //  			assert(false);
 
-  		prior_action_probs_[i]=v;
+  		extras().prior_action_probs[i]=v;
   	}
   	std::map<ACT_TYPE, double>& prior_action_probs(){
-  		return prior_action_probs_;
+  		return extras().prior_action_probs;
   	}
 
-  	double prior_steer_probs(int i){return prior_steer_probs_[i];}
-  	std::vector<double>& prior_steer_probs(){return prior_steer_probs_;}
+  	double prior_steer_probs(int i){return extras().prior_steer_probs[i];}
+  	std::vector<double>& prior_steer_probs(){return extras().prior_steer_probs;}
 
   	void prior_steer_probs(int i, double v){
-		if (prior_steer_probs_.size() > i)
-			prior_steer_probs_[i]=v;
-		else if (prior_steer_probs_.size() == i)
-			prior_steer_probs_.push_back(v);
+  		std::vector<double>& probs = extras().prior_steer_probs;
+		if (probs.size() > i)
+			probs[i]=v;
+		else if (probs.size() == i)
+			probs.push_back(v);
 		else
 			assert(false);
 	}
 
-  	void legal_actions(std::vector<ACT_TYPE> actions){
-  		legal_actions_ = actions;
+  	void legal_actions(const std::vector<ACT_TYPE>& actions){
+  		legal_actions_.assign(actions.begin(), actions.end());
   	}
 
-  	std::vector<ACT_TYPE>& legal_actions(){
+  	ArenaVector<ACT_TYPE>& legal_actions(){
   		return legal_actions_;
   	}
 
 	double prior_value();
-  	void prior_value(double v){prior_value_ = v;}
+  	void prior_value(double v){extras().prior_value = v;}
 
   	void print_action_probs();
 
   	void prior_initialized(bool v){
-  		prior_initialized_ = v;
+  		extras().prior_initialized = v;
   	}
   	bool prior_initialized(){
-  		return prior_initialized_;
+  		return extras_ != NULL && extras_->prior_initialized;
   	}
   	ACT_TYPE max_prob_action();
 // lets_drive
 
 public:
-	VNode():prior_value_(DUMMY_VALUE){	prior_initialized_ = false; }
+	VNode():extras_(NULL){}
 	VNode(std::vector<State*>& particles, std::vector<int> particleIDs, int depth = 0, QNode* parent = NULL,
 		OBS_TYPE edge = (OBS_TYPE)-1);
 	VNode(Belief* belief, int depth = 0, QNode* parent = NULL, OBS_TYPE edge =
@@ -130,12 +157,14 @@ public:
 
 	double Weight();
 	bool PassGPUThreshold();
-	const std::vector<QNode*>& children() const;
-	std::vector<QNode*>& children();
+	const ArenaVector<QNode*>& children() const;
+	ArenaVector<QNode*>& children();
 	const QNode* Child(int action) const;
 	QNode* Child(int action);
 	int Size() const;
 	int PolicyTreeSize() const;
+	/* Particles held by the nodes of this subtree */
+	int NumParticles() const;
 
 	void default_move(ValuedAction move);
 	ValuedAction default_move() const;
@@ -145,6 +174,11 @@ public:
 	double upper_bound() const;
 	void utility_upper_bound(double value);
 	double utility_upper_bound() const;
+	/**
+	 * Tighten the bounds to the given values where they improve on the
+	 * current ones. Safe to call from concurrent backups.
+	 */
+	void ImproveBounds(double lower, double upper, double utility_upper);
 
 	bool IsLeaf();
 
@@ -154,13 +188,24 @@ public:
 	void value(double v);
 	double value() const;
 
+	void likelihood(double l);
+	double likelihood() const;
+
 	void PrintTree(int depth = -1, std::ostream& os = std::cout);
 	void PrintPolicyTree(int depth = -1, std::ostream& os = std::cout);
 
 	void Free(const DSPOMDP& model);
+
+	/**
+	 * Allocate the child and legal action tables from the given arena (or the
+	 * heap if NULL). Must be called before the node is expanded.
+	 */
+	void UseArena(Arena* arena);
+
 	/*GPU particle functions*/
 	void AssignGPUparticles( Dvc_State* src, int size);
-	Dvc_State* GetGPUparticles(){return GPU_particles_;};
+	Dvc_State* GetGPUparticles(){return extras_ == NULL ? NULL : extras_->GPU_particles;};
+	int num_GPU_particles() const {return extras_ == NULL ? 0 : extras_->num_GPU_particles;};
 
 	double GPUWeight();
 	void ResizeParticles(int i);
@@ -179,9 +224,9 @@ class QNode : public MemoryObject{
 protected:
 	VNode* parent_;
 	int edge_;
-	std::map<OBS_TYPE, VNode*> children_;
-	double lower_bound_;
-	double upper_bound_;
+	FlatMap<OBS_TYPE, VNode*> children_;
+	AtomicFloat<double> lower_bound_;
+	AtomicFloat<double> upper_bound_;
 
 	// For POMCP
 	int count_; // Number of visits on the node
@@ -194,7 +239,7 @@ protected:
 
 public:
 	double default_value;
-	double utility_upper_bound_;
+	AtomicFloat<double> utility_upper_bound_;
 	double step_reward;
 	double likelihood;
 
@@ -214,10 +259,14 @@ public:
 	VNode* parent();
 	int edge() const;
 	void edge(int edge) {edge_=edge;};
-	std::map<OBS_TYPE, VNode*>& children();
+	FlatMap<OBS_TYPE, VNode*>& children();
 	VNode* Child(OBS_TYPE obs);
+	/* Allocate the child table from the given arena (or the heap if NULL) */
+	void UseArena(Arena* arena);
 	int Size() const;
 	int PolicyTreeSize() const;
+	/* Particles held by the nodes of this subtree */
+	int NumParticles() const;
 
 	double Weight() /*const*/;
 
@@ -227,6 +276,8 @@ public:
 	double upper_bound() const;
 	void utility_upper_bound(double value);
 	double utility_upper_bound() const;
+	/* See VNode::ImproveBounds */
+	void ImproveBounds(double lower, double upper, double utility_upper);
 
 	void Add(double val);
 	void count(int c);
@@ -0,0 +1,80 @@
+#ifndef OBS_PARTITION_H
+#define OBS_PARTITION_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <despot/interface/pomdp.h>
+
+namespace despot {
+
+/* =============================================================================
+ * ObsPartition class
+ * =============================================================================*/
+
+/**
+ * Groups stepped particles by observation into one contiguous buffer.
+ *
+ * Groups come out in increasing observation order and particles keep their
+ * relative order inside a group, which matches partitioning through a
+ * std::map<OBS_TYPE, std::vector<State*> >. All buffers are kept between
+ * calls, so a reused partition does not allocate once it has grown.
+ */
+class ObsPartition {
+public:
+	/**
+	 * Partition the non-terminal particles by their observation.
+	 */
+	void Build(const std::vector<State*>& particles,
+		const std::vector<OBS_TYPE>& obs, const std::vector<bool>& terminals) {
+		order_.clear();
+		for (int i = 0; i < particles.size(); i++) {
+			if (!terminals[i])
+				order_.push_back(std::make_pair(obs[i], i));
+		}
+		std::sort(order_.begin(), order_.end());
+
+		particles_.resize(order_.size());
+		keys_.clear();
+		starts_.clear();
+		for (int k = 0; k < order_.size(); k++) {
+			particles_[k] = particles[order_[k].second];
+			if (k == 0 || order_[k].first != order_[k - 1].first) {
+				keys_.push_back(order_[k].first);
+				starts_.push_back(k);
+			}
+		}
+		starts_.push_back(order_.size());
+	}
+
+	/* Number of groups */
+	int size() const {
+		return keys_.size();
+	}
+
+	OBS_TYPE obs(int g) const {
+		return keys_[g];
+	}
+
+	/**
+	 * Particles of group g, copied into a buffer owned by the partition. The
+	 * reference is valid until the next call to Group or Build.
+	 */
+	std::vector<State*>& Group(int g) {
+		group_.assign(particles_.begin() + starts_[g],
+			particles_.begin() + starts_[g + 1]);
+		return group_;
+	}
+
+private:
+	std::vector<std::pair<OBS_TYPE, int> > order_;
+	std::vector<State*> particles_;
+	std::vector<OBS_TYPE> keys_;
+	std::vector<int> starts_;
+	std::vector<State*> group_;
+};
+
+} // namespace despot
+
+#endif // OBS_PARTITION_H
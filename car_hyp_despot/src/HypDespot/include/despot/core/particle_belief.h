@@ -24,12 +24,20 @@ protected:
 	int num_particles_;
 	Belief* prior_;
 	bool split_;
+	bool own_particles_;
 	std::vector<State*> initial_particles_;
 	const StateIndexer* state_indexer_;
 
+	void TakeOwnership();
+
 public:
+	/**
+	 * If own_particles is false the particles are borrowed: the caller keeps
+	 * them alive and unchanged while the belief exists, and the belief copies
+	 * them only before it has to modify them (splitting or Update).
+	 */
 	ParticleBelief(std::vector<State*> particles, const DSPOMDP* model,
-		Belief* prior = NULL, bool split = true);
+		Belief* prior = NULL, bool split = true, bool own_particles = true);
 
 	virtual ~ParticleBelief();
 	void state_indexer(const StateIndexer* indexer);
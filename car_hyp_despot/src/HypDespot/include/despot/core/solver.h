@@ -68,6 +68,12 @@ public:
 	 */
 	virtual void belief(Belief* b);
 	Belief* belief();
+
+	/**
+	 * Number of particles the solver still holds between searches, e.g. in
+	 * trees kept for reuse or waiting to be freed.
+	 */
+	virtual int NumHeldParticles();
 };
 
 } // namespace despot
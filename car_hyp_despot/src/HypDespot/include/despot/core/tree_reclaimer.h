@@ -0,0 +1,77 @@
+#ifndef TREE_RECLAIMER_H
+#define TREE_RECLAIMER_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace despot {
+
+class VNode;
+class DSPOMDP;
+class Arena;
+
+/* =============================================================================
+ * TreeReclaimer class
+ * =============================================================================*/
+
+/**
+ * Frees search trees on a background thread.
+ *
+ * Reclaim hands over a detached tree: its particles are returned to the model
+ * and its nodes deleted without blocking the caller. Trees are reclaimed in
+ * the order they were handed over. The destructor reclaims whatever is still
+ * queued before returning.
+ *
+ * The reclaimer also owns the arenas that search trees are built in. A tree
+ * built in an arena is destroyed in place, which frees what its nodes own
+ * outside the arena (particles, particle lists), and the arena is then reset
+ * and made available to a later search.
+ */
+class TreeReclaimer {
+public:
+	TreeReclaimer();
+	~TreeReclaimer();
+
+	/**
+	 * Queue a tree for freeing. The tree must not be referenced anywhere
+	 * else, and model must outlive the reclaimer. The arena the tree was
+	 * built in, if any, is reset afterwards and returned to the free list.
+	 */
+	void Reclaim(VNode* root, const DSPOMDP* model, Arena* arena = NULL);
+
+	/* An empty arena to build a tree in */
+	Arena* AcquireArena();
+
+	/* Block until every queued tree has been freed */
+	void Wait();
+
+	/* Number of trees queued or being freed */
+	int num_pending();
+
+private:
+	struct Job {
+		VNode* root;
+		const DSPOMDP* model;
+		Arena* arena;
+	};
+
+	void Loop();
+
+	std::mutex mutex_;
+	std::condition_variable work_cond_;
+	std::condition_variable idle_cond_;
+	std::deque<Job> jobs_;
+	bool busy_;
+	bool stop_;
+	std::vector<std::unique_ptr<Arena> > arenas_;
+	std::vector<Arena*> free_arenas_;
+	std::thread thread_;
+};
+
+} // namespace despot
+
+#endif // TREE_RECLAIMER_H
@@ -51,6 +51,21 @@ private:
 
 	ValuedAction RecursiveValue(const std::vector<State*>& particles,
 		RandomStreams& streams, History& history) const;
+	ValuedAction BatchValue(const std::vector<State*>& particles,
+		RandomStreams& streams, History& history) const;
+
+protected:
+	/**
+	 * Whether Action depends only on the particles it is given, not on the
+	 * history. Such policies are rolled out iteratively when rollout_type is
+	 * INDEPENDENT: at every step one action, chosen for all particles still
+	 * running, is applied to all of them. Particles are not partitioned by
+	 * observation, so the rollout follows an open-loop policy and its value
+	 * remains a lower bound.
+	 */
+	virtual bool HistoryIndependent() const {
+		return false;
+	}
 
 public:
 	DefaultPolicy(const DSPOMDP* model, ParticleLowerBound* particle_lower_bound);
@@ -143,6 +143,21 @@ public:
 	virtual bool Step(State& state, ACT_TYPE action, double& reward,
 		OBS_TYPE& obs) const;
 
+	/**
+	 * [Optional]
+	 * Steps all particles of a node under the same action. Override this to
+	 * process the particles together; the default calls Step on each of them.
+	 * @param particles  States to be stepped in place
+	 * @param action     Action to be taken
+	 * @param random_nums random_nums[i] is the random number of particles[i]
+	 * @param rewards    rewards[i] is the reward received by particles[i]
+	 * @param obs        obs[i] is the observation received by particles[i]
+	 * @param terminals  terminals[i] is whether particles[i] became terminal
+	 */
+	virtual void StepBatch(const std::vector<State*>& particles, ACT_TYPE action,
+		const std::vector<double>& random_nums, std::vector<double>& rewards,
+		std::vector<OBS_TYPE>& obs, std::vector<bool>& terminals) const;
+
 	/* ========================================================================
 	 * Action
 	 * ========================================================================*/
@@ -185,6 +200,24 @@ public:
 	virtual double ObsProb(OBS_TYPE obs, const State& state,
 		ACT_TYPE action) const = 0;
 
+	/**
+	 * [Optional]
+	 * Returns the likelihoods of particles under a belief given by samples
+	 * of it. Used to carry a search tree over to the next step: the particles
+	 * of the kept subtree are reweighted by these, and the subtree is dropped
+	 * if the belief has moved away from them. Override this if the belief can
+	 * change in ways the tree has not simulated; the default gives all
+	 * particles the same likelihood.
+	 * @param particles      Particles of the kept subtree
+	 * @param belief_samples Particles sampled from the current belief
+	 * @param likelihoods    likelihoods[i] is the likelihood of particles[i].
+	 *                       Only comparisons between calls with the same
+	 *                       samples need to be meaningful.
+	 */
+	virtual void BeliefLikelihoods(const std::vector<State*>& particles,
+		const std::vector<State*>& belief_samples,
+		std::vector<double>& likelihoods) const;
+
 	/**
 	 * [Optional]
 	 * Returns a starting state of simulation.
@@ -393,6 +426,12 @@ public:
 	virtual void CreateMemoryPool() const = 0;
 	virtual void DestroyMemoryPool(MEMORY_MODE mode) const = 0;
 
+	/**
+	 * Amount of independent work in one Step (e.g. the number of agents
+	 * moved). Sets the GPU thread dimension of a step and, on the CPU, how
+	 * many particles go into one task when a node's particles are stepped in
+	 * parallel.
+	 */
 	virtual int ParallelismInStep() const=0;
 
 	
@@ -63,7 +63,7 @@ protected:
 	State* state_;
 	Belief* belief_;
 	//std::string belief_type_;
-	//Solver* solver_;
+	Solver* solver_;
 	clock_t start_clockt_;
 
 	std::string world_type_;
@@ -78,6 +78,14 @@ protected:
 	double total_discounted_reward_;
 	double total_undiscounted_reward_;
 
+	// Particles allocated from the model and not held by the solver at the
+	// end of the last step, and the most seen at the end of any step
+	int active_particles_;
+	int peak_particles_;
+	int particle_leak_count_;
+
+	void TrackParticles();
+
 public:
 	Logger(DSPOMDP* model, Belief* belief, Solver* solver, World* world,
 			std::string world_type, clock_t start_clockt, std::ostream* out,
@@ -118,6 +126,16 @@ public:
 		model_ = m;
 	}
 
+	/**
+	 * Growth of the number of particles allocated at the end of a step beyond
+	 * the peak of the earlier steps. It settles once search trees and beliefs
+	 * have reached their working size; particles leaked every step make it
+	 * climb.
+	 */
+	inline int particle_leak_count() const {
+		return particle_leak_count_;
+	}
+
 	virtual void InitRound(State* state);
 	virtual double EndRound(); // Return total undiscounted reward for this round.
 	virtual bool SummarizeStep(int step, int round, bool terminal, ACT_TYPE action,
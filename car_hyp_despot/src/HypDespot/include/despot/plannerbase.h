@@ -64,6 +64,7 @@ enum OptionIndex {
 	E_EXP_MODE,
 	E_THREAD_GAP,
 	E_SWITCH_THRESH,
+	E_REUSE_TREE,
 };
 
 option::Descriptor* BuildUsage(string lower_bounds_str,
@@ -155,6 +156,8 @@ const option::Descriptor usage[] =
 					"  \t--freq <arg>  \tFrequency launching a despot thread (default num_threads)." },
 				{ E_SWITCH_THRESH, 0, "", "switch", option::Arg::Required,
 					"  \t--switch <arg>  \tThreshold of num particles to switch to CPU expansions (default 2)." },
+				{ E_REUSE_TREE, 0, "", "reuse_tree", option::Arg::Required,
+					"  \t--reuse_tree <arg>  \tStart each search from the subtree of the executed action and observation (default false)." },
 				{ 0, 0, 0, 0, 0, 0 } };
 
 /* =============================================================================
@@ -2,8 +2,10 @@
 #define RANDOM_STREAMS_H
 
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <stdlib.h>
+#include <stdint.h>
 #include <despot/util/random.h>
 
 namespace despot {
@@ -11,22 +13,41 @@ namespace despot {
 /**
  * A RandomStreams object represents multiple random number sequences, where each
  * entry is independently and identically drawn from [0, 1].
+ *
+ * Entries are not stored: Entry(stream, position) is computed on demand from
+ * a counter-based hash of (seed, stream, position), so constructing and
+ * copying a RandomStreams is O(1). Optionally the first depths, which the
+ * search visits most, are kept in one contiguous table shared by all copies.
+ * Streams imported from a file are always kept in full.
  */
 class RandomStreams {
 private:
 	mutable int position_;
 
-public:
-	  std::vector<std::vector<double> > streams_; // streams_[i] is associated with i-th particle
+	int num_streams_;
+	int length_;
+	uint64_t seed_;
+	int offset_; // Entries dropped from the front of every stream
+	bool imported_; // Entries read by ImportStream rather than hashed
+
+	int cached_depth_;
+	// Entries of depths [0, cached_depth_), cached_depth_ per stream
+	std::shared_ptr<const std::vector<double> > cache_;
+
+	static double Hash(uint64_t seed, int stream, int position);
+	void FillCache(int cached_depth);
 
+public:
 	/**
 	 * Constructs multiple random sequences of the same length.
 	 *
 	 * @param num_streams number of sequences
 	 * @param length sequence length
+	 * @param cached_depth number of leading entries of each sequence to
+	 * precompute
 	 */
-	RandomStreams(int num_streams, int length);
-	RandomStreams(){;}
+	RandomStreams(int num_streams, int length, int cached_depth = 0);
+	RandomStreams();
 	/**
 	 * Returns the number of sequences.
 	 */
@@ -45,13 +66,26 @@ public:
 
 	bool Exhausted() const;
 
-	double Entry(int stream) const;
-	double Entry(int stream, int position) const;
+	/**
+	 * Drop the first steps entries of every stream: Entry(stream, p) returns
+	 * what Entry(stream, p + steps) returned before. The streams keep their
+	 * length, fresh entries are appended at the end. Imported streams have
+	 * no entries beyond their length and are left unchanged.
+	 */
+	void Shift(int steps);
+
+	double Entry(int stream) const {
+		return Entry(stream, position_);
+	}
+
+	double Entry(int stream, int position) const {
+		if (position < cached_depth_)
+			return (*cache_)[stream * cached_depth_ + position];
+		return Hash(seed_, stream, offset_ + position);
+	}
 
 	friend std::ostream& operator<<(std::ostream& os, const RandomStreams& stream);
 	void ImportStream(std::istream& in,int num_streams, int length);
-
-	RandomStreams(const RandomStreams& src);
 };
 
 } // namespace despot
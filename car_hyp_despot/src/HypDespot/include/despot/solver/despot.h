@@ -7,10 +7,14 @@
 #include <despot/core/node.h>
 #include <despot/core/globals.h>
 #include <despot/core/history.h>
+#include <despot/core/tree_reclaimer.h>
 #include <despot/random_streams.h>
 #include <despot/GPUcore/shared_node.h>
 #include <despot/GPUcore/shared_solver.h>
 #include <despot/util/memorypool.h>
+#include <despot/util/arena.h>
+#include <despot/util/work_stealing.h>
+#include <despot/util/thread_pool.h>
 
 namespace despot {
 class Dvc_RandomStreams;
@@ -41,6 +45,7 @@ friend class VNode;
 
 protected:
 	VNode* root_;
+	std::vector<VNode*> retained_roots_; // Subtrees to resume the next search from
 	Shared_SearchStatistics statistics_;
 
 	ScenarioLowerBound* lower_bound_;
@@ -57,6 +62,9 @@ protected:
 	bool use_nn_prior;
 	/************** Let's drive ************/
 
+	// Frees discarded trees off the search thread
+	TreeReclaimer reclaimer_;
+
 
 public:
 	DESPOT(const DSPOMDP* model, ScenarioLowerBound* lb, ScenarioUpperBound* ub, Belief* belief = NULL, bool use_GPU=false);
@@ -67,6 +75,25 @@ public:
 	void belief(Belief* b);
 	void BeliefUpdate(ACT_TYPE action, OBS_TYPE obs);
 
+	/**
+	 * Keep the subtree under the executed action and the received observation
+	 * as the root of the next search, and free the rest of the last tree.
+	 * Does nothing unless tree reuse is enabled.
+	 */
+	void RetainSubtree(ACT_TYPE action, OBS_TYPE obs);
+	/**
+	 * Keep all subtrees under the executed action, for when the observation
+	 * is not known until the belief is updated. The next search resumes the
+	 * one that best matches its belief (see SelectRetainedSubtree).
+	 */
+	void RetainSubtree(ACT_TYPE action);
+
+	/**
+	 * Particles in the trees kept for the next search. Waits for the
+	 * reclaimer to free the trees handed to it first.
+	 */
+	virtual int NumHeldParticles();
+
 	ScenarioLowerBound* lower_bound() const;
 	ScenarioUpperBound* upper_bound() const;
 
@@ -74,8 +101,53 @@ public:
 		ScenarioLowerBound* lower_bound, ScenarioUpperBound* upper_bound,
 		const DSPOMDP* model, History& history, double timeout,
 		SearchStatistics* statistics = NULL);
+	static VNode* ExpandTree(VNode* root, RandomStreams& streams,
+		ScenarioLowerBound* lower_bound, ScenarioUpperBound* upper_bound,
+		const DSPOMDP* model, History& history, double timeout,
+		SearchStatistics* statistics = NULL);
+
+	/**
+	 * Call job(i) for i = 0..n-1, spread over the search threads when
+	 * HyP-DESPOT runs multi-threaded. Lets planning work outside the search
+	 * (e.g. belief sampling) use the otherwise idle threads; must not be
+	 * called while a search is running. MapThread gives the index of the
+	 * thread running a job.
+	 */
+	static void ParallelFor(int n, const std::function<void(int)>& job);
+
+	/**
+	 * Index of the subtree to resume a search from: the one whose particles
+	 * keep the most weight when reweighted by likelihoods[k][i], the
+	 * likelihood of particle i of subtrees[k] under the current belief.
+	 * Returns -1 if there is none, or if its reweighted particles amount to
+	 * fewer than min_effective scenarios (effective sample size), i.e. the
+	 * belief has moved away from what the tree simulated.
+	 */
+	static int SelectRetainedSubtree(const std::vector<VNode*>& subtrees,
+		const std::vector<std::vector<double> >& likelihoods,
+		double min_effective);
+	/**
+	 * Multiply the weight of every particle in the tree by
+	 * scales[scenario_id], renormalized so that the root weighs 1, and
+	 * rescale the values of every node by the weight it keeps. Values below
+	 * a node are taken not to depend on which of its particles carry the
+	 * weight; bounds are then backed up again.
+	 */
+	static void ReweightSubtree(VNode* root, const std::vector<double>& scales);
 
 protected:
+	bool TreeReuseEnabled() const;
+	void RetainSubtrees(ACT_TYPE action, const OBS_TYPE* obs);
+	VNode* ResumeRetainedSubtree(const std::vector<State*>& belief_samples);
+	/**
+	 * Construct a node in search_arena_ if set, else from pool, else with
+	 * new if pool is NULL.
+	 */
+	template<class T, class... Args>
+	static T* NewNode(MemoryPool<T>* pool, Args&&... args);
+	static void RebaseSubtree(VNode* vnode, double value_scale, double weight_scale);
+	static void RescaleSubtree(VNode* vnode, const std::vector<double>& scales);
+
 	static VNode* Trial(VNode* root, RandomStreams& streams,
 		ScenarioLowerBound* lower_bound, ScenarioUpperBound* upper_bound,
 		const DSPOMDP* model, History& history, SearchStatistics* statistics =
@@ -175,11 +247,11 @@ protected:
 	void PrintStatisticResult();
 
 
-	static void ExpandTreeServer(RandomStreams streams,
+	static void ExpandTreeServer(Shared_VNode* root, RandomStreams streams,
 			ScenarioLowerBound* lower_bound, ScenarioUpperBound* upper_bound,
 			const DSPOMDP* model, History history, Shared_SearchStatistics* statistics,
 			double& used_time,double& explore_time,double& backup_time,int& num_trials,double timeout,
-			MsgQueque<Shared_VNode>& node_queue, MsgQueque<Shared_VNode>& print_queue, int threadID);
+			WorkStealingScheduler& scheduler, int threadID);
 
 	static float CalExplorationValue(int depth);
 	static void CalExplorationValue(Shared_QNode* node);
@@ -209,6 +281,14 @@ public:
 
 	static MemoryPool<VNode> vnode_pool_;
 	static MemoryPool<Shared_VNode> s_vnode_pool_;
+
+	// Arena the current search builds its tree in; NULL to use the pools
+	static Arena* search_arena_;
+
+	// Hands out search trials and expansion work to the HyP-DESPOT threads
+	static WorkStealingScheduler task_scheduler_;
+	// Search threads, kept alive across calls to Search
+	static ThreadPool search_pool_;
 	/************** HyP-DESPOT ************/
 
 public: // lets_drive
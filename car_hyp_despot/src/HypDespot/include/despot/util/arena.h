@@ -0,0 +1,121 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace despot {
+
+/* =============================================================================
+ * Arena class
+ * =============================================================================*/
+
+/**
+ * Bump allocator for objects that are all released together.
+ *
+ * Memory is handed out from large blocks. Each thread bumps a pointer through
+ * a block of its own, so concurrent allocations only synchronize when a block
+ * runs out. Individual objects are never freed: Reset rewinds the arena in
+ * constant time and keeps its blocks for reuse, without running destructors.
+ * Reset must not be called while other threads allocate from the arena.
+ */
+class Arena {
+public:
+	Arena(size_t block_size = 1 << 20);
+	~Arena();
+
+	void* Allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+	template<class T, class... Args>
+	T* New(Args&&... args) {
+		return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	}
+
+	void Reset();
+
+	/* Number of blocks handed out since the last reset */
+	int num_used_blocks() const;
+	/* Bytes held by the arena, used or not */
+	size_t capacity() const;
+
+private:
+	char* NewBlock(size_t size);
+
+	const size_t block_size_;
+	long epoch_; // Changes at every reset; invalidates the threads' blocks
+
+	mutable std::mutex mutex_;
+	std::vector<char*> blocks_;
+	size_t next_block_;
+	std::vector<char*> large_blocks_; // Oversized allocations, freed on reset
+	size_t large_bytes_;
+};
+
+/* =============================================================================
+ * ArenaAllocator class
+ * =============================================================================*/
+
+/**
+ * Standard allocator drawing from an Arena, or from the heap when no arena
+ * is given. Deallocation is a no-op for arena memory. Copies of a container
+ * are put on the heap; moves keep the source's arena.
+ */
+template<class T>
+class ArenaAllocator {
+public:
+	typedef T value_type;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	ArenaAllocator(Arena* arena = NULL) :
+		arena_(arena) {
+	}
+
+	template<class U>
+	ArenaAllocator(const ArenaAllocator<U>& other) :
+		arena_(other.arena()) {
+	}
+
+	T* allocate(size_t n) {
+		if (arena_ == NULL)
+			return static_cast<T*>(::operator new(n * sizeof(T)));
+		return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T* p, size_t n) {
+		if (arena_ == NULL)
+			::operator delete(p);
+	}
+
+	ArenaAllocator select_on_container_copy_construction() const {
+		return ArenaAllocator();
+	}
+
+	Arena* arena() const {
+		return arena_;
+	}
+
+private:
+	Arena* arena_;
+};
+
+template<class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+	return a.arena() == b.arena();
+}
+
+template<class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+	return a.arena() != b.arena();
+}
+
+template<class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+} // namespace despot
+
+#endif // ARENA_H
@@ -0,0 +1,99 @@
+#ifndef ATOMIC_FLOAT_H
+#define ATOMIC_FLOAT_H
+
+#include <atomic>
+
+namespace despot {
+
+/* =============================================================================
+ * AtomicFloat class
+ * =============================================================================*/
+
+/**
+ * Floating point value that threads can update without a lock.
+ *
+ * Arithmetic updates and the monotone StoreMax/StoreMin are compare-and-swap
+ * loops, so concurrent updates are never lost. The value is a statistic that
+ * publishes no other data, hence all accesses are relaxed. Reads and plain
+ * assignments look like those of the underlying type.
+ */
+template<class T>
+class AtomicFloat {
+public:
+	AtomicFloat(T value = 0) :
+		value_(value) {
+	}
+
+	AtomicFloat(const AtomicFloat& other) :
+		value_(other.load()) {
+	}
+
+	AtomicFloat& operator=(const AtomicFloat& other) {
+		store(other.load());
+		return *this;
+	}
+
+	AtomicFloat& operator=(T value) {
+		store(value);
+		return *this;
+	}
+
+	operator T() const {
+		return load();
+	}
+
+	T load() const {
+		return value_.load(std::memory_order_relaxed);
+	}
+
+	void store(T value) {
+		value_.store(value, std::memory_order_relaxed);
+	}
+
+	AtomicFloat& operator+=(T delta) {
+		T cur = load();
+		while (!value_.compare_exchange_weak(cur, cur + delta,
+				std::memory_order_relaxed))
+			;
+		return *this;
+	}
+
+	AtomicFloat& operator-=(T delta) {
+		return *this += -delta;
+	}
+
+	AtomicFloat& operator*=(T factor) {
+		T cur = load();
+		while (!value_.compare_exchange_weak(cur, cur * factor,
+				std::memory_order_relaxed))
+			;
+		return *this;
+	}
+
+	/* Raise the value to v if v is larger; returns whether it changed */
+	bool StoreMax(T v) {
+		T cur = load();
+		while (v > cur) {
+			if (value_.compare_exchange_weak(cur, v, std::memory_order_relaxed))
+				return true;
+		}
+		return false;
+	}
+
+	/* Lower the value to v if v is smaller; returns whether it changed */
+	bool StoreMin(T v) {
+		T cur = load();
+		while (v < cur) {
+			if (value_.compare_exchange_weak(cur, v, std::memory_order_relaxed))
+				return true;
+		}
+		return false;
+	}
+
+private:
+	std::atomic<T> value_;
+};
+
+} // namespace despot
+
+#endif // ATOMIC_FLOAT_H
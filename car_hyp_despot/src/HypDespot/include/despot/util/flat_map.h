@@ -0,0 +1,117 @@
+#ifndef FLAT_MAP_H
+#define FLAT_MAP_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <despot/util/arena.h>
+
+namespace despot {
+
+/* =============================================================================
+ * FlatMap class
+ * =============================================================================*/
+
+/**
+ * Map kept as a vector of (key, value) pairs sorted by key.
+ *
+ * Meant for small maps that are mostly built once and then iterated, such as
+ * the observation children of a QNode: entries live in one allocation,
+ * iteration is in key order as with std::map, and appending keys in
+ * increasing order costs O(1). Inserting or erasing in the middle moves the
+ * later entries, and invalidates iterators and references like std::vector.
+ * The entries can be placed in an Arena, see UseArena.
+ */
+template<class K, class V>
+class FlatMap {
+public:
+	typedef K key_type;
+	typedef V mapped_type;
+	typedef std::pair<K, V> value_type;
+	typedef typename ArenaVector<value_type>::iterator iterator;
+	typedef typename ArenaVector<value_type>::const_iterator const_iterator;
+
+	FlatMap(Arena* arena = NULL) :
+		entries_(ArenaAllocator<value_type>(arena)) {
+	}
+
+	/**
+	 * Allocate the entries from the given arena (or the heap if NULL) from
+	 * now on. Existing entries are dropped.
+	 */
+	void UseArena(Arena* arena) {
+		entries_ = ArenaVector<value_type>(ArenaAllocator<value_type>(arena));
+	}
+
+	iterator begin() {
+		return entries_.begin();
+	}
+	iterator end() {
+		return entries_.end();
+	}
+	const_iterator begin() const {
+		return entries_.begin();
+	}
+	const_iterator end() const {
+		return entries_.end();
+	}
+
+	size_t size() const {
+		return entries_.size();
+	}
+	bool empty() const {
+		return entries_.empty();
+	}
+	void clear() {
+		entries_.clear();
+	}
+	void reserve(size_t n) {
+		entries_.reserve(n);
+	}
+
+	iterator find(const K& key) {
+		iterator it = LowerBound(key);
+		return (it != end() && it->first == key) ? it : end();
+	}
+
+	const_iterator find(const K& key) const {
+		return const_cast<FlatMap*>(this)->find(key);
+	}
+
+	size_t count(const K& key) const {
+		return find(key) != end();
+	}
+
+	V& operator[](const K& key) {
+		iterator it = LowerBound(key);
+		if (it == end() || it->first != key)
+			it = entries_.insert(it, value_type(key, V()));
+		return it->second;
+	}
+
+	size_t erase(const K& key) {
+		iterator it = find(key);
+		if (it == end())
+			return 0;
+		entries_.erase(it);
+		return 1;
+	}
+
+private:
+	static bool KeyLess(const value_type& entry, const K& key) {
+		return entry.first < key;
+	}
+
+	iterator LowerBound(const K& key) {
+		// Fast path for keys arriving in increasing order
+		if (entries_.empty() || entries_.back().first < key)
+			return entries_.end();
+		return std::lower_bound(entries_.begin(), entries_.end(), key, KeyLess);
+	}
+
+	ArenaVector<value_type> entries_;
+};
+
+} // namespace despot
+
+#endif // FLAT_MAP_H
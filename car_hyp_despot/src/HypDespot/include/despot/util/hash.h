@@ -0,0 +1,51 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+
+namespace despot {
+
+/* =============================================================================
+ * FNVHash class
+ * =============================================================================*/
+
+/**
+ * Streaming 64-bit FNV-1a hash of a sequence of ints. Elements are fed one at
+ * a time, so an observation can be hashed while it is computed, without
+ * building a vector first. Holds no shared state and is safe to use from any
+ * number of threads.
+ */
+class FNVHash {
+public:
+	FNVHash() :
+		value_(OffsetBasis) {
+	}
+
+	inline void Add(int v) {
+		uint32_t u = static_cast<uint32_t>(v);
+		for (int b = 0; b < 4; b++) {
+			value_ ^= (u & 0xff);
+			value_ *= Prime;
+			u >>= 8;
+		}
+	}
+
+	inline void Add(const int* v, int size) {
+		for (int i = 0; i < size; i++)
+			Add(v[i]);
+	}
+
+	inline uint64_t value() const {
+		return value_;
+	}
+
+private:
+	static const uint64_t OffsetBasis = 14695981039346656037ULL;
+	static const uint64_t Prime = 1099511628211ULL;
+
+	uint64_t value_;
+};
+
+} // namespace despot
+
+#endif // HASH_H
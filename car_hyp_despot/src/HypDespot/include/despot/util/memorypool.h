@@ -4,12 +4,21 @@
 #include <cassert>
 #include <vector>
 #include <ostream>
+#include <mutex>
+#include <atomic>
+#include <utility>
+#include <new>
 #include <despot/GPUcore/thread_globals.h>
 
 namespace despot {
 
 class MemoryObject {
 public:
+	MemoryObject() :
+		allocated_(false),
+		in_arena_(false) {
+	}
+
 	void SetAllocated() {
 		allocated_ = true;
 	}
@@ -20,32 +29,92 @@ public:
 		return allocated_;
 	}
 
+	/* Placed in an Arena: destroyed in place, never deleted */
+	void SetInArena() {
+		in_arena_ = true;
+	}
+	bool IsInArena() const {
+		return in_arena_;
+	}
+
 public:
 	bool allocated_;
+	bool in_arena_;
 };
 
+/* =============================================================================
+ * MemoryPool class
+ * =============================================================================*/
+
+/**
+ * Chunk-based object pool.
+ *
+ * In the default mode every Allocate/Free goes through the process-wide lock.
+ * In thread-local mode each thread keeps its own free list: allocations and
+ * frees are served from it without locking, it is refilled from the shared
+ * free list in batches, and it spills a batch back to the shared list when it
+ * grows too long. Objects freed by a thread other than the one that allocated
+ * them simply join the freeing thread's list, so objects migrate between
+ * threads through the shared list. A thread's list is returned to the pool
+ * when the thread exits.
+ */
 template<class T>
 class MemoryPool {
 public:
-	MemoryPool() :
+	MemoryPool(bool thread_local_cache = false) :
+		thread_local_cache_(thread_local_cache),
+		num_local_ops_(0),
+		num_locked_ops_(0),
 		num_allocated_(0) {
 	}
 
 	~MemoryPool() {
+		// Detach the lists of live threads; they are dropped when those exit
+		Globals::lock_process();
+		{
+			std::lock_guard<std::mutex> lck(mutex_);
+			for (int i = 0; i < caches_.size(); i++)
+				caches_[i]->owner = NULL;
+			caches_.clear();
+		}
+		Globals::unlock_process();
+
 		DeleteAll();
 	}
 
-	T* Construct() {
+	/**
+	 * Enable or disable the per-thread free lists. Must be called while no
+	 * other thread is using the pool.
+	 */
+	void UseThreadLocalCache(bool enable) {
+		thread_local_cache_ = enable;
+	}
+
+	bool UseThreadLocalCache() const {
+		return thread_local_cache_;
+	}
+
+	template<class... Args>
+	T* Construct(Args&&... args) {
 		T* obj = Allocate();
-		return new (obj) T;
+		obj->~T();
+		new (obj) T(std::forward<Args>(args)...);
+		obj->SetAllocated();
+		return obj;
 	}
 
 	void Destroy(T* obj) {
-		obj.T::~T();
+		obj->~T();
+		// Chunks own constructed objects; put back a default one in the slot
+		new (obj) T;
+		obj->SetAllocated();
 		Free(obj);
 	}
 
 	T* Allocate() {
+		if (thread_local_cache_)
+			return LocalAllocate();
+
 		Globals::lock_process();
 
 		if (freelist_.empty())
@@ -57,6 +126,7 @@ public:
 		assert(!obj->IsAllocated());
 		obj->SetAllocated();
 		num_allocated_++;
+		num_locked_ops_++;
 
 		Globals::unlock_process();
 
@@ -64,17 +134,29 @@ public:
 	}
 
 	void Free(T* obj) {
+		if (thread_local_cache_) {
+			LocalFree(obj);
+			return;
+		}
+
 		Globals::lock_process();
 
 		assert(obj->IsAllocated());
 		obj->ClearAllocated();
 		freelist_.push_back(obj);
 		num_allocated_--;
+		num_locked_ops_++;
 
 		Globals::unlock_process();
 	}
 
 	void DeleteAll() {
+		std::lock_guard<std::mutex> lck(mutex_);
+		for (int i = 0; i < caches_.size(); i++) {
+			caches_[i]->objects.clear();
+			caches_[i]->net_allocated.store(0, std::memory_order_relaxed);
+		}
+
 		for (chunk_iterator_ i_chunk = chunks_.begin();
 			i_chunk != chunks_.end(); ++i_chunk)
 			delete *i_chunk;
@@ -84,7 +166,51 @@ public:
 	}
 
 	int num_allocated() const {
-		return num_allocated_;
+		if (!thread_local_cache_)
+			return num_allocated_;
+
+		std::lock_guard<std::mutex> lck(mutex_);
+		int total = num_allocated_;
+		for (int i = 0; i < caches_.size(); i++)
+			total += caches_[i]->net_allocated.load(std::memory_order_relaxed);
+		return total;
+	}
+
+	/**
+	 * Number of Allocate/Free calls served from a thread-local free list, i.e.
+	 * lock acquisitions avoided.
+	 */
+	long long num_local_ops() const {
+		std::lock_guard<std::mutex> lck(mutex_);
+		long long total = num_local_ops_;
+		for (int i = 0; i < caches_.size(); i++)
+			total += caches_[i]->local_ops.load(std::memory_order_relaxed);
+		return total;
+	}
+
+	/**
+	 * Number of times a lock was taken: every call in the default mode, and
+	 * batch refills/spills in thread-local mode.
+	 */
+	long long num_locked_ops() const {
+		std::lock_guard<std::mutex> lck(mutex_);
+		return num_locked_ops_;
+	}
+
+	void PrintStatistics(std::ostream& out) const {
+		long long local_ops = num_local_ops(), locked_ops = num_locked_ops();
+		out << "allocated=" << num_allocated()
+			<< ", chunks=" << chunks_.size()
+			<< ", lock-free ops=" << local_ops
+			<< ", locked ops=" << locked_ops;
+		if (local_ops + locked_ops > 0)
+			out << " (" << 100.0 * local_ops / (local_ops + locked_ops)
+				<< "% without lock)";
+	}
+
+	friend std::ostream& operator<<(std::ostream& os, const MemoryPool& pool) {
+		pool.PrintStatistics(os);
+		return os;
 	}
 
 private:
@@ -93,6 +219,148 @@ private:
 		T Objects[Size];
 	};
 
+	/* Objects moved between a thread-local list and the shared list at once */
+	static const int BatchSize = Chunk::Size / 4;
+
+	struct LocalCache {
+		MemoryPool* owner;
+		std::vector<T*> objects;
+		// Only written by the owning thread; read by num_allocated()/statistics
+		std::atomic<int> net_allocated;
+		std::atomic<long long> local_ops;
+
+		LocalCache(MemoryPool* pool) :
+			owner(pool),
+			net_allocated(0),
+			local_ops(0) {
+			objects.reserve(2 * BatchSize + 1);
+		}
+	};
+
+	/* The local lists of one thread, one per pool it has touched */
+	struct ThreadCaches {
+		std::vector<LocalCache*> caches;
+		LocalCache* last;
+
+		ThreadCaches() :
+			last(NULL) {
+		}
+
+		~ThreadCaches() {
+			Globals::lock_process();
+			for (int i = 0; i < caches.size(); i++) {
+				if (caches[i]->owner != NULL)
+					caches[i]->owner->RetireCache(caches[i]);
+				delete caches[i];
+			}
+			Globals::unlock_process();
+		}
+	};
+
+	static ThreadCaches& LocalCaches() {
+		static thread_local ThreadCaches thread_caches;
+		return thread_caches;
+	}
+
+	LocalCache* GetLocalCache() {
+		ThreadCaches& tc = LocalCaches();
+		if (tc.last != NULL && tc.last->owner == this)
+			return tc.last;
+
+		for (int i = 0; i < tc.caches.size(); i++) {
+			if (tc.caches[i]->owner == this) {
+				tc.last = tc.caches[i];
+				return tc.last;
+			}
+		}
+
+		// Drop lists whose pools have been destroyed
+		for (int i = tc.caches.size() - 1; i >= 0; i--) {
+			if (tc.caches[i]->owner == NULL) {
+				delete tc.caches[i];
+				tc.caches.erase(tc.caches.begin() + i);
+			}
+		}
+
+		LocalCache* cache = new LocalCache(this);
+		{
+			std::lock_guard<std::mutex> lck(mutex_);
+			caches_.push_back(cache);
+		}
+		tc.caches.push_back(cache);
+		tc.last = cache;
+		return cache;
+	}
+
+	T* LocalAllocate() {
+		LocalCache* cache = GetLocalCache();
+		if (cache->objects.empty()) {
+			std::lock_guard<std::mutex> lck(mutex_);
+			if (freelist_.size() < BatchSize)
+				NewChunk();
+			cache->objects.insert(cache->objects.end(),
+				freelist_.end() - BatchSize, freelist_.end());
+			freelist_.resize(freelist_.size() - BatchSize);
+			num_locked_ops_++;
+		} else
+			Increment(cache->local_ops);
+
+		T* obj = cache->objects.back();
+		cache->objects.pop_back();
+
+		assert(!obj->IsAllocated());
+		obj->SetAllocated();
+		Increment(cache->net_allocated);
+		return obj;
+	}
+
+	void LocalFree(T* obj) {
+		LocalCache* cache = GetLocalCache();
+
+		assert(obj->IsAllocated());
+		obj->ClearAllocated();
+		cache->objects.push_back(obj);
+		Decrement(cache->net_allocated);
+
+		if (cache->objects.size() > 2 * BatchSize) {
+			std::lock_guard<std::mutex> lck(mutex_);
+			freelist_.insert(freelist_.end(),
+				cache->objects.end() - BatchSize, cache->objects.end());
+			cache->objects.resize(cache->objects.size() - BatchSize);
+			num_locked_ops_++;
+		} else
+			Increment(cache->local_ops);
+	}
+
+	/* Called with the process lock held when a thread exits, which keeps the
+	 * pool from being destroyed meanwhile */
+	void RetireCache(LocalCache* cache) {
+		std::lock_guard<std::mutex> lck(mutex_);
+		freelist_.insert(freelist_.end(), cache->objects.begin(),
+			cache->objects.end());
+		num_allocated_ += cache->net_allocated.load(std::memory_order_relaxed);
+		num_local_ops_ += cache->local_ops.load(std::memory_order_relaxed);
+		for (int i = 0; i < caches_.size(); i++) {
+			if (caches_[i] == cache) {
+				caches_.erase(caches_.begin() + i);
+				break;
+			}
+		}
+		cache->owner = NULL;
+	}
+
+	template<class C>
+	static void Increment(std::atomic<C>& counter) {
+		counter.store(counter.load(std::memory_order_relaxed) + 1,
+			std::memory_order_relaxed);
+	}
+
+	template<class C>
+	static void Decrement(std::atomic<C>& counter) {
+		counter.store(counter.load(std::memory_order_relaxed) - 1,
+			std::memory_order_relaxed);
+	}
+
 	void NewChunk() {
 		Chunk* chunk = new Chunk;
 		chunks_.push_back(chunk);
@@ -102,10 +370,16 @@ private:
 		}
 	}
 
+	bool thread_local_cache_;
+	mutable std::mutex mutex_;
+	std::vector<LocalCache*> caches_;
 	std::vector<Chunk*> chunks_;
 	std::vector<T*> freelist_;
 	typedef typename std::vector<Chunk*>::iterator chunk_iterator_;
 
+	long long num_local_ops_;
+	long long num_locked_ops_;
+
 public:
 	int num_allocated_;
 };
@@ -0,0 +1,129 @@
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace despot {
+
+/* =============================================================================
+ * Philox function
+ * =============================================================================*/
+
+/**
+ * Philox4x32-10 block function (Salmon et al., "Parallel random numbers: as
+ * easy as 1, 2, 3"). Maps a 128-bit counter and a 64-bit key to 128 random
+ * bits without any state.
+ */
+inline void Philox4x32(const uint32_t counter[4], const uint32_t key[2],
+		uint32_t out[4]) {
+	const uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+	const uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+
+	uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+	uint32_t k0 = key[0], k1 = key[1];
+	for (int round = 0; round < 10; round++) {
+		uint64_t p0 = (uint64_t) M0 * c0;
+		uint64_t p1 = (uint64_t) M1 * c2;
+		uint32_t n0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+		uint32_t n2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+		c1 = (uint32_t) p1;
+		c3 = (uint32_t) p0;
+		c0 = n0;
+		c2 = n2;
+		k0 += W0;
+		k1 += W1;
+	}
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+}
+
+/* =============================================================================
+ * CounterRandom class
+ * =============================================================================*/
+
+/**
+ * Random numbers of one model step, computed from a counter instead of a
+ * shared generator state.
+ *
+ * Draws are keyed by (seed, scenario, action, agent, draw index). The seed is
+ * taken from the scenario's random-stream entry, which the solver fixes per
+ * search, scenario and depth. The same key gives the same numbers on every
+ * thread and in every run, and no two threads ever share state.
+ */
+class CounterRandom {
+public:
+	/* Agent slot of the ego-vehicle's draws */
+	static const int CAR = -1;
+
+	CounterRandom() {
+		Init(0, 0, 0);
+	}
+
+	CounterRandom(double stream_entry, int scenario, int action) {
+		uint64_t bits;
+		memcpy(&bits, &stream_entry, sizeof(bits));
+		Init(bits, scenario, action);
+	}
+
+	CounterRandom(uint64_t seed, int scenario, int action) {
+		Init(seed, scenario, action);
+	}
+
+	/**
+	 * Independent sequence for one agent of the same step; agent is the
+	 * agent's id, or CAR.
+	 */
+	CounterRandom ForAgent(int agent) const {
+		CounterRandom random(*this);
+		random.counter_[2] = (uint32_t) agent;
+		random.counter_[3] = 0;
+		random.used_ = 4;
+		return random;
+	}
+
+	/* Uniform in (0, 1) */
+	double NextDouble() {
+		if (used_ == 4)
+			NextBlock();
+		uint64_t hi = block_[used_++], lo = block_[used_++];
+		uint64_t bits = ((hi << 32) | lo) >> 11; // 53 bits
+		return (bits + 0.5) * (1.0 / 9007199254740992.0);
+	}
+
+	/* Standard normal, by the Box-Muller transform */
+	double NextGaussian() {
+		double u1 = NextDouble();
+		double u2 = NextDouble();
+		return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+	}
+
+private:
+	void Init(uint64_t seed, int scenario, int action) {
+		key_[0] = (uint32_t) seed;
+		key_[1] = (uint32_t) (seed >> 32);
+		counter_[0] = (uint32_t) scenario;
+		counter_[1] = (uint32_t) action;
+		counter_[2] = (uint32_t) CAR;
+		counter_[3] = 0;
+		used_ = 4;
+	}
+
+	void NextBlock() {
+		Philox4x32(counter_, key_, block_);
+		counter_[3]++;
+		used_ = 0;
+	}
+
+	uint32_t key_[2];
+	uint32_t counter_[4]; // scenario, action, agent, block
+	uint32_t block_[4];
+	int used_;
+};
+
+} // namespace despot
+
+#endif // PHILOX_H
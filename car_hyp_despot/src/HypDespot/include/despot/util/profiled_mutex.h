@@ -0,0 +1,62 @@
+#ifndef PROFILED_MUTEX_H
+#define PROFILED_MUTEX_H
+
+#include <functional>
+#include <mutex>
+
+namespace despot {
+
+/* =============================================================================
+ * ProfiledMutex class
+ * =============================================================================*/
+
+/**
+ * Mutex that records how long threads wait for it.
+ *
+ * Uncontended locking costs a single try_lock. When the mutex is held by
+ * another thread, the wait is timed and added to process-wide totals, which
+ * Contention() reports and ResetContention() clears (e.g. once per search).
+ */
+class ProfiledMutex {
+public:
+	struct Profile {
+		long num_waits; // Lock calls that found the mutex held
+		double wait_time; // Total time spent waiting, in seconds
+	};
+
+	void lock() {
+		if (!mutex_.try_lock())
+			LockSlow();
+	}
+
+	/**
+	 * Lock, running help() instead of sleeping while the mutex is held
+	 * elsewhere. help returns whether it found something to do; only the
+	 * time spent without work counts as waiting.
+	 */
+	void lock(const std::function<bool()>& help) {
+		if (!mutex_.try_lock())
+			LockHelping(help);
+	}
+
+	bool try_lock() {
+		return mutex_.try_lock();
+	}
+
+	void unlock() {
+		mutex_.unlock();
+	}
+
+	static Profile Contention();
+	static void ResetContention();
+
+private:
+	void LockSlow();
+	void LockHelping(const std::function<bool()>& help);
+
+	std::mutex mutex_;
+};
+
+} // namespace despot
+
+#endif // PROFILED_MUTEX_H
@@ -0,0 +1,59 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace despot {
+
+/* =============================================================================
+ * ThreadPool class
+ * =============================================================================*/
+
+/**
+ * Persistent pool of worker threads.
+ *
+ * Run(n, job) calls job(i) on worker i for i = 0..n-1 and returns once all
+ * calls have returned. Workers are created on first use, pinned to a core
+ * each, and sleep between runs, so repeated runs do not pay for thread
+ * creation. Worker i is the same thread in every run. An exception thrown by
+ * a job is rethrown by Run.
+ */
+class ThreadPool {
+public:
+	typedef std::function<void(int)> Job;
+
+	ThreadPool(bool pin_threads = true);
+	~ThreadPool();
+
+	void Run(int num_jobs, const Job& job);
+
+	int size() const {
+		return threads_.size();
+	}
+
+private:
+	void WorkerLoop(int worker);
+	void Pin(std::thread& t, int worker);
+
+	bool pin_threads_;
+	std::vector<std::thread> threads_;
+
+	std::mutex mutex_;
+	std::condition_variable start_cond_;
+	std::condition_variable done_cond_;
+	Job job_;
+	int num_jobs_;
+	long generation_;
+	int running_;
+	bool stop_;
+	std::exception_ptr error_;
+};
+
+} // namespace despot
+
+#endif // THREAD_POOL_H
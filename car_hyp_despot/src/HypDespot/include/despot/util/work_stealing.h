@@ -0,0 +1,152 @@
+#ifndef WORK_STEALING_H
+#define WORK_STEALING_H
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace despot {
+
+/* =============================================================================
+ * WorkStealingScheduler class
+ * =============================================================================*/
+
+/**
+ * Task scheduler for the search threads of HyP-DESPOT.
+ *
+ * Every worker owns a deque of trial tasks and a deque of leaf tasks (node
+ * expansions, bound initializations, rollouts). A worker pops its own tasks
+ * from the back and, when it runs out, steals from the front of the other
+ * workers' deques, leaf tasks first. Each deque has its own lock, so workers
+ * only contend when they steal.
+ *
+ * Leaf tasks must not wait on other tasks. A trial may fan leaf tasks out
+ * through a TaskGroup and wait for them, helping with leaf tasks meanwhile;
+ * trials never run nested inside another task, so per-thread search state
+ * is never re-entered.
+ *
+ * The scheduler records, per worker, the time spent running tasks and the
+ * time spent looking for work.
+ */
+class WorkStealingScheduler {
+public:
+	/* A task receives the index of the worker running it */
+	typedef std::function<void(int)> Task;
+
+	enum TaskKind {
+		TRIAL,
+		LEAF
+	};
+
+	WorkStealingScheduler();
+
+	/**
+	 * Prepare num_workers empty deques and clear the statistics. Must be
+	 * called while no worker is running.
+	 */
+	void Reset(int num_workers);
+
+	int num_workers() const {
+		return workers_.size();
+	}
+
+	/**
+	 * Push a task to the back of the given worker's deque. pending, if not
+	 * NULL, is decremented once the task has run.
+	 */
+	void Submit(int worker, const Task& task, TaskKind kind = LEAF,
+		std::atomic<int>* pending = NULL);
+
+	/**
+	 * Run one task of the worker's own deques or, failing that, one stolen
+	 * from another worker. Returns false if no task was found.
+	 */
+	bool RunOne(int worker, bool leaf_only = false);
+
+	/**
+	 * Worker loop: run tasks until none is queued or running anywhere.
+	 */
+	void Run(int worker);
+
+	/* Count time (in seconds) the worker spent waiting for work */
+	void AddIdleTime(int worker, double time);
+
+	void PrintUtilization(std::ostream& out) const;
+	friend std::ostream& operator<<(std::ostream& os,
+		const WorkStealingScheduler& scheduler);
+
+private:
+	struct Entry {
+		Task task;
+		std::atomic<int>* pending;
+	};
+
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Entry> trials;
+		std::deque<Entry> leaves;
+
+		// Only written by the worker itself
+		double busy_time;
+		double idle_time;
+		long num_tasks;
+		long num_stolen;
+
+		Worker() :
+			busy_time(0),
+			idle_time(0),
+			num_tasks(0),
+			num_stolen(0) {
+		}
+	};
+
+	bool Pop(int worker, bool leaf_only, Entry& entry);
+	bool Steal(int worker, bool leaf_only, Entry& entry);
+
+	std::vector<std::unique_ptr<Worker> > workers_;
+	std::atomic<int> outstanding_; // tasks queued or running
+};
+
+/* =============================================================================
+ * TaskGroup class
+ * =============================================================================*/
+
+/**
+ * Set of leaf tasks submitted by one worker that it can wait for.
+ */
+class TaskGroup {
+public:
+	TaskGroup(WorkStealingScheduler& scheduler, int worker) :
+		scheduler_(scheduler),
+		worker_(worker),
+		pending_(0) {
+	}
+
+	~TaskGroup() {
+		Wait();
+	}
+
+	void Submit(const WorkStealingScheduler::Task& task) {
+		pending_++;
+		scheduler_.Submit(worker_, task, WorkStealingScheduler::LEAF, &pending_);
+	}
+
+	/**
+	 * Return once all tasks of the group have run, running leaf tasks of
+	 * any worker in the meantime.
+	 */
+	void Wait();
+
+private:
+	WorkStealingScheduler& scheduler_;
+	int worker_;
+	std::atomic<int> pending_;
+};
+
+} // namespace despot
+
+#endif // WORK_STEALING_H
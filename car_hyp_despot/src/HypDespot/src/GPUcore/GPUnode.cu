@@ -8,8 +8,8 @@ namespace despot {
 
 void VNode::AssignGPUparticles( Dvc_State* src, int size)
 {
-	GPU_particles_=src;
-	num_GPU_particles_=size;
+	extras().GPU_particles=src;
+	extras().num_GPU_particles=size;
 }
 
 __global__ void CalWeight(double* result, Dvc_State* particles, int size)
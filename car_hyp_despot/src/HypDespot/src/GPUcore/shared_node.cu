@@ -4,35 +4,37 @@
 using namespace std;
 
 namespace despot {
-MsgQueque<Shared_VNode> Expand_queue, Print_queue;
 /* =============================================================================
  * Shared_VNode class
  * =============================================================================*/
 
+Shared_VNode::Shared_VNode() {
+	exploration_bonus=0;
+	is_waiting_=false;
+	expanded_=false;
+	visit_count_=0;
+}
+
 Shared_VNode::Shared_VNode(vector<State*>& particles,std::vector<int> particleIDs, int depth, Shared_QNode* parent,
 	OBS_TYPE edge)
 {
 	logv << "[Shared_VNode::Shared_VNode] "<< endl;
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	particles_=particles;
-	particleIDs_=particleIDs;
-	GPU_particles_=NULL;
-	num_GPU_particles_=0;
-	belief_=NULL;
+	particleIDs_.swap(particleIDs);
 	depth_=depth;
 	parent_=parent;
 	edge_=edge;
 	vstar=this;
-	likelihood=1;
 	logv << "Constructed Shared_VNode with " << particles_.size() << " particles"
 		<< endl;
 	/*for (int i = 0; i < particles_.size(); i++) {
-		logd << " " << i << " = " <<"("<< particleIDs_[i]<<")"<< *particles_[i] << endl;
+		logd << " " << i << " = " <<"("<< particleIDs()[i]<<")"<< *particles_[i] << endl;
 	}*/
 	weight_=0;
 	exploration_bonus=0;
-	value_=0;
 	is_waiting_=false;
+	expanded_=false;
 	visit_count_=0;
 
 	upper_bound_ = EMPTY_UB_VALUE;
@@ -40,53 +42,51 @@ Shared_VNode::Shared_VNode(vector<State*>& particles,std::vector<int> particleID
 }
 
 Shared_VNode::Shared_VNode(Belief* belief, int depth, Shared_QNode* parent, OBS_TYPE edge){
-	lock_guard<mutex> lck(_mutex);
-	GPU_particles_=NULL;
-	num_GPU_particles_=0;
-	belief_=belief;
+	lock_guard<ProfiledMutex> lck(_mutex);
+	extras().belief=belief;
 	depth_=depth;
 	parent_=parent;
 	edge_=edge;
 	vstar=this;
-	likelihood=1;
 	weight_=0;
 	exploration_bonus=0;
-	value_=0;
 	is_waiting_=false;
+	expanded_=false;
 	visit_count_=0;
 }
 
 Shared_VNode::Shared_VNode(int count, double value, int depth, Shared_QNode* parent, OBS_TYPE edge) {
-	lock_guard<mutex> lck(_mutex);
-	GPU_particles_=NULL;
-	num_GPU_particles_=0;
-	belief_=NULL;
+	lock_guard<ProfiledMutex> lck(_mutex);
 	depth_=depth;
 	parent_=parent;
 	edge_=edge;
-	count_=count;
-	value_=value;
+	extras().count=count;
+	extras().value=value;
 	weight_=0;
 	exploration_bonus=0;
 	is_waiting_=false;
+	expanded_=false;
 	visit_count_=0;
 }
 
 Shared_VNode::~Shared_VNode() {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	for (ACT_TYPE a = 0; a < children_.size(); a++) {
 		Shared_QNode* child = static_cast<Shared_QNode*>(children_[a]);
 		assert(child != NULL);
-		delete child;
+		if(child != NULL && child->IsAllocated())//allocated by memory pool
+			DESPOT::s_qnode_pool_.Destroy(child);
+		else if(child != NULL && child->IsInArena())//memory released with the arena
+			child->~Shared_QNode();
+		else
+			delete child;
 	}
 	children_.clear();
-
-	if (belief_ != NULL)
-		delete belief_;
+	// The belief and other extras are released by ~VNode
 }
 
 Belief* Shared_VNode::belief() const {
-	return belief_;
+	return VNode::belief();
 }
 
 const vector<State*>& Shared_VNode::particles() const {
@@ -97,7 +97,7 @@ const vector<int>& Shared_VNode::particleIDs() const {
 	return particleIDs_;
 }
 void Shared_VNode::depth(int d) {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 
 	depth_ = d;
 }
@@ -107,7 +107,7 @@ int Shared_VNode::depth() const {
 }
 
 void Shared_VNode::parent(Shared_QNode* parent) {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	parent_ = parent;
 }
 
@@ -120,7 +120,7 @@ OBS_TYPE Shared_VNode::edge() {
 }
 
 double Shared_VNode::Weight() {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	if(Globals::config.useGPU==false ||!PassGPUThreshold())
 		if(GPUWeight()>0)
 			return GPUWeight();
@@ -131,7 +131,7 @@ double Shared_VNode::Weight() {
 }
 void Shared_VNode::ResizeParticles(int i)
 {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 
 	particles_.resize(i);
 	particleIDs_.resize(i);
@@ -139,7 +139,7 @@ void Shared_VNode::ResizeParticles(int i)
 void Shared_VNode::ReconstructCPUParticles(const DSPOMDP* model,
 		RandomStreams& streams, History& history)
 {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	std::vector<int>& particleIDsinParentList=particleIDs_;
 	for(int i=0;i<particleIDsinParentList.size();i++)
 	{
@@ -166,22 +166,22 @@ void Shared_VNode::ReconstructCPUParticles(const DSPOMDP* model,
 			depth++;
 		}
 		particles_.push_back(particle);
-		particleIDs_.push_back(ScenarioID);
+		particleIDsinParentList.push_back(ScenarioID);
 	}
 }
 
 const Shared_QNode* Shared_VNode::Child(ACT_TYPE action) const {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	return static_cast<Shared_QNode*>(children_[action]);
 }
 
 Shared_QNode* Shared_VNode::Child(ACT_TYPE action) {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	return static_cast<Shared_QNode*>(children_[action]);
 }
 
 int Shared_VNode::Size() const {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	int size = 1;
 	for (ACT_TYPE a = 0; a < children_.size(); a++) {
 		size += children_[a]->Size();
@@ -190,7 +190,7 @@ int Shared_VNode::Size() const {
 }
 
 int Shared_VNode::PolicyTreeSize() const {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	if (children_.size() == 0)
 		return 0;
 
@@ -204,7 +204,7 @@ int Shared_VNode::PolicyTreeSize() const {
 }
 
 void Shared_VNode::default_move(ValuedAction move) {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	default_move_ = move;
 }
 
@@ -213,7 +213,6 @@ ValuedAction Shared_VNode::default_move() const {
 }
 
 void Shared_VNode::lower_bound(double value) {
-	lock_guard<mutex> lck(_mutex);
 	lower_bound_ = value;
 }
 
@@ -222,7 +221,6 @@ double Shared_VNode::lower_bound() const {
 }
 
 void Shared_VNode::upper_bound(double value) {
-	lock_guard<mutex> lck(_mutex);
 	upper_bound_ = value;
 }
 
@@ -234,7 +232,6 @@ double Shared_VNode::upper_bound(bool use_Vloss) const {
 }
 
 void Shared_VNode::utility_upper_bound(double value){
-	lock_guard<mutex> lck(_mutex);
 	utility_upper_bound_=value;
 }
 double Shared_VNode::utility_upper_bound() const {
@@ -242,44 +239,43 @@ double Shared_VNode::utility_upper_bound() const {
 }
 
 bool Shared_VNode::IsLeaf() {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	return children_.size() == 0;
 }
 
 void Shared_VNode::Add(double val) {
-	lock_guard<mutex> lck(_mutex);
-	value_ = (value_ * count_ + val) / (count_ + 1);
-	count_++;
+	lock_guard<ProfiledMutex> lck(_mutex);
+	VNode::Add(val);
 }
 
 void Shared_VNode::count(int c) {
-	lock_guard<mutex> lck(_mutex);
-	count_ = c;
+	lock_guard<ProfiledMutex> lck(_mutex);
+	VNode::count(c);
 }
 int Shared_VNode::count() const {
-	return count_;
+	return VNode::count();
 }
 
 void Shared_VNode::value(double v) {
-	lock_guard<mutex> lck(_mutex);
-	value_ = v;
+	lock_guard<ProfiledMutex> lck(_mutex);
+	VNode::value(v);
 }
 
 double Shared_VNode::value() const {
 
-	return value_;
+	return VNode::value();
 }
 
 void Shared_VNode::Free(const DSPOMDP& model) {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	for (int i = 0; i < particles_.size(); i++) {
 		if(particles_[i])model.Free(particles_[i]);
 	}
 
 	for (ACT_TYPE a = 0; a < children().size(); a++) {
 		Shared_QNode* Shared_QNode = Child(a);
-		map<OBS_TYPE, VNode*>& children = Shared_QNode->children();
-		for (map<OBS_TYPE, VNode*>::iterator it = children.begin();
+		FlatMap<OBS_TYPE, VNode*>& children = Shared_QNode->children();
+		for (FlatMap<OBS_TYPE, VNode*>::iterator it = children.begin();
 			it != children.end(); it++) {
 			static_cast<Shared_VNode*>(it->second)->Free(model);
 		}
@@ -287,11 +283,11 @@ void Shared_VNode::Free(const DSPOMDP& model) {
 }
 
 void Shared_VNode::PrintPolicyTree(int depth, ostream& os) {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	if (depth != -1 && this->depth() > depth)
 		return;
 
-	vector<QNode*>& Shared_QNodes = children();
+	ArenaVector<QNode*>& Shared_QNodes = children();
 	if (Shared_QNodes.size() == 0) {
 		ACT_TYPE astar = this->default_move().action;
 		os << this << "-a=" << astar << endl;
@@ -307,8 +303,8 @@ void Shared_VNode::PrintPolicyTree(int depth, ostream& os) {
 		os << this << "-a=" << qstar->edge() << endl;
 
 		vector<OBS_TYPE> labels;
-		map<OBS_TYPE, VNode*>& Shared_VNodes = qstar->children();
-		for (map<OBS_TYPE, VNode*>::iterator it = Shared_VNodes.begin();
+		FlatMap<OBS_TYPE, VNode*>& Shared_VNodes = qstar->children();
+		for (FlatMap<OBS_TYPE, VNode*>::iterator it = Shared_VNodes.begin();
 			it != Shared_VNodes.end(); it++) {
 			labels.push_back(it->first);
 		}
@@ -326,13 +322,11 @@ void Shared_VNode::PrintPolicyTree(int depth, ostream& os) {
 
 void Shared_VNode::AddVirtualLoss(float v)
 {
-	lock_guard<mutex> lck(_mutex);
 	exploration_bonus-=v;
 }
 
 void Shared_VNode::RemoveVirtualLoss(float v)
 {
-	lock_guard<mutex> lck(_mutex);
 	exploration_bonus+=v;
 }
 
@@ -356,9 +350,14 @@ bool Shared_VNode::check_despot_thread(){
  * Shared_QNode class
  * =============================================================================*/
 
+Shared_QNode::Shared_QNode() {
+	exploration_bonus=0;
+	visit_count_=0;
+}
+
 Shared_QNode::Shared_QNode(Shared_VNode* parent, ACT_TYPE edge)
 	{
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	parent_=parent;
 	edge_=edge;
 	vstar=NULL;
@@ -373,7 +372,7 @@ Shared_QNode::Shared_QNode(Shared_VNode* parent, ACT_TYPE edge)
 
 Shared_QNode::Shared_QNode(int count, double value)
 	{
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	count_=count;
 	value_=value;
 	exploration_bonus=0;
@@ -382,17 +381,23 @@ Shared_QNode::Shared_QNode(int count, double value)
 }
 
 Shared_QNode::~Shared_QNode() {
-	lock_guard<mutex> lck(_mutex);
-	for (map<OBS_TYPE, VNode*>::iterator it = children_.begin();
+	lock_guard<ProfiledMutex> lck(_mutex);
+	for (FlatMap<OBS_TYPE, VNode*>::iterator it = children_.begin();
 		it != children_.end(); it++) {
 		assert(it->second != NULL);
-		delete static_cast<Shared_VNode*>(it->second);
+		Shared_VNode* child = static_cast<Shared_VNode*>(it->second);
+		if(child != NULL && child->IsAllocated())//allocated by memory pool
+			DESPOT::s_vnode_pool_.Destroy(child);
+		else if(child != NULL && child->IsInArena())//memory released with the arena
+			child->~Shared_VNode();
+		else
+			delete child;
 	}
 	children_.clear();
 }
 
 void Shared_QNode::parent(Shared_VNode* parent) {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	parent_ = parent;
 }
 
@@ -406,14 +411,14 @@ ACT_TYPE Shared_QNode::edge() const{
 
 
 Shared_VNode* Shared_QNode::Child(OBS_TYPE obs) {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	return static_cast<Shared_VNode*>(children_[obs]);
 }
 
 int Shared_QNode::Size() const {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	int size = 0;
-	for (map<OBS_TYPE, VNode*>::const_iterator it = children_.begin();
+	for (FlatMap<OBS_TYPE, VNode*>::const_iterator it = children_.begin();
 		it != children_.end(); it++) {
 		size += static_cast<Shared_VNode*>(it->second)->Size();
 	}
@@ -421,9 +426,9 @@ int Shared_QNode::Size() const {
 }
 
 int Shared_QNode::PolicyTreeSize() const {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	int size = 0;
-	for (map<OBS_TYPE, VNode*>::const_iterator it = children_.begin();
+	for (FlatMap<OBS_TYPE, VNode*>::const_iterator it = children_.begin();
 		it != children_.end(); it++) {
 		size += static_cast<Shared_VNode*>(it->second)->PolicyTreeSize();
 	}
@@ -431,24 +436,24 @@ int Shared_QNode::PolicyTreeSize() const {
 }
 
 double Shared_QNode::Weight() /*const*/ {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	if(weight_>1e-5) return weight_;
 	else
 	{
 		weight_=0;
-		for (map<OBS_TYPE, VNode*>::const_iterator it = children_.begin();
+		for (FlatMap<OBS_TYPE, VNode*>::const_iterator it = children_.begin();
 			it != children_.end(); it++) {
 			weight_ += static_cast<Shared_VNode*>(it->second)->Weight();
 		}
 		if(weight_>1.001)
 		{
-			for (map<OBS_TYPE, VNode*>::const_iterator it = children_.begin();
+			for (FlatMap<OBS_TYPE, VNode*>::const_iterator it = children_.begin();
 					it != children_.end(); it++) {
 				Global_print_value(this_thread::get_id(),
 						static_cast<Shared_VNode*>(it->second)->Weight(),
 						"Wrong weight from Shared_QNode::Weight()");
 				Global_print_value(this_thread::get_id(),
-						static_cast<Shared_VNode*>(it->second)->num_GPU_particles_,
+						static_cast<Shared_VNode*>(it->second)->num_GPU_particles(),
 						"Wrong weight from Shared_QNode::Weight(), num of particles=");
 			}
 		}
@@ -457,12 +462,11 @@ double Shared_QNode::Weight() /*const*/ {
 }
 
 void Shared_QNode::lower_bound(double value) {
-	lock_guard<mutex> lck(_mutex);
 	lower_bound_ = value;
 }
 
 double Shared_QNode::lower_bound() const {
-	//lock_guard<mutex> lck(_mutex);
+	//lock_guard<ProfiledMutex> lck(_mutex);
 	return lower_bound_/*+exploration_bonus*/;
 }
 
@@ -471,33 +475,31 @@ double Shared_QNode::lower_bound_with_bonus() const {
 }
 
 void Shared_QNode::upper_bound(double value) {
-	lock_guard<mutex> lck(_mutex);
 	upper_bound_ = value;
 }
 
 double Shared_QNode::upper_bound(bool use_Vloss) const {
-	//lock_guard<mutex> lck(_mutex);
+	//lock_guard<ProfiledMutex> lck(_mutex);
 	if(use_Vloss)
 		return upper_bound_+exploration_bonus;
 	else
 		return upper_bound_;
 }
 void Shared_QNode::utility_upper_bound(double value){
-	lock_guard<mutex> lck(_mutex);
 	utility_upper_bound_=value;
 }
 double Shared_QNode::utility_upper_bound() const {
-	//lock_guard<mutex> lck(_mutex);
+	//lock_guard<ProfiledMutex> lck(_mutex);
 	return utility_upper_bound_;
 }
 void Shared_QNode::Add(double val) {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	value_ = (value_ * count_ + val) / (count_ + 1);
 	count_++;
 }
 
 void Shared_QNode::count(int c) {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	count_ = c;
 }
 
@@ -506,7 +508,7 @@ int Shared_QNode::count() const {
 }
 
 void Shared_QNode::value(double v) {
-	lock_guard<mutex> lck(_mutex);
+	lock_guard<ProfiledMutex> lck(_mutex);
 	value_ = v;
 }
 
@@ -515,17 +517,15 @@ double Shared_QNode::value() const {
 }
 void Shared_QNode::AddVirtualLoss(float v)
 {
-	lock_guard<mutex> lck(_mutex);
 	exploration_bonus-=v;
 }
 void Shared_QNode::RemoveVirtualLoss(float v)
 {
-	lock_guard<mutex> lck(_mutex);
 	exploration_bonus+=v;
 }
 float Shared_QNode::GetVirtualLoss()
 {
-	//lock_guard<mutex> lck(_mutex);
+	//lock_guard<ProfiledMutex> lck(_mutex);
 	return exploration_bonus;
 }
 } // namespace despot
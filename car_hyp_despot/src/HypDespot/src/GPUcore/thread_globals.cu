@@ -1,6 +1,6 @@
 #include <despot/GPUcore/thread_globals.h>
 #include <despot/core/globals.h>
-#include <map>
+#include <cassert>
 #include <ucontext.h>
 
 #include <despot/solver/despot.h>
@@ -23,8 +23,8 @@ StreamManager StreamManager::MANAGER(0);
 // Global mutex for the shared HyP-DESPOT tree
 mutex global_mutex;
 
-//Thread ID mapping
-map<std::thread::id, int > ThreadIdMap;
+//Thread ID mapping: index of the calling search worker, -1 if unregistered
+thread_local int mapped_thread_id = -1;
 
 bool force_print = false;
 
@@ -149,12 +149,17 @@ void ResetSerialTime()
 
 void AddMappedThread(std::thread::id the_id, int mapped_id)
 {
-	ThreadIdMap[the_id]=mapped_id;
+	assert(the_id == this_thread::get_id());
+	mapped_thread_id=mapped_id;
 }
 
 int MapThread(std::thread::id the_id)
 {
-	return ThreadIdMap[the_id];
+	if (CHECK_THREAD_MAP) {
+		assert(the_id == this_thread::get_id());
+		assert(mapped_thread_id >= 0 && "MapThread called from an unregistered thread");
+	}
+	return mapped_thread_id < 0 ? 0 : mapped_thread_id;
 }
 
 void AddActiveThread()
@@ -203,9 +203,11 @@ HOST void Dvc_RandomStreams::CopyToGPU(Dvc_RandomStreams* Dvc, const RandomStrea
 	int length=Hst->Length();
 
 
+	// Host entries are computed on demand; materialize them for the device
 	for (int i = 0; i < num_streams; i++)
 	{
-		memcpy((void*)(Hst_streams_list+i*length), (const void*)Hst->streams_[i].data(),sizeof(double)*length);
+		for (int j = 0; j < length; j++)
+			Hst_streams_list[i * length + j] = Hst->Entry(i, j);
 	}
 	HANDLE_ERROR(cudaMemcpy((void*)(Dvc_streams_list), (const void*)Hst_streams_list,sizeof(double)*num_streams*length, cudaMemcpyHostToDevice));
 
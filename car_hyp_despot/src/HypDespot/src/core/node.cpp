@@ -5,6 +5,21 @@ using namespace std;
 
 namespace despot {
 
+/* =============================================================================
+ * VNodeExtras struct
+ * =============================================================================*/
+
+VNodeExtras::VNodeExtras() :
+	GPU_particles(NULL),
+	num_GPU_particles(0),
+	belief(NULL),
+	likelihood(1),
+	count(0),
+	value(0),
+	prior_value(VNode::DUMMY_VALUE),
+	prior_initialized(false) {
+}
+
 /* =============================================================================
  * VNode class
  * =============================================================================*/
@@ -12,69 +27,52 @@ namespace despot {
 
 VNode::VNode(vector<State*>& particles,std::vector<int> particleIDs, int depth, QNode* parent,
 	OBS_TYPE edge) :
-	particles_(particles),
-	particleIDs_(particleIDs),
-	GPU_particles_(NULL),
-	num_GPU_particles_(0),
-	belief_(NULL),
+	weight_(0),
+	vstar(this),
 	depth_(depth),
 	parent_(parent),
 	edge_(edge),
-	vstar(this),
-	likelihood(1),
-	prior_value_(DUMMY_VALUE){
+	particles_(particles),
+	extras_(NULL) {
+	particleIDs_.swap(particleIDs);
 	logv << "Constructed vnode with " << particles_.size() << " particles"
 		<< endl;
 	for (int i = 0; i < particles_.size(); i++) {
-		logv << " " << i << " = " <<"("<< particleIDs_[i]<<")"<< *particles_[i] << endl;
+		logv << " " << i << " = " <<"("<< this->particleIDs()[i]<<")"<< *particles_[i] << endl;
 	}
-	weight_=0;
-	prior_initialized_ = false;
 }
 
 void VNode::Initialize(vector<State*>& particles,std::vector<int> particleIDs, int depth, QNode* parent,
 	OBS_TYPE edge){
 	particles_=particles;
-	particleIDs_=particleIDs;
-	GPU_particles_=NULL;
-	num_GPU_particles_=0;
-	belief_=NULL;
+	particleIDs_.swap(particleIDs);
+	delete extras_;
+	extras_=NULL;
 	depth_=depth;
 	parent_=parent;
 	edge_=edge;
 	vstar=this;
-	likelihood=1;
 	weight_=0;
-	prior_initialized_ = false;
 }
 
 VNode::VNode(Belief* belief, int depth, QNode* parent, OBS_TYPE edge) :
-	GPU_particles_(NULL),
-	num_GPU_particles_(0),
-	belief_(belief),
+	weight_(0),
+	vstar(this),
 	depth_(depth),
 	parent_(parent),
 	edge_(edge),
-	vstar(this),
-	likelihood(1),
-	prior_value_(DUMMY_VALUE) {
-	weight_=0;
-	prior_initialized_ = false;
-
+	extras_(NULL) {
+	extras().belief = belief;
 }
 
 VNode::VNode(int count, double value, int depth, QNode* parent, OBS_TYPE edge) :
-	GPU_particles_(NULL),
-	num_GPU_particles_(0),
-	belief_(NULL),
+	weight_(0),
 	depth_(depth),
 	parent_(parent),
 	edge_(edge),
-	count_(count),
-	value_(value),
-	prior_value_(DUMMY_VALUE) {
-	weight_=0;
-	prior_initialized_ = false;
+	extras_(NULL) {
+	extras().count = count;
+	extras().value = value;
 }
 
 
@@ -85,19 +83,30 @@ VNode::~VNode() {
 			QNode* child = children_[a];
 			assert(child != NULL);
 			if(child->IsAllocated())//allocated by memory pool
-				DESPOT::qnode_pool_.Free(child);
+				DESPOT::qnode_pool_.Destroy(child);
+			else if(child->IsInArena())//memory released with the arena
+				child->~QNode();
 			else
 				delete child;
 		}
 	}
 	children_.clear();
 
-	if (belief_ != NULL)
-		delete belief_;
+	if (extras_ != NULL) {
+		if (extras_->belief != NULL)
+			delete extras_->belief;
+		delete extras_;
+	}
+}
+
+VNodeExtras& VNode::extras() {
+	if (extras_ == NULL)
+		extras_ = new VNodeExtras();
+	return *extras_;
 }
 
 Belief* VNode::belief() const {
-	return belief_;
+	return extras_ == NULL ? NULL : extras_->belief;
 }
 
 const std::vector<State*>& VNode::particles() const {
@@ -139,14 +148,19 @@ double VNode::Weight() {
 bool VNode::PassGPUThreshold(){
 	return (particleIDs().size()>Globals::config.expanstion_switch_thresh || depth()<1);
 }
-const vector<QNode*>& VNode::children() const {
+const ArenaVector<QNode*>& VNode::children() const {
 	return children_;
 }
 
-vector<QNode*>& VNode::children() {
+ArenaVector<QNode*>& VNode::children() {
 	return children_;
 }
 
+void VNode::UseArena(Arena* arena) {
+	children_ = ArenaVector<QNode*>(ArenaAllocator<QNode*>(arena));
+	legal_actions_ = ArenaVector<ACT_TYPE>(ArenaAllocator<ACT_TYPE>(arena));
+}
+
 const QNode* VNode::Child(int action) const {
 	return children_[action];
 }
@@ -169,6 +183,19 @@ int VNode::Size() const {
 	return size;
 }
 
+int VNode::NumParticles() const {
+	int num = 0;
+	for (int i = 0; i < particles_.size(); i++) {
+		if (particles_[i])
+			num++;
+	}
+	for (int a = 0; a < children_.size(); a++) {
+		if (children_[a])
+			num += children_[a]->NumParticles();
+	}
+	return num;
+}
+
 int VNode::PolicyTreeSize() const {
 	if (children_.size() == 0)
 		return 0;
@@ -216,16 +243,22 @@ double VNode::utility_upper_bound() const {
 	return utility_upper_bound_;
 }
 
+void VNode::ImproveBounds(double lower, double upper, double utility_upper) {
+	lower_bound_.StoreMax(lower);
+	upper_bound_.StoreMin(upper);
+	utility_upper_bound_.StoreMin(utility_upper);
+}
+
 double VNode::prior_value() {
-	if(prior_value_ != DUMMY_VALUE){
-		return prior_value_;
+	if(extras_ != NULL && extras_->prior_value != DUMMY_VALUE){
+		return extras_->prior_value;
 	} else {
 		std::cerr << "prior_value_ uninitialized" << std::endl;
 		std::cerr << "node info: depth " << depth() << " parent action "
 				<< parent()->edge();
 
 		int sib_id = 0;
-		for (std::map<OBS_TYPE, VNode*>::iterator it =
+		for (FlatMap<OBS_TYPE, VNode*>::iterator it =
 				parent()->children().begin(); it != parent()->children().end();
 				it++) {
 			OBS_TYPE obs = it->first;
@@ -241,6 +274,7 @@ double VNode::prior_value() {
 ACT_TYPE VNode::max_prob_action(){
 	ACT_TYPE astar = -1;
 	double prob = 0;
+	map<ACT_TYPE, double>& prior_action_probs_ = prior_action_probs();
 //	for (int a = 0; a < prior_action_probs_.size(); a++) {
 	for (map<ACT_TYPE, double>::iterator it = prior_action_probs_.begin();
 		        it != prior_action_probs_.end(); it++) {
@@ -255,6 +289,7 @@ ACT_TYPE VNode::max_prob_action(){
 }
 
 void VNode::print_action_probs(){
+	map<ACT_TYPE, double>& prior_action_probs_ = prior_action_probs();
 	logi << "vnode " << this << " of level " << depth() << " action_probs with " <<
 			prior_action_probs_.size() << " elements:" << endl;
 	for (map<ACT_TYPE, double>::iterator it = prior_action_probs_.begin();
@@ -270,21 +305,29 @@ bool VNode::IsLeaf() {
 }
 
 void VNode::Add(double val) {
-	value_ = (value_ * count_ + val) / (count_ + 1);
-	count_++;
+	VNodeExtras& e = extras();
+	e.value = (e.value * e.count + val) / (e.count + 1);
+	e.count++;
 }
 
 void VNode::count(int c) {
-	count_ = c;
+	extras().count = c;
 }
 int VNode::count() const {
-	return count_;
+	return extras_ == NULL ? 0 : extras_->count;
 }
 void VNode::value(double v) {
-	value_ = v;
+	extras().value = v;
 }
 double VNode::value() const {
-	return value_;
+	return extras_ == NULL ? 0 : extras_->value;
+}
+
+void VNode::likelihood(double l) {
+	extras().likelihood = l;
+}
+double VNode::likelihood() const {
+	return extras_ == NULL ? 1 : extras_->likelihood;
 }
 
 void VNode::Free(const DSPOMDP& model) {
@@ -298,8 +341,8 @@ void VNode::Free(const DSPOMDP& model) {
 		QNode* qnode = Child(a);
 
 		if(qnode){
-			map<OBS_TYPE, VNode*>& children = qnode->children();
-			for (map<OBS_TYPE, VNode*>::iterator it = children.begin();
+			FlatMap<OBS_TYPE, VNode*>& children = qnode->children();
+			for (FlatMap<OBS_TYPE, VNode*>::iterator it = children.begin();
 				it != children.end(); it++) {
 
 				if (it->second)
@@ -319,7 +362,7 @@ void VNode::PrintPolicyTree(int depth, ostream& os) {
 	if (depth != -1 && this->depth() > depth)
 		return;
 
-	vector<QNode*>& qnodes = children();
+	ArenaVector<QNode*>& qnodes = children();
 	if (qnodes.size() == 0) {
 		int astar = this->default_move().action;
 		os << this << "-a=" << astar << endl;
@@ -335,8 +378,8 @@ void VNode::PrintPolicyTree(int depth, ostream& os) {
 		os << this << "-a=" << qstar->edge() << endl;
 
 		vector<OBS_TYPE> labels;
-		map<OBS_TYPE, VNode*>& vnodes = qstar->children();
-		for (map<OBS_TYPE, VNode*>::iterator it = vnodes.begin();
+		FlatMap<OBS_TYPE, VNode*>& vnodes = qstar->children();
+		for (FlatMap<OBS_TYPE, VNode*>::iterator it = vnodes.begin();
 			it != vnodes.end(); it++) {
 			labels.push_back(it->first);
 		}
@@ -370,13 +413,13 @@ void VNode::PrintTree(int depth, ostream& os) {
 		<< endl;
 
 
-	vector<QNode*>& qnodes = children();
+	ArenaVector<QNode*>& qnodes = children();
 	for (int a = 0; a < qnodes.size(); a++) {
 		QNode* qnode = qnodes[a];
 
 		vector<OBS_TYPE> labels;
-		map<OBS_TYPE, VNode*>& vnodes = qnode->children();
-		for (map<OBS_TYPE, VNode*>::iterator it = vnodes.begin();
+		FlatMap<OBS_TYPE, VNode*>& vnodes = qnode->children();
+		for (FlatMap<OBS_TYPE, VNode*>::iterator it = vnodes.begin();
 			it != vnodes.end(); it++) {
 			labels.push_back(it->first);
 		}
@@ -428,11 +471,13 @@ QNode::QNode(int count, double value) :
 }
 
 QNode::~QNode() {
-	for (map<OBS_TYPE, VNode*>::iterator it = children_.begin();
+	for (FlatMap<OBS_TYPE, VNode*>::iterator it = children_.begin();
 		it != children_.end(); it++) {
 		if(it->second){
 			if(it->second->IsAllocated())//allocated by memory pool
-				DESPOT::vnode_pool_.Free(it->second);
+				DESPOT::vnode_pool_.Destroy(it->second);
+			else if(it->second->IsInArena())//memory released with the arena
+				it->second->~VNode();
 			else
 				delete it->second;
 		}
@@ -452,17 +497,21 @@ int QNode::edge() const{
 	return edge_;
 }
 
-map<OBS_TYPE, VNode*>& QNode::children() {
+FlatMap<OBS_TYPE, VNode*>& QNode::children() {
 	return children_;
 }
 
+void QNode::UseArena(Arena* arena) {
+	children_.UseArena(arena);
+}
+
 VNode* QNode::Child(OBS_TYPE obs) {
 	return children_[obs];
 }
 
 int QNode::Size() const {
 	int size = 0;
-	for (map<OBS_TYPE, VNode*>::const_iterator it = children_.begin();
+	for (FlatMap<OBS_TYPE, VNode*>::const_iterator it = children_.begin();
 		it != children_.end(); it++) {
 		if(it->second)
 			size += it->second->Size();
@@ -470,9 +519,19 @@ int QNode::Size() const {
 	return size;
 }
 
+int QNode::NumParticles() const {
+	int num = 0;
+	for (FlatMap<OBS_TYPE, VNode*>::const_iterator it = children_.begin();
+		it != children_.end(); it++) {
+		if (it->second)
+			num += it->second->NumParticles();
+	}
+	return num;
+}
+
 int QNode::PolicyTreeSize() const {
 	int size = 0;
-	for (map<OBS_TYPE, VNode*>::const_iterator it = children_.begin();
+	for (FlatMap<OBS_TYPE, VNode*>::const_iterator it = children_.begin();
 		it != children_.end(); it++) {
 		if (it->second)
 			size += it->second->PolicyTreeSize();
@@ -496,7 +555,7 @@ double QNode::Weight() /*const*/ {
 	{
 		try{
 			weight_=0;
-			for (map<OBS_TYPE, VNode*>::const_iterator it = children_.begin();
+			for (FlatMap<OBS_TYPE, VNode*>::const_iterator it = children_.begin();
 				it != children_.end(); it++) {
 				if (it->second)
 					weight_ += it->second->Weight();
@@ -540,6 +599,12 @@ double QNode::utility_upper_bound() const {
 	return utility_upper_bound_;
 }
 
+void QNode::ImproveBounds(double lower, double upper, double utility_upper) {
+	lower_bound_.StoreMax(lower);
+	upper_bound_.StoreMin(upper);
+	utility_upper_bound_.StoreMin(utility_upper);
+}
+
 void QNode::Add(double val) {
 	value_ = (value_ * count_ + val) / (count_ + 1);
 	count_++;
@@ -19,12 +19,13 @@ namespace despot {
  * =============================================================================*/
 
 ParticleBelief::ParticleBelief(vector<State*> particles, const DSPOMDP* model,
-	Belief* prior, bool split) :
+	Belief* prior, bool split, bool own_particles) :
 	Belief(model),
 	particles_(particles),
 	num_particles_(particles.size()),
 	prior_(prior),
 	split_(split),
+	own_particles_(own_particles),
 	state_indexer_(NULL) {
 
 	if (fabs(State::Weight(particles) - 1.0) > 1e-6) {
@@ -50,10 +51,13 @@ ParticleBelief::ParticleBelief(vector<State*> particles, const DSPOMDP* model,
 				}
 			}
 
-			for (int i = 0; i < particles_.size(); i++)
-				model_->Free(particles_[i]);
+			if (own_particles_) {
+				for (int i = 0; i < particles_.size(); i++)
+					model_->Free(particles_[i]);
+			}
 
 			particles_ = new_particles;
+			own_particles_ = true;
 		}
 	}
 
@@ -65,7 +69,8 @@ ParticleBelief::ParticleBelief(vector<State*> particles, const DSPOMDP* model,
 	random_shuffle(particles_.begin(), particles_.end());
 	// cerr << "Number of particles in initial belief: " << particles_.size() << endl;
 
-	if (prior_ == NULL) {
+	// Borrowed particles are copied by TakeOwnership when they are needed
+	if (prior_ == NULL && own_particles_) {
 		for (int i = 0; i < particles.size(); i++)
 			// TODO: free initial_particles
 			initial_particles_.push_back(model_->Copy(particles[i]));
@@ -73,8 +78,10 @@ ParticleBelief::ParticleBelief(vector<State*> particles, const DSPOMDP* model,
 }
 
 ParticleBelief::~ParticleBelief() {
-	for (int i = 0; i < particles_.size(); i++) {
-		model_->Free(particles_[i]);
+	if (own_particles_) {
+		for (int i = 0; i < particles_.size(); i++) {
+			model_->Free(particles_[i]);
+		}
 	}
 
 	for (int i = 0; i < initial_particles_.size(); i++) {
@@ -82,6 +89,19 @@ ParticleBelief::~ParticleBelief() {
 	}
 }
 
+void ParticleBelief::TakeOwnership() {
+	if (own_particles_)
+		return;
+
+	if (prior_ == NULL && initial_particles_.empty()) {
+		for (int i = 0; i < particles_.size(); i++)
+			initial_particles_.push_back(model_->Copy(particles_[i]));
+	}
+	for (int i = 0; i < particles_.size(); i++)
+		particles_[i] = model_->Copy(particles_[i]);
+	own_particles_ = true;
+}
+
 void ParticleBelief::state_indexer(const StateIndexer* indexer) {
 	state_indexer_ = indexer;
 }
@@ -95,6 +115,7 @@ vector<State*> ParticleBelief::Sample(int num) const {
 }
 
 void ParticleBelief::Update(ACT_TYPE action, OBS_TYPE obs) {
+	TakeOwnership();
 	history_.Add(action, obs);
 
 	vector<State*> updated;
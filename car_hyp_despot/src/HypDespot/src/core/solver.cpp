@@ -45,6 +45,11 @@ ostream& operator<<(ostream& os, const SearchStatistics& statistics) {
 	os << "# nodes: expanded / total / policy = "
 		<< statistics.num_expanded_nodes << " / " << statistics.num_tree_nodes
 		<< " / " << statistics.num_policy_nodes << endl;
+	os << "Throughput (nodes/s): expanded / total = "
+		<< (statistics.time_search > 0 ?
+			statistics.num_expanded_nodes / statistics.time_search : 0) << " / "
+		<< (statistics.time_search > 0 ?
+			statistics.num_tree_nodes / statistics.time_search : 0) << endl;
 	os << "# particles: initial / final / tree = "
 		<< statistics.num_particles_before_search << " / "
 		<< statistics.num_particles_after_search << " / "
@@ -87,4 +92,8 @@ Belief* Solver::belief() {
 	return belief_;
 }
 
+int Solver::NumHeldParticles() {
+	return 0;
+}
+
 } // namespace despot
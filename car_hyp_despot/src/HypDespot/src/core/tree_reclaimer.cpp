@@ -0,0 +1,102 @@
+#include <despot/core/tree_reclaimer.h>
+#include <despot/core/node.h>
+#include <despot/interface/pomdp.h>
+#include <despot/util/arena.h>
+#include <despot/util/logging.h>
+#include <despot/util/util.h>
+
+using namespace std;
+
+namespace despot {
+
+/* =============================================================================
+ * TreeReclaimer class
+ * =============================================================================*/
+
+TreeReclaimer::TreeReclaimer() :
+	busy_(false),
+	stop_(false) {
+	thread_ = thread(&TreeReclaimer::Loop, this);
+}
+
+TreeReclaimer::~TreeReclaimer() {
+	{
+		lock_guard<mutex> lck(mutex_);
+		stop_ = true;
+	}
+	work_cond_.notify_all();
+	thread_.join();
+}
+
+void TreeReclaimer::Reclaim(VNode* root, const DSPOMDP* model, Arena* arena) {
+	if (root == NULL && arena == NULL)
+		return;
+
+	Job job;
+	job.root = root;
+	job.model = model;
+	job.arena = arena;
+	{
+		lock_guard<mutex> lck(mutex_);
+		jobs_.push_back(job);
+	}
+	work_cond_.notify_one();
+}
+
+Arena* TreeReclaimer::AcquireArena() {
+	lock_guard<mutex> lck(mutex_);
+	if (free_arenas_.empty()) {
+		arenas_.push_back(unique_ptr<Arena>(new Arena()));
+		return arenas_.back().get();
+	}
+	Arena* arena = free_arenas_.back();
+	free_arenas_.pop_back();
+	return arena;
+}
+
+void TreeReclaimer::Wait() {
+	unique_lock<mutex> lck(mutex_);
+	idle_cond_.wait(lck, [this] { return jobs_.empty() && !busy_; });
+}
+
+int TreeReclaimer::num_pending() {
+	lock_guard<mutex> lck(mutex_);
+	return jobs_.size() + (busy_ ? 1 : 0);
+}
+
+void TreeReclaimer::Loop() {
+	unique_lock<mutex> lck(mutex_);
+	for (;;) {
+		work_cond_.wait(lck, [this] { return stop_ || !jobs_.empty(); });
+		// Queued trees are still freed on shutdown
+		if (jobs_.empty())
+			break;
+
+		Job job = jobs_.front();
+		jobs_.pop_front();
+		busy_ = true;
+		lck.unlock();
+
+		double start = get_time_second();
+		if (job.root != NULL) {
+			job.root->Free(*job.model);
+			if (job.root->IsInArena())
+				job.root->~VNode();
+			else
+				delete job.root;
+		}
+		if (job.arena != NULL)
+			job.arena->Reset();
+		logi << "[TreeReclaimer] Freed a search tree in "
+		     << get_time_second() - start << "s" << endl;
+
+		lck.lock();
+		if (job.arena != NULL)
+			free_arenas_.push_back(job.arena);
+		busy_ = false;
+		if (jobs_.empty())
+			idle_cond_.notify_all();
+	}
+}
+
+} // namespace despot
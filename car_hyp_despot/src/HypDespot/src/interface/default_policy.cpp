@@ -1,6 +1,8 @@
 #include <despot/interface/default_policy.h>
 #include <despot/interface/pomdp.h>
+#include <despot/core/obs_partition.h>
 #include <unistd.h>
+#include <deque>
 #include <despot/GPUcore/thread_globals.h>
 
 using namespace std;
@@ -26,8 +28,13 @@ ValuedAction DefaultPolicy::Value(const vector<State*>& particles,
 	for (int i = 0; i < particles.size(); i++)
 		copy.push_back(model_->Copy(particles[i]));
 
-	initial_depth_ = history.Size();
-	ValuedAction va = RecursiveValue(copy, streams, history);
+	ValuedAction va;
+	if (Globals::config.rollout_type == "INDEPENDENT" && HistoryIndependent())
+		va = BatchValue(copy, streams, history);
+	else {
+		initial_depth_ = history.Size();
+		va = RecursiveValue(copy, streams, history);
+	}
 
 	for (int i = 0; i < copy.size(); i++)
 		model_->Free(copy[i]);
@@ -55,13 +62,26 @@ ValuedAction DefaultPolicy::RecursiveValue(const vector<State*>& particles,
 
 		double value = 0;
 
-		map<OBS_TYPE, vector<State*> > partitions;
-		OBS_TYPE obs;
-		double reward;
+		// One reusable partition buffer per rollout depth; deque keeps the
+		// buffers of the enclosing calls in place when it grows
+		static thread_local deque<ObsPartition> partition_stack;
+		int level = history.Size() - initial_depth_;
+		if (partition_stack.size() <= level)
+			partition_stack.resize(level + 1);
+		ObsPartition& partitions = partition_stack[level];
+
+		vector<double> rand_nums(particles.size());
+		for (int i = 0; i < particles.size(); i++)
+			rand_nums[i] = streams.Entry(particles[i]->scenario_id);
+
+		vector<double> rewards;
+		vector<OBS_TYPE> obs;
+		vector<bool> terminals;
+		model_->StepBatch(particles, action, rand_nums, rewards, obs, terminals);
+
 		for (int i = 0; i < particles.size(); i++) {
 			State* particle = particles[i];
-			bool terminal = model_->Step(*particle,
-				streams.Entry(particle->scenario_id), action, reward, obs);
+			double reward = rewards[i];
 
 			if(false && initial_depth_ == 0 && particle->scenario_id == 0){
 				cout << "rollout state with reward " << reward << endl;
@@ -70,21 +90,16 @@ ValuedAction DefaultPolicy::RecursiveValue(const vector<State*>& particles,
 			}
 
 			value += reward * particle->weight;
-
-			if (!terminal) {
-				partitions[obs].push_back(particle);
-			}
 		}
+		partitions.Build(particles, obs, terminals);
 
 	    if(DoPrintCPU) printf("action, ave_reward= %d %f\n",action,value);
 
 
-		for (map<OBS_TYPE, vector<State*> >::iterator it = partitions.begin();
-			it != partitions.end(); it++) {
-			OBS_TYPE obs = it->first;
-			history.Add(action, obs);
+		for (int g = 0; g < partitions.size(); g++) {
+			history.Add(action, partitions.obs(g));
 			streams.Advance();
-			ValuedAction va = RecursiveValue(it->second, streams, history);
+			ValuedAction va = RecursiveValue(partitions.Group(g), streams, history);
 			value += Globals::Discount() * va.value;
 			streams.Back();
 			history.RemoveLast();
@@ -94,6 +109,69 @@ ValuedAction DefaultPolicy::RecursiveValue(const vector<State*>& particles,
 	}
 }
 
+ValuedAction DefaultPolicy::BatchValue(const vector<State*>& particles,
+	RandomStreams& streams, History& history) const {
+	int num = particles.size();
+
+	// Per rollout, reused across calls. Nothing in a rollout waits on other
+	// tasks, so the buffers are never shared by two rollouts of a thread.
+	static thread_local vector<double> values; // Discounted weighted reward
+	static thread_local vector<int> active; // Indices of non-terminal particles
+	static thread_local vector<State*> batch;
+	static thread_local vector<double> rand_nums, rewards;
+	static thread_local vector<OBS_TYPE> obs;
+	static thread_local vector<bool> terminals;
+
+	values.assign(num, 0.0);
+	active.resize(num);
+	for (int i = 0; i < num; i++)
+		active[i] = i;
+
+	ACT_TYPE first_action = Action(particles, streams, history);
+	int start_position = streams.position();
+	double discount = 1.0;
+	for (int step = 0; step < Globals::config.max_policy_sim_len
+			&& !streams.Exhausted() && !active.empty(); step++) {
+		batch.clear();
+		rand_nums.clear();
+		for (int i : active) {
+			batch.push_back(particles[i]);
+			rand_nums.push_back(streams.Entry(particles[i]->scenario_id));
+		}
+
+		// One action for all particles, as when running the policy on a belief
+		ACT_TYPE action = (step == 0) ? first_action
+			: Action(batch, streams, history);
+
+		model_->StepBatch(batch, action, rand_nums, rewards, obs, terminals);
+
+		int kept = 0;
+		for (int k = 0; k < batch.size(); k++) {
+			int i = active[k];
+			values[i] += discount * rewards[k] * batch[k]->weight;
+			if (!terminals[k])
+				active[kept++] = i;
+		}
+		active.resize(kept);
+
+		streams.Advance();
+		discount *= Globals::Discount();
+	}
+	streams.position(start_position);
+
+	double value = 0;
+	for (int i = 0; i < num; i++)
+		value += values[i];
+
+	if (!active.empty()) {
+		batch.clear();
+		for (int i : active)
+			batch.push_back(particles[i]);
+		value += discount * particle_lower_bound_->Value(batch).value;
+	}
+	return ValuedAction(first_action, value);
+}
+
 void DefaultPolicy::Reset() {
 }
 
@@ -87,6 +87,23 @@ bool DSPOMDP::Step(State& state, double random_num, ACT_TYPE action,
 	return Step(state, random_num, action, reward, obs);
 }
 
+void DSPOMDP::StepBatch(const vector<State*>& particles, ACT_TYPE action,
+		const vector<double>& random_nums, vector<double>& rewards,
+		vector<OBS_TYPE>& obs, vector<bool>& terminals) const {
+	int num = particles.size();
+	rewards.resize(num);
+	obs.resize(num);
+	terminals.resize(num);
+	for (int i = 0; i < num; i++)
+		terminals[i] = Step(*particles[i], random_nums[i], action, rewards[i],
+			obs[i]);
+}
+
+void DSPOMDP::BeliefLikelihoods(const vector<State*>& particles,
+		const vector<State*>& belief_samples, vector<double>& likelihoods) const {
+	likelihoods.assign(particles.size(), 1.0);
+}
+
 State* DSPOMDP::CreateStartState(std::string type) const{
 	cerr << "Unimplemented function: DSPOMDP::CreateStartState" << endl;
 	exit(1);
@@ -126,9 +126,10 @@ double EvalLog::GetRemainingBudget(string instance) const {
 Logger::Logger(DSPOMDP* model, Belief* belief, Solver* solver,
 		World* world, string world_type, clock_t start_clockt, ostream* out,
 		double target_finish_time, int num_steps) :
-		model_(model), world_(world), belief_(belief), start_clockt_(
+		model_(model), world_(world), belief_(belief), solver_(solver), start_clockt_(
 				start_clockt), world_type_(world_type), step_(0), out_(out), reward_(
-				0), total_discounted_reward_(0), total_undiscounted_reward_(0) {
+				0), total_discounted_reward_(0), total_undiscounted_reward_(0),
+		active_particles_(-1), peak_particles_(-1), particle_leak_count_(0) {
 	state_ = world->GetCurrentState();
 	target_finish_time_ = target_finish_time;
 	if (target_finish_time_ != -1) {
@@ -287,6 +288,8 @@ bool Logger::SummarizeStep(int step, int round, bool terminal, ACT_TYPE action,
 				<< total_discounted_reward_ << " / "
 				<< total_undiscounted_reward_ << endl;
 
+	TrackParticles();
+
 	//Report step time
 	double step_end_t = get_time_second();
 	double step_time = (step_end_t - step_start_t);
@@ -351,8 +354,25 @@ bool Logger::SummarizeStep(int step, int round, bool terminal, ACT_TYPE action,
 	return false;
 }
 
+void Logger::TrackParticles() {
+	// Trees kept for reuse or still being freed are not leaks
+	int active = model_->NumActiveParticles();
+	if (solver_ != NULL)
+		active -= solver_->NumHeldParticles();
+	int change = active_particles_ < 0 ? 0 : active - active_particles_;
+	if (peak_particles_ >= 0 && active > peak_particles_)
+		particle_leak_count_ += active - peak_particles_;
+	peak_particles_ = max(peak_particles_, active);
+	active_particles_ = active;
+
+	logi << "[Logger::SummarizeStep] Active particles: " << active << " ("
+			<< (change >= 0 ? "+" : "") << change << " this step), peak "
+			<< peak_particles_ << ", leak count " << particle_leak_count_ << endl;
+}
+
 void Logger::PrintStatistics(int num_runs) {
 	cout << std::setprecision(5) << "\nCompleted " << num_runs << " run(s)." << endl;
+	cout << "Particle leak count = " << particle_leak_count_ << endl;
 	cout << std::setprecision(5) << "Average total discounted reward (stderr) = "
 			<< AverageDiscountedRoundReward() << " ("
 			<< StderrDiscountedRoundReward() << ")" << endl;
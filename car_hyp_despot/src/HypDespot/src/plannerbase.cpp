@@ -106,6 +106,8 @@ option::Descriptor* BuildUsage(string lower_bounds_str,
 						"  \t--freq <arg>  \tFrequency launching a despot thread (default large number)." },
 					{ E_SWITCH_THRESH, 0, "", "switch", option::Arg::Required,
 						"  \t--switch <arg>  \tThreshold of num particles to switch to CPU expansions (default 2)." },
+					{ E_REUSE_TREE, 0, "", "reuse_tree", option::Arg::Required,
+						"  \t--reuse_tree <arg>  \tStart each search from the subtree of the executed action and observation (default false)." },
 					{ 0, 0, 0, 0, 0, 0 }
 			};
 	return usage;
@@ -400,6 +402,12 @@ void PlannerBase::OptionParse(option::Option *options, int &num_runs,
 		cout<<"[CmdLine] Threshold for switching back to CPU expansion: " << Globals::config.expanstion_switch_thresh << endl;
 	}
 
+	if(options[E_REUSE_TREE])
+	{
+		Globals::config.reuse_tree = atoi(options[E_REUSE_TREE].arg);
+		cout<<"[CmdLine] Reuse search trees across steps: " << Globals::config.reuse_tree << endl;
+	}
+
 
 
 	int verbosity = logging::level();
@@ -1,5 +1,8 @@
 #include <despot/random_streams.h>
 #include <despot/util/seeds.h>
+#include <despot/util/philox.h>
+#include <despot/util/logging.h>
+#include <algorithm>
 #include <vector>
 #include <sstream>
 #include <cstring>
@@ -9,37 +12,67 @@ using namespace std;
 namespace despot {
 
 
-RandomStreams::RandomStreams(int num_streams, int length) :
-	position_(0) {
-	vector<unsigned> seeds = Seeds::Next(num_streams);
+RandomStreams::RandomStreams(int num_streams, int length, int cached_depth) :
+	position_(0),
+	num_streams_(num_streams),
+	length_(length),
+	offset_(0),
+	imported_(false),
+	cached_depth_(0) {
+	seed_ = ((uint64_t) Seeds::Next() << 32) | Seeds::Next();
+	FillCache(min(cached_depth, length));
+}
 
-	streams_.resize(num_streams);
-	for (int i = 0; i < num_streams; i++) {
-		Random random(seeds[i]);
-		streams_[i].resize(length);
-		for (int j = 0; j < length; j++)
-			streams_[i][j] = random.NextDouble();
+void RandomStreams::FillCache(int cached_depth) {
+	cached_depth_ = 0;
+	cache_.reset();
+	if (cached_depth > 0) {
+		vector<double>* cache = new vector<double>(num_streams_ * cached_depth);
+		for (int i = 0; i < num_streams_; i++)
+			for (int j = 0; j < cached_depth; j++)
+				(*cache)[i * cached_depth + j] = Hash(seed_, i, offset_ + j);
+		cache_.reset(cache);
+		cached_depth_ = cached_depth;
 	}
 }
-RandomStreams::RandomStreams(const RandomStreams& src)
-{
-	position_=src.position_;
-	streams_.resize(src.streams_.size());
-	for(int i=0;i<streams_.size();i++)
-	{
-		streams_[i].resize(src.streams_[i].size());
-		memcpy(streams_[i].data(),src.streams_[i].data(), src.streams_[i].size()*sizeof(double));
-		/*for(int j=0;j<10;j++)
-			cout<<streams_[i][j]<<" ";
-		cout<<endl;*/
+
+void RandomStreams::Shift(int steps) {
+	if (imported_) {
+		loge << "[RandomStreams::Shift] Imported streams cannot be shifted"
+			<< endl;
+		return;
 	}
+	offset_ += steps;
+	// Copies keep the old table
+	FillCache(cached_depth_);
+}
+
+RandomStreams::RandomStreams() :
+	position_(0),
+	num_streams_(0),
+	length_(0),
+	seed_(0),
+	offset_(0),
+	imported_(false),
+	cached_depth_(0) {
+}
+
+double RandomStreams::Hash(uint64_t seed, int stream, int position) {
+	uint32_t counter[4] = { (uint32_t) stream, (uint32_t) position, 0, 0 };
+	uint32_t key[2] = { (uint32_t) seed, (uint32_t) (seed >> 32) };
+	uint32_t bits[4];
+	Philox4x32(counter, key, bits);
+	// 53 random bits mapped into (0, 1)
+	uint64_t mantissa = (((uint64_t) bits[0] << 32) | bits[1]) >> 11;
+	return (mantissa + 0.5) * (1.0 / 9007199254740992.0);
 }
+
 int RandomStreams::NumStreams() const {
-	return streams_.size();
+	return num_streams_;
 }
 
 int RandomStreams::Length() const {
-	return streams_.size() > 0 ? streams_[0].size() : 0;
+	return num_streams_ > 0 ? length_ : 0;
 }
 
 void RandomStreams::Advance() const {
@@ -60,14 +93,6 @@ bool RandomStreams::Exhausted() const {
 	return position_ > Length() - 1;
 }
 
-double RandomStreams::Entry(int stream) const {
-	return streams_[stream][position_];
-}
-
-double RandomStreams::Entry(int stream, int position) const {
-	return streams_[stream][position];
-}
-
 ostream& operator<<(ostream& os, const RandomStreams& stream) {
 	for (int i = 0; i < stream.NumStreams(); i++) {
 		os << "Stream " << i << ":";
@@ -81,10 +106,13 @@ ostream& operator<<(ostream& os, const RandomStreams& stream) {
 
 void RandomStreams::ImportStream(std::istream& in,int num_streams, int length)
 {
-	streams_.resize(num_streams);
-	for (int i = 0; i < num_streams; i++) {
-		streams_[i].resize(length);
-	}
+	vector<double>* streams = new vector<double>(num_streams * length);
+	num_streams_ = num_streams;
+	length_ = length;
+	cached_depth_ = length;
+	cache_.reset(streams);
+	offset_ = 0;
+	imported_ = true;
 	if (in.good())
 	{
 		string str;
@@ -104,7 +132,7 @@ void RandomStreams::ImportStream(std::istream& in,int num_streams, int length)
 						pos=0;
 						cout<<"Import stream error: pos>=length!"<<endl;
 					}
-					streams_[SID][pos]=num;
+					(*streams)[SID * length + pos]=num;
 					pos++;
 				}
 			}
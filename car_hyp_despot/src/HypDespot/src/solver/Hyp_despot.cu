@@ -10,6 +10,7 @@
 #include <despot/GPUinterface/GPUpolicy_graph.h>
 
 #include <despot/planner.h>
+#include <despot/util/hash.h>
 #include <string.h>
 #include <iomanip>
 
@@ -955,7 +956,7 @@ void DESPOT::MCSimulation(VNode* vnode, int ThreadID,
 	dim3 ThreadDim;
 	int NumActions = model->NumActions();
 	int NumObs = model->NumObservations();
-	int NumParticles=vnode->num_GPU_particles_;
+	int NumParticles=vnode->num_GPU_particles();
 
 	int ParalllelisminStep = model->ParallelismInStep();
 	int Shared_mem_per_particle=CalSharedMemSize();
@@ -1239,19 +1240,13 @@ void DESPOT::GPU_Expand_Action(VNode* vnode, ScenarioLowerBound* lb,
 
 			if(Obs_type==OBS_INT_ARRAY)
 			{
-				std::vector<int> tempobs;
 				int* Int_obs_list = &Hst_obs_int_all_a_and_p[ThreadID][(action * NumScenarios
 									+ parent_PID)*num_Obs_element_in_GPU];
 				int num_obs_elements=Int_obs_list[0];
-				tempobs.resize(num_obs_elements);
 
-				for(int i=0;i<num_obs_elements;i++)
-				{
-					tempobs[i]=Int_obs_list[i+1];
-				}
-
-				std::hash<std::vector<int>> myhash;
-				obs=myhash(tempobs);
+				FNVHash hash;
+				hash.Add(Int_obs_list + 1, num_obs_elements);
+				obs=hash.value();
 			}
 			else
 			{
@@ -1301,7 +1296,7 @@ void DESPOT::GPU_Expand_Action(VNode* vnode, ScenarioLowerBound* lb,
 		}
 
 
-		std::map<OBS_TYPE, VNode*>& children = qnode->children();
+		FlatMap<OBS_TYPE, VNode*>& children = qnode->children();
 		for (std::map<OBS_TYPE, std::vector<State*> >::iterator it =
 				partitions.begin(); it != partitions.end(); it++) {
 			OBS_TYPE obs = it->first;
@@ -1474,7 +1469,7 @@ void DESPOT::GPU_InitBounds(VNode* vnode, ScenarioLowerBound* lower_bound,
 	dim3 GridDim;
 	dim3 ThreadDim;
 	int NumScenarios = Globals::config.num_scenarios;
-	int NumParticles=vnode->num_GPU_particles_;
+	int NumParticles=vnode->num_GPU_particles();
 
 	int ParalllelisminStep = model->ParallelismInStep();
 
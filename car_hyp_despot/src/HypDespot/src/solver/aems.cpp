@@ -90,7 +90,7 @@ VNode* AEMS::FindMaxApproxErrorLeaf(VNode* root) {
 void AEMS::FindMaxApproxErrorLeaf(VNode* vnode, double likelihood,
 	double& bestAE, VNode*& bestNode) {
 	if (vnode->IsLeaf()) {
-		double curAE = likelihood * vnode->likelihood * Globals::Discount(vnode->depth())
+		double curAE = likelihood * vnode->likelihood() * Globals::Discount(vnode->depth())
 			* (vnode->upper_bound() - vnode->lower_bound());
 		if (curAE > bestAE) {
 			bestAE = curAE;
@@ -108,8 +108,8 @@ void AEMS::FindMaxApproxErrorLeaf(QNode* qnode, double likelihood,
 	double& bestAE, VNode*& bestNode) {
 	likelihood *= Likelihood(qnode);
 
-	map<OBS_TYPE, VNode*>& children = qnode->children();
-	for (map<OBS_TYPE, VNode*>::iterator it = children.begin();
+	FlatMap<OBS_TYPE, VNode*>& children = qnode->children();
+	for (FlatMap<OBS_TYPE, VNode*>::iterator it = children.begin();
 			it != children.end(); it++) {
 		VNode* vnode = it->second;
 		FindMaxApproxErrorLeaf(vnode, likelihood, bestAE, bestNode);
@@ -157,13 +157,13 @@ void AEMS::Update(QNode* qnode) {
 	double lower = qnode->step_reward;
 	double upper = qnode->step_reward;
 
-	map<OBS_TYPE, VNode*>& children = qnode->children();
-	for (map<OBS_TYPE, VNode*>::iterator it = children.begin();
+	FlatMap<OBS_TYPE, VNode*>& children = qnode->children();
+	for (FlatMap<OBS_TYPE, VNode*>::iterator it = children.begin();
 			it != children.end(); it++) {
 		VNode* vnode = it->second;
 
-		lower += Globals::Discount() * vnode->likelihood * vnode->lower_bound();
-		upper += Globals::Discount() * vnode->likelihood * vnode->upper_bound();
+		lower += Globals::Discount() * vnode->likelihood() * vnode->lower_bound();
+		upper += Globals::Discount() * vnode->likelihood() * vnode->upper_bound();
 	}
 
 	if (lower > qnode->lower_bound())
@@ -208,7 +208,7 @@ void AEMS::InitUpperBound(VNode* vnode, BeliefUpperBound* upper_bound,
 
 void AEMS::Expand(VNode* vnode, BeliefLowerBound* lower_bound,
 	BeliefUpperBound* upper_bound, const BeliefMDP* model, History& history) {
-	vector<QNode*>& children = vnode->children();
+	ArenaVector<QNode*>& children = vnode->children();
 	logv << "- Expanding vnode " << vnode << endl;
 	for (int action = 0; action < model->NumActions(); action++) {
 		logv << " Action " << action << endl;
@@ -224,7 +224,7 @@ void AEMS::Expand(QNode* qnode, BeliefLowerBound* lb, BeliefUpperBound* ub,
 	const BeliefMDP* model, History& history) {
 	VNode* parent = qnode->parent();
 	int action = qnode->edge();
-	map<OBS_TYPE, VNode*>& children = qnode->children();
+	FlatMap<OBS_TYPE, VNode*>& children = qnode->children();
 
 	const Belief* belief = parent->belief();
 	// cout << *belief << endl;
@@ -245,7 +245,7 @@ void AEMS::Expand(QNode* qnode, BeliefLowerBound* lb, BeliefUpperBound* ub,
 			<< " with weight " << weight << endl;
 		VNode* vnode = new VNode(model->Tau(belief, action, obs),
 			parent->depth() + 1, qnode, obs);
-		vnode->likelihood = weight;
+		vnode->likelihood(weight);
 		logv << " New node created!" << endl;
 		children[obs] = vnode;
 
@@ -270,7 +270,7 @@ void AEMS::Update(int action, OBS_TYPE obs) {
 		root_->Child(action)->children().erase(obs);
 		delete root_;
 		root_ = node;
-		root_->likelihood = 1.0;
+		root_->likelihood(1.0);
 		root_->parent(NULL);
 
 		belief_ = root_->belief();
@@ -4,6 +4,7 @@
 #include <despot/core/builtin_upper_bounds.h>
 
 #include <despot/core/prior.h>
+#include <despot/core/obs_partition.h>
 #include <exception>
 #undef LOG
 #define LOG(lv) \
@@ -49,23 +50,82 @@ bool DESPOT::Print_nodes = false;
 
 int max_trial = 10000000; // debugging
 
+// Smallest share of the scenarios a subtree must keep to be searched again
+static const double MIN_RETAINED_PARTICLES = 0.5;
+// Old trees that may still be waiting to be freed when a search starts
+static const int MAX_PENDING_TREES = 2;
+// Alignment of nodes built in the search arena
+static const size_t NODE_ALIGNMENT = 64;
+// Work per task when the particles of a node are stepped in parallel, in
+// units of DSPOMDP::ParallelismInStep (e.g. agents stepped)
+static const int STEP_CHUNK_WORK = 256;
+
+// Copies of a contiguous range of a node's particles and their step results
+struct StepChunk {
+	vector<State*> copies;
+	vector<double> rand_nums;
+	vector<double> rewards;
+	vector<OBS_TYPE> obs_list;
+	vector<bool> terminals;
+};
+
+// Whether the work of a node expansion is spread over the search workers;
+// not when debugging output has to stay in order
+static bool ParallelExpansion() {
+	return Globals::config.use_multi_thread_ && Globals::config.NUM_THREADS > 1
+	       && FIX_SCENARIO != 1 && !DESPOT::Print_nodes;
+}
+
+// Number of particles stepped per task during an expansion
+static int StepChunkSize(const DSPOMDP* model, int num_particles) {
+	if (!ParallelExpansion())
+		return max(num_particles, 1);
+	return max(STEP_CHUNK_WORK / max(model->ParallelismInStep(), 1), 1);
+}
+
 int stop_count=0;
 
-MemoryPool<QNode> DESPOT::qnode_pool_;
-MemoryPool<Shared_QNode> DESPOT::s_qnode_pool_;
+// Search threads allocate nodes from per-thread free lists
+MemoryPool<QNode> DESPOT::qnode_pool_(true);
+MemoryPool<Shared_QNode> DESPOT::s_qnode_pool_(true);
 
-MemoryPool<VNode> DESPOT::vnode_pool_;
-MemoryPool<Shared_VNode> DESPOT::s_vnode_pool_;
+MemoryPool<VNode> DESPOT::vnode_pool_(true);
+MemoryPool<Shared_VNode> DESPOT::s_vnode_pool_(true);
+
+Arena* DESPOT::search_arena_ = NULL;
+
+WorkStealingScheduler DESPOT::task_scheduler_;
+ThreadPool DESPOT::search_pool_;
 static int step_counter = 0;
 
 
+template<class T, class... Args>
+T* DESPOT::NewNode(MemoryPool<T>* pool, Args&&... args) {
+	if (search_arena_ != NULL) {
+		// Cache-line aligned, so the hot fields of a node never straddle lines
+		T* node = new (search_arena_->Allocate(sizeof(T), NODE_ALIGNMENT))
+			T(std::forward<Args>(args)...);
+		node->SetInArena();
+		node->UseArena(search_arena_);
+		return node;
+	}
+	if (pool != NULL)
+		return pool->Construct(std::forward<Args>(args)...);
+	return new T(std::forward<Args>(args)...);
+}
+
 DESPOT::DESPOT(const DSPOMDP* model, ScenarioLowerBound* lb,
                ScenarioUpperBound* ub, Belief* belief, bool use_GPU) :
-	Solver(model, belief), root_(NULL), lower_bound_(lb), upper_bound_(ub) {
+	Solver(model, belief), root_(NULL), lower_bound_(lb),
+	upper_bound_(ub) {
   logv << __FUNCTION__ << endl;
 	assert(model != NULL);
 	model_ = model;
 
+	logi << "[DESPOT] Node sizes (bytes): VNode " << sizeof(VNode)
+	     << ", Shared_VNode " << sizeof(Shared_VNode) << ", QNode "
+	     << sizeof(QNode) << ", Shared_QNode " << sizeof(Shared_QNode) << endl;
+
 	use_GPU_ = Globals::config.useGPU;
 
 	cout<<"DESPOT GPU mode "<< use_GPU_ << endl;
@@ -86,6 +146,11 @@ DESPOT::DESPOT(const DSPOMDP* model, ScenarioLowerBound* lb,
 DESPOT::~DESPOT() {
   logv << __FUNCTION__ << endl;
 
+	reclaimer_.Reclaim(root_, model_);
+	for (int k = 0; k < retained_roots_.size(); k++)
+		reclaimer_.Reclaim(retained_roots_[k], model_);
+	reclaimer_.Wait();
+
 	QuickRandom::DestroyRandGen();
 
 	if (use_GPU_)
@@ -207,6 +272,12 @@ Shared_VNode* DESPOT::Trial(Shared_VNode* root, RandomStreams& streams,
 	int threadID=MapThread(this_thread::get_id());
 	int trial_expansion_count = 0;
 
+	// While another worker holds a node (typically to expand it), run leaf
+	// tasks, which may well be that expansion's own work
+	function<bool()> help = [threadID]() {
+		return task_scheduler_.RunOne(threadID, true);
+	};
+
 	do {
 		logd << "Level " << cur->depth() << " start" << endl;
 
@@ -226,7 +297,8 @@ Shared_VNode* DESPOT::Trial(Shared_VNode* root, RandomStreams& streams,
 		}
 
 		try {
-			lock_guard < mutex > lck(cur->GetMutex());
+			cur->GetMutex().lock(help);
+			lock_guard < ProfiledMutex > lck(cur->GetMutex(), adopt_lock);
 			if (((VNode*) cur)->IsLeaf()) {
 				auto start = Time::now();
 				Expand(((VNode*) cur), lower_bound, upper_bound, model, streams,
@@ -253,7 +325,8 @@ Shared_VNode* DESPOT::Trial(Shared_VNode* root, RandomStreams& streams,
 		Shared_VNode* next;
 		try {
 			if (!cur->IsLeaf()) {
-				lock_guard < mutex > lck(cur->GetMutex());
+				cur->GetMutex().lock(help);
+				lock_guard < ProfiledMutex > lck(cur->GetMutex(), adopt_lock);
 
 				qstar = SelectBestUpperBoundNode(cur, despot_thread);
 				if (qstar)
@@ -333,9 +406,9 @@ void DESPOT::ExploitBlockers(VNode* vnode) {
 				cur->upper_bound(value);
 				cur->utility_upper_bound(value);
 			} else {
-				const map<OBS_TYPE, VNode*>& siblings =
+				const FlatMap<OBS_TYPE, VNode*>& siblings =
 				    cur->parent()->children();
-				for (map<OBS_TYPE, VNode*>::const_iterator it =
+				for (FlatMap<OBS_TYPE, VNode*>::const_iterator it =
 				            siblings.begin(); it != siblings.end(); it++) {
 					VNode* node = it->second;
 					double value = node->default_move().value;
@@ -372,18 +445,18 @@ void DESPOT::ExploitBlockers(Shared_VNode* vnode) {
 
 		if (blocker != NULL) {
 			if (cur->parent() == NULL || blocker == cur) {
-				lock_guard < mutex > lok(cur->GetMutex());			//lock cur
+				lock_guard < ProfiledMutex > lok(cur->GetMutex());			//lock cur
 				double value = ((VNode*) cur)->default_move().value;
 				((VNode*) cur)->lower_bound(value);
 				((VNode*) cur)->upper_bound(value);
 				((VNode*) cur)->utility_upper_bound(value);
 			} else {
-				const map<OBS_TYPE, VNode*>& siblings =
+				const FlatMap<OBS_TYPE, VNode*>& siblings =
 				    cur->parent()->children();
-				for (map<OBS_TYPE, VNode*>::const_iterator it =
+				for (FlatMap<OBS_TYPE, VNode*>::const_iterator it =
 				            siblings.begin(); it != siblings.end(); it++) {
 					Shared_VNode* node = static_cast<Shared_VNode*>(it->second);
-					lock_guard < mutex > lok(node->GetMutex());		//lock node
+					lock_guard < ProfiledMutex > lok(node->GetMutex());		//lock node
 					double value = ((VNode*) node)->default_move().value;
 					((VNode*) node)->lower_bound(value);
 					((VNode*) node)->upper_bound(value);
@@ -405,13 +478,12 @@ void DESPOT::ExploitBlockers(Shared_VNode* vnode) {
 		}
 	}
 }
-void DESPOT::ExpandTreeServer(RandomStreams streams,
+void DESPOT::ExpandTreeServer(Shared_VNode* root, RandomStreams streams,
                               ScenarioLowerBound* lower_bound, ScenarioUpperBound* upper_bound,
                               const DSPOMDP* model, History history,
                               Shared_SearchStatistics* statistics, double& used_time,
                               double& explore_time, double& backup_time, int& num_trials,
-                              double timeout, MsgQueque<Shared_VNode>& node_queue,
-                              MsgQueque<Shared_VNode>& print_queue, int threadID) {
+                              double timeout, WorkStealingScheduler& scheduler, int threadID) {
 	logd << __FUNCTION__ << endl;
 	Globals::ChooseGPUForThread();			//otherwise the GPUID would be 0 (default)
 	Globals::AddMappedThread(this_thread::get_id(), threadID);
@@ -419,106 +491,125 @@ void DESPOT::ExpandTreeServer(RandomStreams streams,
 	explore_time = 0;
 	backup_time = 0;
 	num_trials = 0;
-	Shared_VNode* root = node_queue.receive(true, timeout);
 //	DEBUG(string_sprintf("thread %d", threadID));
 
 	logd << "time_out = "<< timeout << endl;
 
-	do {
-		logd << "Trial " << num_trials << " start" << endl;
-
-		if (root == NULL || Globals::Timeout(timeout)) {
-			int the_case = (root == NULL) ? 0 : 1;
-			Globals::Global_print_deleteT(this_thread::get_id(), 0, the_case);
-			print_queue.WakeOneThread();
-			break;
-		}
-		if (statistics->num_expanded_nodes > 100000000)
-			break;
-		auto start = Time::now();
-		bool despot_thread = root->check_despot_thread();
+	// Trials of this thread form a chain: each one queues the next on the
+	// worker that ran it until the thread's budget is used up. Only one trial
+	// of the chain exists at a time, so streams and history are not shared.
+	// The queued trial owns the chain's state, so a stolen trial never refers
+	// to this frame.
+	struct TrialChain {
+		Shared_VNode* root;
+		RandomStreams streams;
+		ScenarioLowerBound* lower_bound;
+		ScenarioUpperBound* upper_bound;
+		const DSPOMDP* model;
+		History history;
+		Shared_SearchStatistics* statistics;
+		double timeout;
+		WorkStealingScheduler* scheduler;
+
+		double used_time;
+		double explore_time;
+		double backup_time;
+		int num_trials;
+	};
+
+	struct TrialTask {
+		shared_ptr<TrialChain> chain;
+
+		void operator()(int worker) const {
+			TrialChain& c = *chain;
+			logd << "Trial " << c.num_trials << " start" << endl;
+
+			if (Globals::Timeout(c.timeout))
+				return;
+			if (c.statistics->num_expanded_nodes > 100000000)
+				return;
+			auto start = Time::now();
+			bool despot_thread = c.root->check_despot_thread();
 
-		if (despot_thread)
-			logi << "[ExpandTreeServer] Launch a despot thread from root at visit "<< root->visit_count_ << endl;;
-		root->visit_count_++;
+			if (despot_thread)
+				logi << "[ExpandTreeServer] Launch a despot thread from root at visit "<< c.root->visit_count_ << endl;;
+			c.root->visit_count_++;
 
-		bool Expansion_done = false;
-		VNode* cur = Trial(root, streams, lower_bound, upper_bound, model,
-		                   history, Expansion_done, statistics, despot_thread);
+			bool Expansion_done = false;
+			VNode* cur = Trial(c.root, c.streams, c.lower_bound, c.upper_bound, c.model,
+			                   c.history, Expansion_done, c.statistics, despot_thread);
 
-		used_time += Globals::ElapsedTime(start);
-		explore_time += Globals::ElapsedTime(start);
+			c.used_time += Globals::ElapsedTime(start);
+			c.explore_time += Globals::ElapsedTime(start);
 
-		logd << "Backup in trial " << num_trials << " start" << endl;
+			logd << "Backup in trial " << c.num_trials << " start" << endl;
 
-		start = Time::now();
-		if (Expansion_done)
-			Backup(cur, true);
-		else
-		{
-			while (cur->parent() != NULL) {
-				Shared_QNode* qnode = static_cast<Shared_QNode*>(cur->parent());
-				if (Globals::config.exploration_mode == VIRTUAL_LOSS)
-				{
-					if (cur->depth() >= 0)
-						qnode->exploration_bonus += CalExplorationValue(cur->depth());
-					else
-						qnode->exploration_bonus = 0;
+			start = Time::now();
+			if (Expansion_done)
+				Backup(cur, true);
+			else
+			{
+				while (cur->parent() != NULL) {
+					Shared_QNode* qnode = static_cast<Shared_QNode*>(cur->parent());
+					if (Globals::config.exploration_mode == VIRTUAL_LOSS)
+					{
+						if (cur->depth() >= 0)
+							qnode->exploration_bonus += CalExplorationValue(cur->depth());
+						else
+							qnode->exploration_bonus = 0;
+					}
+					cur = qnode->parent();
+					if ( Globals::config.exploration_mode == VIRTUAL_LOSS) //release virtual loss
+						static_cast<Shared_VNode*>(cur)->exploration_bonus += CalExplorationValue(((VNode*) cur)->depth());
+					else if ( Globals::config.exploration_mode == UCT) //release virtual loss
+						static_cast<Shared_VNode*>(cur)->exploration_bonus +=
+						    CalExplorationValue(((VNode*) cur)->depth()) * ((VNode*) cur)->Weight();
 				}
-				cur = qnode->parent();
-				if ( Globals::config.exploration_mode == VIRTUAL_LOSS) //release virtual loss
-					static_cast<Shared_VNode*>(cur)->exploration_bonus += CalExplorationValue(((VNode*) cur)->depth());
-				else if ( Globals::config.exploration_mode == UCT) //release virtual loss
-					static_cast<Shared_VNode*>(cur)->exploration_bonus +=
-					    CalExplorationValue(((VNode*) cur)->depth()) * ((VNode*) cur)->Weight();
 			}
-		}
 
-		logd << "Backup in trial " << num_trials << " end" << endl;
+			logd << "Backup in trial " << c.num_trials << " end" << endl;
 
-		if (statistics != NULL) {
-			statistics->Add_time_backup(Globals::ElapsedTime(start));
-		}
-		used_time += Globals::ElapsedTime(start);
-		backup_time += Globals::ElapsedTime(start);
+			if (c.statistics != NULL) {
+				c.statistics->Add_time_backup(Globals::ElapsedTime(start));
+			}
+			c.used_time += Globals::ElapsedTime(start);
+			c.backup_time += Globals::ElapsedTime(start);
 
-		logd << "Trial " << num_trials << " end" << endl;
+			logd << "Trial " << c.num_trials << " end" << endl;
 
-		Globals::AddSerialTime(used_time);
-		num_trials++;
-		print_queue.send(root);
+			Globals::AddSerialTime(c.used_time);
+			c.num_trials++;
 
-//		if (DESPOT::Debug_mode || FIX_SCENARIO == 1)
-		if (num_trials == max_trial){
-			cout << "Reaching max trials, stopping search" << endl;
-			break;
+//			if (DESPOT::Debug_mode || FIX_SCENARIO == 1)
+			if (c.num_trials == max_trial){
+				cout << "Reaching max trials, stopping search" << endl;
+				return;
+			}
+
+			if (c.used_time /** (num_trials + 1.0) / num_trials*/ < c.timeout
+			         && !Globals::Timeout(Globals::config.time_per_move)
+			         && (((VNode*) c.root)->upper_bound() - ((VNode*) c.root)->lower_bound())
+			         > 1e-6)
+				c.scheduler->Submit(worker, *this, WorkStealingScheduler::TRIAL);
 		}
-	} while (used_time /** (num_trials + 1.0) / num_trials*/ < timeout
-	         && !Globals::Timeout(Globals::config.time_per_move)
-	         && (((VNode*) root)->upper_bound() - ((VNode*) root)->lower_bound())
-	         > 1e-6);
+	};
 
-//    printf("Termination of thread %d: used_time = %f, timeout = %d, root gap = %f\n", threadID, used_time,
-//      Globals::Timeout(Globals::config.time_per_move), ((VNode*) root)->upper_bound() - ((VNode*) root)->lower_bound());
+	shared_ptr<TrialChain> chain(new TrialChain { root, streams, lower_bound,
+		upper_bound, model, history, statistics, timeout, &scheduler,
+		used_time, explore_time, backup_time, num_trials });
+	scheduler.Submit(threadID, TrialTask { chain }, WorkStealingScheduler::TRIAL);
 
-	Globals::Global_print_deleteT(this_thread::get_id(), 0, 1);
+	// Keep serving tasks of other threads once this chain has ended
+	scheduler.Run(threadID);
 
-	Globals::MinusActiveThread();
-	print_queue.WakeOneThread();
-}
+	// Run only returns once no task is queued or running anywhere
+	used_time = chain->used_time;
+	explore_time = chain->explore_time;
+	backup_time = chain->backup_time;
+	num_trials = chain->num_trials;
 
-void PrintServer(MsgQueque<Shared_VNode>& print_queue, float timeout) {
-  logv << __FUNCTION__ << endl;
-	//cout << "Create printing thread " << this_thread::get_id() << endl;
-	for (;;) {
-		Shared_VNode* node = print_queue.receive(false, timeout);
-		if (node == NULL || Globals::Timeout(timeout)) {
-			int the_case = (node == NULL) ? 0 : 1;
-			Globals::Global_print_deleteT(this_thread::get_id(), 1, the_case);
-			print_queue.WakeOneThread();
-			break;
-		}
-	}
+//    printf("Termination of thread %d: used_time = %f, timeout = %d, root gap = %f\n", threadID, used_time,
+//      Globals::Timeout(Globals::config.time_per_move), ((VNode*) root)->upper_bound() - ((VNode*) root)->lower_bound());
 }
 
 VNode* DESPOT::ConstructTree(vector<State*>& particles, RandomStreams& streams,
@@ -533,10 +624,6 @@ VNode* DESPOT::ConstructTree(vector<State*>& particles, RandomStreams& streams,
 
 	Globals::RecordSearchStartTime();
 
-	double used_time = 0;
-	double explore_time = 0;
-	double backup_time = 0;
-
 	vector<int> particleIDs;
 	particleIDs.resize(particles.size());
 	for (int i = 0; i < particles.size(); i++) {
@@ -546,13 +633,13 @@ VNode* DESPOT::ConstructTree(vector<State*>& particles, RandomStreams& streams,
 
 	VNode* root = NULL;
 	if (Globals::config.use_multi_thread_) {
-		root = new Shared_VNode(particles, particleIDs);
+		root = NewNode<Shared_VNode>(NULL, particles, particleIDs);
 		if (Globals::config.exploration_mode == UCT)
 			static_cast<Shared_VNode*>(root)->visit_count_ = 1.1;
 
 		ComputeLegalActions(root, model);
 	} else
-		root = new VNode(particles, particleIDs);
+		root = NewNode<VNode>(NULL, particles, particleIDs);
 
 	if (use_GPU_) {
 		PrepareGPUDataForRoot(root, model, particleIDs, particles);
@@ -576,6 +663,19 @@ VNode* DESPOT::ConstructTree(vector<State*>& particles, RandomStreams& streams,
 			cout << "Root bounds: (" << statistics->initial_lb << "," << statistics->initial_ub << ")" << endl;
 	}
 
+	return ExpandTree(root, streams, lower_bound, upper_bound, model, history,
+		timeout, statistics);
+}
+
+VNode* DESPOT::ExpandTree(VNode* root, RandomStreams& streams,
+                          ScenarioLowerBound* lower_bound, ScenarioUpperBound* upper_bound,
+                          const DSPOMDP* model, History& history, double timeout,
+                          SearchStatistics* statistics) {
+	logv << __FUNCTION__ << endl;
+
+	double used_time = 0;
+	double explore_time = 0;
+	double backup_time = 0;
 	int num_trials = 0;
 
 	used_time = Globals::ElapsedSearchTime();
@@ -587,44 +687,27 @@ VNode* DESPOT::ConstructTree(vector<State*>& particles, RandomStreams& streams,
 		if (Globals::config.use_multi_thread_) {
 
 			//cout << "Start!" << endl << endl;
-			double thread_used_time[Globals::config.NUM_THREADS];
-			double thread_explore_time[Globals::config.NUM_THREADS];
-			double thread_backup_time[Globals::config.NUM_THREADS];
-			int num_trials_t[Globals::config.NUM_THREADS];
-			for (int i = 0; i < Globals::config.NUM_THREADS; i++) {
-				Expand_queue.send(static_cast<Shared_VNode*>(root));
-				thread_used_time[i] = used_time;
-				thread_explore_time[i] = 0;
-				thread_backup_time[i] = 0;
-			}
-
-			vector<future<void>> futures;
-			for (int i = 0; i < Globals::config.NUM_THREADS; i++) {
-				RandomStreams local_stream(streams);
-				History local_history(history);
-				futures.push_back(
-					async(launch::async, &ExpandTreeServer, local_stream,
-						  lower_bound, upper_bound, model, local_history,
-						  static_cast<Shared_SearchStatistics*>(statistics),
-						  ref(thread_used_time[i]),
-						  ref(thread_explore_time[i]),
-						  ref(thread_backup_time[i]), ref(num_trials_t[i]),
-						  timeout, ref(Expand_queue), ref(Print_queue), i));
-			}
-
-			futures.push_back(
-				async(launch::async, &PrintServer, ref(Print_queue), timeout));
+			int num_threads = Globals::config.NUM_THREADS;
+			vector<double> thread_used_time(num_threads, used_time);
+			vector<double> thread_explore_time(num_threads, 0);
+			vector<double> thread_backup_time(num_threads, 0);
+			vector<int> num_trials_t(num_threads, 0);
+			task_scheduler_.Reset(num_threads);
 
 			double passed_time = Globals::ElapsedSearchTime();
-			cout << std::setprecision(5) << Globals::config.NUM_THREADS << " threads started at the "
+			cout << std::setprecision(5) << num_threads << " threads started at the "
 				 << passed_time << "'th second" << endl;
 			try {
-				while (!futures.empty()) {
-					auto ftr = std::move(futures.back());
-					futures.pop_back();
-					ftr.get();
-				}
-				for (int i = 0; i < Globals::config.NUM_THREADS; i++) {
+				// Threads share the stream table; each copy only owns a position
+				search_pool_.Run(num_threads, [&](int i) {
+					ExpandTreeServer(static_cast<Shared_VNode*>(root), streams,
+						lower_bound, upper_bound, model, history,
+						static_cast<Shared_SearchStatistics*>(statistics),
+						thread_used_time[i], thread_explore_time[i],
+						thread_backup_time[i], num_trials_t[i],
+						timeout, task_scheduler_, i);
+				});
+				for (int i = 0; i < num_threads; i++) {
 					used_time = max(used_time, thread_used_time[i]);
 					explore_time = max(explore_time, thread_explore_time[i]);
 					backup_time = max(backup_time, thread_backup_time[i]);
@@ -638,6 +721,9 @@ VNode* DESPOT::ConstructTree(vector<State*>& particles, RandomStreams& streams,
 			cout << std::setprecision(5) << "Tree expansion in "
 				 << passed_time << " s" << endl;
 
+			logi << "[DESPOT::ExpandTree] Search thread utilization:" << endl
+				<< task_scheduler_;
+
 		} else {
 
 			do {
@@ -769,6 +855,23 @@ void DESPOT::InitBounds(VNode* vnode, ScenarioLowerBound* lower_bound,
 	}
 }
 
+void DESPOT::ParallelFor(int n, const function<void(int)>& job) {
+	int num_workers = Globals::config.use_multi_thread_ ?
+		min(Globals::config.NUM_THREADS, n) : 1;
+	if (num_workers <= 1) {
+		for (int i = 0; i < n; i++)
+			job(i);
+		return;
+	}
+
+	search_pool_.Run(num_workers, [&](int worker) {
+		// Models index their per-thread state by the mapped thread ID
+		Globals::AddMappedThread(this_thread::get_id(), worker);
+		for (int i = worker; i < n; i += num_workers)
+			job(i);
+	});
+}
+
 ValuedAction DESPOT::Search() {
   logv << __FUNCTION__ << endl;
 	if (logging::level() >= logging::DEBUG) {
@@ -783,10 +886,27 @@ ValuedAction DESPOT::Search() {
 
 	double start = get_time_second();
 
+	// The planning thread shares index 0 with search worker 0, which only
+	// runs while this thread waits for the search
+	Globals::AddMappedThread(this_thread::get_id(), 0);
+
 	if (Debug_mode){
 		step_counter++;
 	}
 
+	// Tree of the previous search whose subtree was not retained
+	if (root_ != NULL) {
+		reclaimer_.Reclaim(root_, model_);
+		root_ = NULL;
+	}
+
+	// Bound the memory held by trees waiting to be freed
+	if (reclaimer_.num_pending() > MAX_PENDING_TREES) {
+		logi << "[DESPOT::Search] Waiting for " << reclaimer_.num_pending()
+		     << " old trees to be freed" << endl;
+		reclaimer_.Wait();
+	}
+
 	vector<State*> particles;
 	if (FIX_SCENARIO == 1) {
 		ifstream fin;
@@ -808,6 +928,17 @@ ValuedAction DESPOT::Search() {
 	logi << "[DESPOT::Search] Time for sampling " << particles.size()
 	     << " particles: " << (get_time_second() - start) << "s" << endl;
 
+	// Kept subtrees are matched against the particles of the new belief
+	VNode* resumed_root = NULL;
+	if (!retained_roots_.empty()) {
+		resumed_root = ResumeRetainedSubtree(particles);
+		if (resumed_root != NULL) {
+			for (int i = 0; i < particles.size(); i++)
+				model_->Free(particles[i]);
+			particles.clear();
+		}
+	}
+
 	if (FIX_SCENARIO == 2) {
 		for (int i = 0; i < particles.size(); i++) {
 			particles[i]->scenario_id = i;
@@ -862,6 +993,10 @@ ValuedAction DESPOT::Search() {
 
 		fin.close();
 		cout << "[FIX_SCENARIO] random streams read from file "<< stream_file << endl;
+	} else if (resumed_root != NULL) {
+		// The retained subtree was simulated with the last streams one level
+		// deeper; advance them so that its bounds and particles stay valid
+		streams.Shift(1);
 	} else {
 		streams = RandomStreams(Globals::config.num_scenarios,
 		                        Globals::config.search_depth);
@@ -886,27 +1021,6 @@ ValuedAction DESPOT::Search() {
 	} else {
 		logi << "[DESPOT::Search] Initializing streams " << endl;
 
-		if (FIX_SCENARIO == 1 || Debug_mode) {
-			std::ifstream fin;
-			string stream_file = "Streams" + std::to_string(step_counter) + ".txt";
-
-			fin.open(stream_file, std::ios::in);
-			streams.ImportStream(fin, Globals::config.num_scenarios,
-			                     Globals::config.search_depth);
-			fin.close();
-
-		} else {
-			streams = RandomStreams(Globals::config.num_scenarios,
-			                        Globals::config.search_depth);
-		}
-		if (FIX_SCENARIO == 2) {
-			std::ofstream fout;
-			string stream_file = "Streams" + std::to_string(step_counter) + ".txt";
-
-			fout.open(stream_file, std::ios::trunc);
-			fout << streams;
-			fout.close();
-		}
 		lower_bound_->Init(streams);
 		upper_bound_->Init(streams);
 	}
@@ -924,30 +1038,71 @@ ValuedAction DESPOT::Search() {
 
 	logi << "[used param] time_per_move=" << Globals::config.time_per_move << endl;
 
+	// A tree that is not kept past this search is built in an arena and
+	// released with it
+	if (!TreeReuseEnabled())
+		search_arena_ = reclaimer_.AcquireArena();
 
-	root_ = ConstructTree(particles, streams, lower_bound_, upper_bound_,
-	                      model_, history_, Globals::config.time_per_move, &statistics_);
-	logi << "[DESPOT::Search] Time for tree construction: "
-	     << (get_time_second() - start) << "s" << endl;
-	start = get_time_second();
+	ProfiledMutex::ResetContention();
 
-	logi  << "[DESPOT::Search] Freeing the model" << endl;
-	root_->Free(*model_);
+	if (resumed_root != NULL) {
+		logi << "[DESPOT::Search] Resuming the subtree retained from the last search ("
+		     << resumed_root->particles().size() << " particles)" << endl;
 
-	if (use_GPU_)
-		model_->DeleteGPUParticles(MEMORY_MODE(RESET));
+		root_ = resumed_root;
+
+		statistics_.num_particles_before_search = model_->NumActiveParticles();
+		Globals::RecordSearchStartTime();
+		Initial_root_gap = Gap(root_);
+		statistics_.initial_lb = root_->lower_bound();
+		statistics_.initial_ub = root_->upper_bound();
 
-	logi << "[DESPOT::Search] Time for freeing particles in search tree: "
+		root_ = ExpandTree(root_, streams, lower_bound_, upper_bound_,
+		                   model_, history_, Globals::config.time_per_move, &statistics_);
+	} else
+		root_ = ConstructTree(particles, streams, lower_bound_, upper_bound_,
+		                      model_, history_, Globals::config.time_per_move, &statistics_);
+	logi << "[DESPOT::Search] Time for tree construction: "
 	     << (get_time_second() - start) << "s" << endl;
 
+	if (Globals::config.use_multi_thread_) {
+		ProfiledMutex::Profile contention = ProfiledMutex::Contention();
+		logi << "[DESPOT::Search] Node lock contention: " << contention.num_waits
+		     << " waits, " << contention.wait_time << "s waited in total" << endl;
+	}
 
-	start = get_time_second();
 	ValuedAction astar = OptimalAction(root_);
 
-	delete root_;
+	if (TreeReuseEnabled()) {
+		// Kept until RetainSubtree or the next search
+		logi << "[DESPOT::Search] Keeping the tree for reuse" << endl;
+	} else {
+		start = get_time_second();
+
+		if (use_GPU_)
+			model_->DeleteGPUParticles(MEMORY_MODE(RESET));
 
-	logi << "[DESPOT::Search] Time for deleting tree: "
-	     << (get_time_second() - start) << "s" << endl;
+		logi << "[DESPOT::Search] Tree arena: " << search_arena_->num_used_blocks()
+		     << " blocks used, " << search_arena_->capacity() / (1 << 20)
+		     << " MB reserved" << endl;
+
+		// Particles and nodes are freed while the action is executed and the
+		// belief updated
+		reclaimer_.Reclaim(root_, model_, search_arena_);
+		root_ = NULL;
+		search_arena_ = NULL;
+
+		logi << "[DESPOT::Search] Time for handing the tree to the reclaimer: "
+		     << (get_time_second() - start) << "s" << endl;
+	}
+
+	if (Globals::config.use_multi_thread_) {
+		logi << "[DESPOT::Search] V-node pool: " << s_vnode_pool_ << endl
+			<< "[DESPOT::Search] Q-node pool: " << s_qnode_pool_ << endl;
+	} else {
+		logi << "[DESPOT::Search] V-node pool: " << vnode_pool_ << endl
+			<< "[DESPOT::Search] Q-node pool: " << qnode_pool_ << endl;
+	}
 
 	//logi << "[DESPOT::Search] Search statistics:" << endl << statistics_
 	//     << endl;
@@ -1101,7 +1256,7 @@ VNode* DESPOT::Prune(VNode* vnode, int& pruned_action, double& pruned_value) {
 	VNode* pruned_v = new VNode(empty, emptyID, vnode->depth(), NULL,
 	                            vnode->edge());
 
-	vector<QNode*>& children = vnode->children();
+	ArenaVector<QNode*>& children = vnode->children();
 	ACT_TYPE astar = -1;
 	double nustar = Globals::NEG_INFTY;
 	QNode* qstar = NULL;
@@ -1146,8 +1301,8 @@ QNode* DESPOT::Prune(QNode* qnode, double& pruned_value) {
   logv << __FUNCTION__ << endl;
 	QNode* pruned_q = new QNode((VNode*) NULL, qnode->edge());
 	pruned_value = qnode->step_reward - Globals::config.pruning_constant;
-	map<OBS_TYPE, VNode*>& children = qnode->children();
-	for (map<OBS_TYPE, VNode*>::iterator it = children.begin();
+	FlatMap<OBS_TYPE, VNode*>& children = qnode->children();
+	for (FlatMap<OBS_TYPE, VNode*>::iterator it = children.begin();
 	        it != children.end(); it++) {
 		ACT_TYPE astar;
 		double nu;
@@ -1182,8 +1337,8 @@ void DESPOT::OutputWeight(QNode* qnode) {
 		     << "  ub: " << qnode->upper_bound() / qnode->Weight();
 		logi.precision(3);
 		logi << " weight: " << qnode->Weight() << endl;
-		map<OBS_TYPE, VNode*>& vnodes = qnode->children();
-		for (map<OBS_TYPE, VNode*>::iterator it = vnodes.begin();
+		FlatMap<OBS_TYPE, VNode*>& vnodes = qnode->children();
+		for (FlatMap<OBS_TYPE, VNode*>::iterator it = vnodes.begin();
 		        it != vnodes.end(); it++) {
 			if (it->second == NULL) {
 				logi << "child vnode is empty" << endl;
@@ -1360,8 +1515,8 @@ VNode* DESPOT::SelectBestWEUNode(QNode* qnode, bool despot_thread) {
 	if (despot_thread)
 		use_exploration_value = false;
 
-	map<OBS_TYPE, VNode*>& children = qnode->children();
-	for (map<OBS_TYPE, VNode*>::iterator it = children.begin();
+	FlatMap<OBS_TYPE, VNode*>& children = qnode->children();
+	for (FlatMap<OBS_TYPE, VNode*>::iterator it = children.begin();
 			it != children.end(); it++) {
 		VNode* vnode = it->second;
 
@@ -1543,20 +1698,14 @@ void DESPOT::Update(VNode* vnode, bool real) {
 		utility_upper = max(utility_upper, qnode->utility_upper_bound());
 	}
 
-	if (lower > vnode->lower_bound()) {
-		vnode->lower_bound(lower);
-	}
-	if (upper < vnode->upper_bound()) {
-		vnode->upper_bound(upper);
-	}
-	if (utility_upper < vnode->utility_upper_bound()) {
-		vnode->utility_upper_bound(utility_upper);
-	}
+	vnode->ImproveBounds(lower, upper, utility_upper);
 }
 
 void DESPOT::Update(Shared_VNode* vnode, bool real) {
   logv << __FUNCTION__ << endl;
-	lock_guard < mutex > lck(vnode->GetMutex());//lock v_node during updation
+	// Lock-free: bounds only ever tighten, so a backup computed from
+	// children that are concurrently updated is still valid, and the later
+	// backup of those children sees their new values
 	if (((VNode*) vnode)->depth() > 0 && real) {
 		if ( Globals::config.exploration_mode == VIRTUAL_LOSS) //release virtual loss
 			vnode->exploration_bonus += CalExplorationValue(((VNode*) vnode)->depth());
@@ -1565,7 +1714,7 @@ void DESPOT::Update(Shared_VNode* vnode, bool real) {
 			                            * ((VNode*) vnode)->Weight();
 	}
 
-	if (((VNode*) vnode)->IsLeaf()) {
+	if (!vnode->IsExpanded()) {
 		return;
 	}
 
@@ -1610,16 +1759,7 @@ void DESPOT::Update(Shared_VNode* vnode, bool real) {
 
 	}
 
-	if (lower > ((VNode*) vnode)->lower_bound()) {
-		((VNode*) vnode)->lower_bound(lower);
-	}
-
-	if (upper < ((VNode*) vnode)->upper_bound()) {
-		((VNode*) vnode)->upper_bound(upper);
-	}
-	if (utility_upper < ((VNode*) vnode)->utility_upper_bound()) {
-		((VNode*) vnode)->utility_upper_bound(utility_upper);
-	}
+	((VNode*) vnode)->ImproveBounds(lower, upper, utility_upper);
 
 //	cout << "3" << endl;
 
@@ -1632,8 +1772,8 @@ void DESPOT::Update(QNode* qnode, bool real) {
 	double utility_upper = qnode->step_reward
 	                       + Globals::config.pruning_constant;
 
-	map<OBS_TYPE, VNode*>& children = qnode->children();
-	for (map<OBS_TYPE, VNode*>::iterator it = children.begin();
+	FlatMap<OBS_TYPE, VNode*>& children = qnode->children();
+	for (FlatMap<OBS_TYPE, VNode*>::iterator it = children.begin();
 	        it != children.end(); it++) {
 		VNode* vnode = it->second;
 
@@ -1642,20 +1782,12 @@ void DESPOT::Update(QNode* qnode, bool real) {
 		utility_upper += vnode->utility_upper_bound();
 	}
 
-	if (lower > qnode->lower_bound()) {
-		qnode->lower_bound(lower);
-	}
-	if (upper < qnode->upper_bound()) {
-		qnode->upper_bound(upper);
-	}
-	if (utility_upper < qnode->utility_upper_bound()) {
-		qnode->utility_upper_bound(utility_upper);
-	}
+	qnode->ImproveBounds(lower, upper, utility_upper);
 }
 
 void DESPOT::Update(Shared_QNode* qnode, bool real) {
   logv << __FUNCTION__ << endl;
-	lock_guard < mutex > lck(qnode->GetMutex());//lock v_node during updation
+	// Lock-free, see Update(Shared_VNode*)
 
 	double lower = qnode->step_reward;
 	double upper = qnode->step_reward;
@@ -1664,8 +1796,8 @@ void DESPOT::Update(Shared_QNode* qnode, bool real) {
 	                       + Globals::config.pruning_constant;
 
 	int cur_depth = -1;
-	map<OBS_TYPE, VNode*>& children = ((QNode*) qnode)->children();
-	for (map<OBS_TYPE, VNode*>::iterator it = children.begin();
+	FlatMap<OBS_TYPE, VNode*>& children = ((QNode*) qnode)->children();
+	for (FlatMap<OBS_TYPE, VNode*>::iterator it = children.begin();
 	        it != children.end(); it++) {
 		Shared_VNode* vnode = static_cast<Shared_VNode*>(it->second);
 
@@ -1683,16 +1815,7 @@ void DESPOT::Update(Shared_QNode* qnode, bool real) {
 			qnode->exploration_bonus = 0;
 	}
 
-	if (lower > ((QNode*) qnode)->lower_bound()) {
-		((QNode*) qnode)->lower_bound(lower);
-	}
-
-	if (upper < ((QNode*) qnode)->upper_bound()) {
-		((QNode*) qnode)->upper_bound(upper);
-	}
-	if (utility_upper < ((QNode*) qnode)->utility_upper_bound()) {
-		((QNode*) qnode)->utility_upper_bound(utility_upper);
-	}
+	((QNode*) qnode)->ImproveBounds(lower, upper, utility_upper);
 }
 
 void DESPOT::Backup(VNode* vnode, bool real) {
@@ -1827,7 +1950,7 @@ void DESPOT::Expand(VNode* vnode, ScenarioLowerBound* lower_bound,
                     ScenarioUpperBound* upper_bound, const DSPOMDP* model,
                     RandomStreams& streams, History& history) {
   logv << __FUNCTION__ << endl;
-	vector<QNode*>& children = vnode->children();
+	ArenaVector<QNode*>& children = vnode->children();
 	logv << "- Expanding vnode " << vnode << endl;
 
 	if (use_GPU_ && !vnode->PassGPUThreshold())
@@ -1849,9 +1972,7 @@ void DESPOT::Expand(VNode* vnode, ScenarioLowerBound* lower_bound,
 	if (!use_GPU_ || !vnode->PassGPUThreshold())
 		Globals::Global_print_expand(this_thread::get_id(), vnode, vnode->depth(), vnode->edge());
 
-	for (ACT_TYPE action = 0; action < model->NumActions(); action++) {
-		children.push_back(NULL);
-	}
+	children.resize(model->NumActions(), NULL);
 
 	logv << "vnode level " << vnode->depth() << " " << vnode->legal_actions().size() << endl;
  
@@ -1862,9 +1983,9 @@ void DESPOT::Expand(VNode* vnode, ScenarioLowerBound* lower_bound,
 		QNode* qnode;
 
 		if (Globals::config.use_multi_thread_)
-			qnode = new Shared_QNode(static_cast<Shared_VNode*>(vnode), action);
+			qnode = NewNode(&s_qnode_pool_, static_cast<Shared_VNode*>(vnode), action);
 		else
-			qnode = new QNode(vnode, action);
+			qnode = NewNode(&qnode_pool_, vnode, action);
 
 		children[action] = qnode;
 	}
@@ -1892,6 +2013,9 @@ void DESPOT::Expand(VNode* vnode, ScenarioLowerBound* lower_bound,
 		HitCount++;
 	}
 
+	if (Globals::config.use_multi_thread_)
+		static_cast<Shared_VNode*>(vnode)->MarkExpanded();
+
 	logv << "* Expansion complete!" << endl;
 }
 
@@ -1927,49 +2051,84 @@ void DESPOT::Expand(QNode* qnode, ScenarioLowerBound* lb,
 
 	VNode* parent = qnode->parent();
 	streams.position(parent->depth());
-	map<OBS_TYPE, VNode*>& children = qnode->children();
+	FlatMap<OBS_TYPE, VNode*>& children = qnode->children();
 	auto totalstart = Time::now();
 
 	const vector<State*>& particles = parent->particles();
 
 	double step_reward = 0;
 
-	// Partition particles by observation
-	map<OBS_TYPE, vector<State*> > partitions;
-	OBS_TYPE obs;
-	double reward;
+	// Partition particles by observation, in a buffer reused across calls
+	static thread_local ObsPartition partitions;
 	auto start = Time::now();
 	int NumParticles = particles.size();
 
 	logv << "qnode "<< qnode << " has " << NumParticles << " particles" << endl;
 
-	for (int i = 0; i < NumParticles; i++) {
-
-		State* particle = particles[i];
-		logv << " Original: " << *particle  << endl;
-		State* copy = model->Copy(particle);
-		assert(copy != NULL);
-
-		logv << " Before step: " << *copy << endl;
-
-		EnableDebugInfo(qnode);
-
-		bool terminal = model->Step(*copy, streams.Entry(copy->scenario_id),
-		                            qnode->edge(), reward, obs);
+	vector<State*> copies(NumParticles);
+	vector<double> rewards(NumParticles);
+	vector<OBS_TYPE> obs_list(NumParticles);
+	vector<bool> terminals(NumParticles);
+
+	EnableDebugInfo(qnode);
+
+	// Step the particles of the node in chunks, on idle workers if any
+	int chunk_size = StepChunkSize(model, NumParticles);
+	int num_chunks = (NumParticles + chunk_size - 1) / chunk_size;
+	vector<StepChunk> chunks(num_chunks);
+	auto step_chunk = [&](int c) {
+		StepChunk& chunk = chunks[c];
+		int begin = c * chunk_size;
+		int end = min(begin + chunk_size, NumParticles);
+		chunk.copies.resize(end - begin);
+		chunk.rand_nums.resize(end - begin);
+		for (int i = begin; i < end; i++) {
+			logv << " Original: " << *particles[i]  << endl;
+			State* copy = model->Copy(particles[i]);
+			assert(copy != NULL);
+			chunk.copies[i - begin] = copy;
+			chunk.rand_nums[i - begin] = streams.Entry(copy->scenario_id);
+		}
+		model->StepBatch(chunk.copies, qnode->edge(), chunk.rand_nums,
+		                 chunk.rewards, chunk.obs_list, chunk.terminals);
+	};
+
+	if (num_chunks > 1) {
+		TaskGroup group(task_scheduler_, prior_ID);
+		for (int c = 1; c < num_chunks; c++)
+			group.Submit([&step_chunk, c](int worker) { step_chunk(c); });
+		step_chunk(0);
+		group.Wait();
+	} else if (num_chunks == 1)
+		step_chunk(0);
+
+	DisableDebugInfo();
+
+	// Merged serially: vector<bool> elements cannot be written concurrently
+	for (int c = 0; c < num_chunks; c++) {
+		const StepChunk& chunk = chunks[c];
+		int begin = c * chunk_size;
+		for (int i = 0; i < chunk.copies.size(); i++) {
+			copies[begin + i] = chunk.copies[i];
+			rewards[begin + i] = chunk.rewards[i];
+			obs_list[begin + i] = chunk.obs_list[i];
+			terminals[begin + i] = chunk.terminals[i];
+		}
+	}
 
-		DisableDebugInfo();
+	for (int i = 0; i < NumParticles; i++) {
+		State* copy = copies[i];
+		double reward = rewards[i];
 
 		step_reward += reward * copy->weight;
 
 		logv << " After step: " << *copy << " " << (reward * copy->weight)
 		     << " " << reward << " " << copy->weight << endl;
 
-		if (!terminal) {
-			partitions[obs].push_back(copy);
-		} else {
+		if (terminals[i])
 			model->Free(copy);
-		}
 	}
+	partitions.Build(copies, obs_list, terminals);
 
 	step_reward = Globals::Discount(parent->depth()) * step_reward
 	              - Globals::config.pruning_constant;	//pruning_constant is used for regularization
@@ -1988,15 +2147,16 @@ void DESPOT::Expand(QNode* qnode, ScenarioLowerBound* lb,
 
 	start = Time::now();
 	// Create new belief nodes
-	for (map<OBS_TYPE, vector<State*> >::iterator it = partitions.begin();
-	        it != partitions.end(); it++) {
-		OBS_TYPE obs = it->first;
+	children.reserve(partitions.size());
+	for (int g = 0; g < partitions.size(); g++) {
+		OBS_TYPE obs = partitions.obs(g);
 		logv << " Creating node for obs " << obs << endl;
 		vector<int> partition_ID;	//empty ID, no use for CPU codes
+		vector<State*>& partition = partitions.Group(g);
 		VNode* vnode;
 		if (Globals::config.use_multi_thread_)
 		{
-			vnode = new Shared_VNode(partitions[obs], partition_ID,
+			vnode = NewNode(&s_vnode_pool_, partition, partition_ID,
 			                         parent->depth() + 1, static_cast<Shared_QNode*>(qnode),
 			                         obs);
 			if (Globals::config.exploration_mode == UCT)
@@ -2005,7 +2165,7 @@ void DESPOT::Expand(QNode* qnode, ScenarioLowerBound* lb,
 			ComputeLegalActions(vnode, model);
 		}
 		else
-			vnode = new VNode(partitions[obs], partition_ID,
+			vnode = NewNode(&vnode_pool_, partition, partition_ID,
 			                  parent->depth() + 1, qnode, obs);
 
     logv << " New node created with " << vnode->legal_actions().size() <<" legal actions!" << endl;
@@ -2028,22 +2188,44 @@ void DESPOT::InitChildrenBounds(QNode* qnode, ScenarioLowerBound* lb,
 	double lower_bound = qnode->step_reward;
 	double upper_bound = qnode->step_reward;
 
-	auto children = qnode->children();
-	for (map<OBS_TYPE, VNode* >::iterator it = children.begin();
+	FlatMap<OBS_TYPE, VNode*>& children = qnode->children();
+
+	// The bounds of the children are independent: fan them out to idle
+	// workers, each task with its own stream position and history
+	bool fan_out = ParallelExpansion() && children.size() > 1;
+	auto start1 = Time::now();
+	if (fan_out) {
+		TaskGroup group(task_scheduler_, MapThread(this_thread::get_id()));
+		for (FlatMap<OBS_TYPE, VNode* >::iterator it = children.begin();
+			        it != children.end(); it++) {
+			OBS_TYPE obs = it->first;
+			VNode* vnode = it->second;
+			group.Submit([=, &streams, &history](int worker) {
+				RandomStreams child_streams(streams);
+				History child_history(history);
+				child_history.Add(qnode->edge(), obs);
+				InitBounds(vnode, lb, ub, child_streams, child_history, false);
+			});
+		}
+		group.Wait();
+	}
+
+	for (FlatMap<OBS_TYPE, VNode* >::iterator it = children.begin();
 		        it != children.end(); it++) {
 		OBS_TYPE obs = it->first;
-		VNode* vnode = children[obs];
-		auto start1 = Time::now();
+		VNode* vnode = it->second;
 
-		history.Add(qnode->edge(), obs);
+		if (!fan_out) {
+			history.Add(qnode->edge(), obs);
 
-		EnableDebugInfo(vnode, qnode);
+			EnableDebugInfo(vnode, qnode);
 
-		InitBounds(vnode, lb, ub, streams, history, false);
+			InitBounds(vnode, lb, ub, streams, history, false);
 
-		DisableDebugInfo();
+			DisableDebugInfo();
 
-		history.RemoveLast();
+			history.RemoveLast();
+		}
 
 		logv << " New node's bounds: (" << vnode->lower_bound() << ", "
 		     << vnode->upper_bound() << ")" << endl;
@@ -2069,8 +2251,8 @@ void DESPOT::InitChildrenBounds(QNode* qnode, ScenarioLowerBound* lb,
 
 		lower_bound += vnode->lower_bound();
 		upper_bound += vnode->upper_bound();
-		InitBoundTime += Globals::ElapsedTime(start1);
 	}
+	InitBoundTime += Globals::ElapsedTime(start1);
 
 	qnode->Weight();//just to initialize the weight
 
@@ -2105,7 +2287,7 @@ void DESPOT::InitChildrenUpperBounds(QNode* qnode, ScenarioUpperBound* ub,
 	logv << " New node's step_reward: " << qnode->step_reward << endl;
 
 	auto children = qnode->children();
-	for (map<OBS_TYPE, VNode* >::iterator it = children.begin();
+	for (FlatMap<OBS_TYPE, VNode* >::iterator it = children.begin();
 		        it != children.end(); it++) {
 		OBS_TYPE obs = it->first;
 		VNode* vnode = children[obs];
@@ -2148,7 +2330,7 @@ void DESPOT::InitChildrenLowerBounds(QNode* qnode, ScenarioLowerBound* lb,
 	double upper_bound = qnode->step_reward;
 
 	auto children = qnode->children();
-	for (map<OBS_TYPE, VNode* >::iterator it = children.begin();
+	for (FlatMap<OBS_TYPE, VNode* >::iterator it = children.begin();
 		        it != children.end(); it++) {
 		OBS_TYPE obs = it->first;
 		VNode* vnode = children[obs];
@@ -2286,7 +2468,7 @@ ValuedAction DESPOT::Evaluate(VNode* root, vector<State*>& particles,
 
 				if (cur != NULL && !cur->IsLeaf()) {
 					QNode* qnode = cur->Child(action);
-					map<OBS_TYPE, VNode*>& vnodes = qnode->children();
+					FlatMap<OBS_TYPE, VNode*>& vnodes = qnode->children();
 					cur = vnodes.find(obs) != vnodes.end() ? vnodes[obs] : NULL;
 				}
 			} else {
@@ -2327,6 +2509,9 @@ void DESPOT::BeliefUpdate(ACT_TYPE action, OBS_TYPE obs) {
 
 	belief_->Update(action, obs);
 	history_.Add(action, obs);
+
+	if (TreeReuseEnabled())
+		RetainSubtree(action, obs);
 	//lower_bound_->belief(belief_);
 
 	logi << "[Solver::Update] Updated belief, history and root with action "
@@ -2334,6 +2519,252 @@ void DESPOT::BeliefUpdate(ACT_TYPE action, OBS_TYPE obs) {
 	     << (get_time_second() - start) << "s" << endl;
 }
 
+bool DESPOT::TreeReuseEnabled() const {
+	// GPU particle buffers and replayed scenarios are rebuilt at every search
+	return Globals::config.reuse_tree && !use_GPU_ && FIX_SCENARIO == 0
+		&& !Debug_mode;
+}
+
+void DESPOT::RetainSubtree(ACT_TYPE action, OBS_TYPE obs) {
+  logv << __FUNCTION__ << endl;
+	RetainSubtrees(action, &obs);
+}
+
+void DESPOT::RetainSubtree(ACT_TYPE action) {
+  logv << __FUNCTION__ << endl;
+	RetainSubtrees(action, NULL);
+}
+
+void DESPOT::RetainSubtrees(ACT_TYPE action, const OBS_TYPE* obs) {
+	if (root_ == NULL || !TreeReuseEnabled())
+		return;
+
+	double start = get_time_second();
+
+	for (int k = 0; k < retained_roots_.size(); k++)
+		reclaimer_.Reclaim(retained_roots_[k], model_);
+	retained_roots_.clear();
+
+	// Subtrees keep the weights and values of the old root until one of them
+	// is chosen for the next search
+	if (action < root_->children().size() && root_->Child(action) != NULL) {
+		FlatMap<OBS_TYPE, VNode*>& children = root_->Child(action)->children();
+		for (FlatMap<OBS_TYPE, VNode*>::iterator it = children.begin();
+				it != children.end(); it++) {
+			if (it->second != NULL && (obs == NULL || it->first == *obs)) {
+				it->second->parent(NULL);
+				retained_roots_.push_back(it->second);
+			}
+		}
+		for (int k = 0; k < retained_roots_.size(); k++)
+			children.erase(retained_roots_[k]->edge());
+	}
+
+	logi << "[DESPOT::RetainSubtree] Retained " << retained_roots_.size()
+	     << " subtrees of action " << action;
+	if (obs != NULL)
+		logi << ", observation " << *obs;
+	logi << endl;
+
+	// The rest of the old tree is freed in the background
+	reclaimer_.Reclaim(root_, model_);
+	root_ = NULL;
+
+	logi << "[DESPOT::RetainSubtree] Time for promoting subtree: "
+	     << (get_time_second() - start) << "s" << endl;
+}
+
+int DESPOT::SelectRetainedSubtree(const vector<VNode*>& subtrees,
+		const vector<vector<double> >& likelihoods, double min_effective) {
+	int best = -1;
+	double best_weight = 0;
+	for (int k = 0; k < subtrees.size(); k++) {
+		const vector<State*>& particles = subtrees[k]->particles();
+		double weight = 0;
+		for (int i = 0; i < particles.size(); i++)
+			weight += particles[i]->weight * likelihoods[k][i];
+		if (weight > best_weight) {
+			best = k;
+			best_weight = weight;
+		}
+	}
+	if (best < 0)
+		return -1;
+
+	const vector<State*>& particles = subtrees[best]->particles();
+	double sum_sq = 0;
+	for (int i = 0; i < particles.size(); i++) {
+		double weight = particles[i]->weight * likelihoods[best][i] / best_weight;
+		sum_sq += weight * weight;
+	}
+	return 1.0 / sum_sq >= min_effective ? best : -1;
+}
+
+VNode* DESPOT::ResumeRetainedSubtree(const vector<State*>& belief_samples) {
+	double start = get_time_second();
+
+	vector<vector<double> > likelihoods(retained_roots_.size());
+	for (int k = 0; k < retained_roots_.size(); k++)
+		model_->BeliefLikelihoods(retained_roots_[k]->particles(),
+			belief_samples, likelihoods[k]);
+	int best = SelectRetainedSubtree(retained_roots_, likelihoods,
+		MIN_RETAINED_PARTICLES * Globals::config.num_scenarios);
+
+	VNode* subtree = NULL;
+	if (best >= 0) {
+		subtree = retained_roots_[best];
+		retained_roots_.erase(retained_roots_.begin() + best);
+
+		// Values in the tree are discounted to and weighted by the old root
+		double weight = State::Weight(subtree->particles());
+		RebaseSubtree(subtree, 1.0 / (Globals::Discount(1) * weight),
+			1.0 / weight);
+
+		// Scenarios the belief has made less likely count for less
+		const vector<State*>& particles = subtree->particles();
+		vector<double> scales(Globals::config.num_scenarios, 0.0);
+		for (int i = 0; i < particles.size(); i++)
+			scales[particles[i]->scenario_id] = likelihoods[best][i];
+		ReweightSubtree(subtree, scales);
+
+		logi << "[DESPOT::ResumeRetainedSubtree] Resuming the subtree of observation "
+		     << subtree->edge() << " with " << subtree->particles().size()
+		     << " particles" << endl;
+	} else {
+		logi << "[DESPOT::ResumeRetainedSubtree] The belief has moved away from all "
+		     << retained_roots_.size() << " retained subtrees" << endl;
+	}
+
+	for (int k = 0; k < retained_roots_.size(); k++)
+		reclaimer_.Reclaim(retained_roots_[k], model_);
+	retained_roots_.clear();
+
+	logi << "[DESPOT::ResumeRetainedSubtree] Time for matching subtrees: "
+	     << (get_time_second() - start) << "s" << endl;
+	return subtree;
+}
+
+int DESPOT::NumHeldParticles() {
+	reclaimer_.Wait();
+
+	int num = 0;
+	if (root_ != NULL)
+		num += root_->NumParticles();
+	for (int k = 0; k < retained_roots_.size(); k++)
+		num += retained_roots_[k]->NumParticles();
+	return num;
+}
+
+void DESPOT::RebaseSubtree(VNode* vnode, double value_scale, double weight_scale) {
+	vnode->depth(vnode->depth() - 1);
+	const vector<State*>& particles = vnode->particles();
+	for (int i = 0; i < particles.size(); i++)
+		particles[i]->weight *= weight_scale;
+	if (vnode->weight_ > 0)
+		vnode->weight_ *= weight_scale;
+
+	ValuedAction move = vnode->default_move();
+	move.value *= value_scale;
+	vnode->default_move(move);
+	vnode->lower_bound(vnode->lower_bound() * value_scale);
+	vnode->upper_bound(vnode->upper_bound() * value_scale);
+	vnode->utility_upper_bound(vnode->utility_upper_bound() * value_scale);
+
+	for (int a = 0; a < vnode->children().size(); a++) {
+		QNode* qnode = vnode->Child(a);
+		if (qnode == NULL)
+			continue;
+
+		qnode->lower_bound(qnode->lower_bound() * value_scale);
+		qnode->upper_bound(qnode->upper_bound() * value_scale);
+		qnode->utility_upper_bound(qnode->utility_upper_bound() * value_scale);
+		qnode->step_reward *= value_scale;
+		qnode->default_value *= value_scale;
+		if (qnode->weight_ > 0)
+			qnode->weight_ *= weight_scale;
+
+		FlatMap<OBS_TYPE, VNode*>& children = qnode->children();
+		for (FlatMap<OBS_TYPE, VNode*>::iterator it = children.begin();
+				it != children.end(); it++) {
+			if (it->second != NULL)
+				RebaseSubtree(it->second, value_scale, weight_scale);
+		}
+	}
+}
+
+void DESPOT::ReweightSubtree(VNode* root, const vector<double>& scales) {
+	const vector<State*>& particles = root->particles();
+	double weight = 0;
+	for (int i = 0; i < particles.size(); i++)
+		weight += particles[i]->weight * scales[particles[i]->scenario_id];
+
+	vector<double> normalized(scales.size());
+	for (int i = 0; i < scales.size(); i++)
+		normalized[i] = scales[i] / weight;
+	RescaleSubtree(root, normalized);
+}
+
+void DESPOT::RescaleSubtree(VNode* vnode, const vector<double>& scales) {
+	const vector<State*>& particles = vnode->particles();
+	double old_weight = State::Weight(particles);
+	for (int i = 0; i < particles.size(); i++)
+		particles[i]->weight *= scales[particles[i]->scenario_id];
+	double ratio = old_weight > 0 ? State::Weight(particles) / old_weight : 0;
+	if (vnode->weight_ > 0)
+		vnode->weight_ *= ratio;
+
+	ValuedAction move = vnode->default_move();
+	move.value *= ratio;
+	vnode->default_move(move);
+
+	if (vnode->IsLeaf()) {
+		vnode->lower_bound(vnode->lower_bound() * ratio);
+		vnode->upper_bound(vnode->upper_bound() * ratio);
+		vnode->utility_upper_bound(vnode->utility_upper_bound() * ratio);
+		return;
+	}
+
+	// Bounds only tighten in Update, so they are backed up here directly
+	double lower = move.value;
+	double upper = move.value;
+	double utility_upper = Globals::NEG_INFTY;
+	for (int a = 0; a < vnode->children().size(); a++) {
+		QNode* qnode = vnode->Child(a);
+		if (qnode == NULL)
+			continue;
+
+		qnode->step_reward *= ratio;
+		qnode->default_value *= ratio;
+		if (qnode->weight_ > 0)
+			qnode->weight_ *= ratio;
+
+		double q_lower = qnode->step_reward;
+		double q_upper = qnode->step_reward;
+		double q_utility_upper = qnode->step_reward
+		                         + Globals::config.pruning_constant;
+		FlatMap<OBS_TYPE, VNode*>& children = qnode->children();
+		for (FlatMap<OBS_TYPE, VNode*>::iterator it = children.begin();
+				it != children.end(); it++) {
+			if (it->second == NULL)
+				continue;
+			RescaleSubtree(it->second, scales);
+			q_lower += it->second->lower_bound();
+			q_upper += it->second->upper_bound();
+			q_utility_upper += it->second->utility_upper_bound();
+		}
+		qnode->lower_bound(q_lower);
+		qnode->upper_bound(q_upper);
+		qnode->utility_upper_bound(q_utility_upper);
+
+		lower = max(lower, q_lower);
+		upper = max(upper, q_upper);
+		utility_upper = max(utility_upper, q_utility_upper);
+	}
+	vnode->lower_bound(lower);
+	vnode->upper_bound(upper);
+	vnode->utility_upper_bound(utility_upper);
+}
+
 double DESPOT::AverageInitLower() const {
   logv << __FUNCTION__ << endl;
 	double sum = 0;
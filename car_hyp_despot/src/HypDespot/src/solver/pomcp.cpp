@@ -165,7 +165,7 @@ void POMCP::Update(int action, OBS_TYPE obs) {
 }
 
 int POMCP::UpperBoundAction(const VNode* vnode, double explore_constant) {
-	const vector<QNode*>& qnodes = vnode->children();
+	const ArenaVector<QNode*>& qnodes = vnode->children();
 	double best_ub = Globals::NEG_INFTY;
 	int best_action = -1;
 
@@ -197,7 +197,7 @@ int POMCP::UpperBoundAction(const VNode* vnode, double explore_constant) {
 }
 
 ValuedAction POMCP::OptimalAction(const VNode* vnode) {
-	const vector<QNode*>& qnodes = vnode->children();
+	const ArenaVector<QNode*>& qnodes = vnode->children();
 	ValuedAction astar(-1, Globals::NEG_INFTY);
 	for (int action = 0; action < qnodes.size(); action++) {
 		// cout << action << " " << qnodes[action]->value() << " " << qnodes[action]->count() << " " << vnode->count() << endl;
@@ -283,7 +283,7 @@ double POMCP::Simulate(State* particle, RandomStreams& streams, VNode* vnode,
 	if (!terminal) {
 		prior->Add(action, obs);
 		streams.Advance();
-		map<OBS_TYPE, VNode*>& vnodes = qnode->children();
+		FlatMap<OBS_TYPE, VNode*>& vnodes = qnode->children();
 		if (vnodes[obs] != NULL) {
 			reward += Globals::Discount()
 				* Simulate(particle, streams, vnodes[obs], model, prior);
@@ -321,7 +321,7 @@ double POMCP::Simulate(State* particle, VNode* vnode, const DSPOMDP* model,
 	QNode* qnode = vnode->Child(action);
 	if (!terminal) {
 		prior->Add(action, obs);
-		map<OBS_TYPE, VNode*>& vnodes = qnode->children();
+		FlatMap<OBS_TYPE, VNode*>& vnodes = qnode->children();
 		if (vnodes[obs] != NULL) {
 			reward += Globals::Discount()
 				* Simulate(particle, vnodes[obs], model, prior);
@@ -425,7 +425,7 @@ ValuedAction POMCP::Evaluate(VNode* root, vector<State*>& particles,
 
 				if (cur != NULL) {
 					QNode* qnode = cur->Child(action);
-					map<OBS_TYPE, VNode*>& vnodes = qnode->children();
+					FlatMap<OBS_TYPE, VNode*>& vnodes = qnode->children();
 					cur = vnodes.find(obs) != vnodes.end() ? vnodes[obs] : NULL;
 				}
 			} else {
@@ -279,7 +279,7 @@ double POMDPLite::Simulate(Ext_VNode* vnode, RandomStreams& streams, SolverPrior
 	/*Not bottom yet: choose action branch to proceed*/
 	ACT_TYPE action = OptimalAction(vnode, true).action;
 	Ext_QNode* qnode = static_cast<Ext_QNode*>(vnode->Child(action));
-	map<OBS_TYPE, VNode*>& vnodes = qnode->children();
+	FlatMap<OBS_TYPE, VNode*>& vnodes = qnode->children();
 	//logv << *vnode->observable_state() << endl;
 	//logv << "depth = " << vnode->depth() << "; action = " << action << "; " << endl;
 	logv << "[Traversal @Simulate] Traverse to q-node with action " << qnode->edge()
@@ -583,8 +583,8 @@ void POMDPLite::Update(Ext_QNode* qnode) {
 
 	int total_child_count=0;
 	double total_child_value=0;
-	map<OBS_TYPE, VNode*>& children = qnode->children();
-	for (map<OBS_TYPE, VNode*>::iterator it = children.begin();
+	FlatMap<OBS_TYPE, VNode*>& children = qnode->children();
+	for (FlatMap<OBS_TYPE, VNode*>::iterator it = children.begin();
 		it != children.end(); it++) {
 		VNode* vnode = it->second;
 
@@ -610,10 +610,10 @@ void POMDPLite::Update(Ext_QNode* qnode, double value) {
 	if(isDebug){
 			Update(qnode);
 			if(abs(qnode->value()-value)>1e-4){
-				map<OBS_TYPE, VNode*>& children = qnode->children();
+				FlatMap<OBS_TYPE, VNode*>& children = qnode->children();
 				cout<<  " details: "<< qnode<<" internal reward="<<qnode->internal_reward()
 						<<" #children="<<qnode->children().size()<<" - ";
-				for (map<OBS_TYPE, VNode*>::iterator it = children.begin();
+				for (FlatMap<OBS_TYPE, VNode*>::iterator it = children.begin();
 					it != children.end(); it++) {
 					VNode* vnode = it->second;
 					cout<< vnode->value()<<"("<<vnode->count()<<")"<<", ";
@@ -646,10 +646,10 @@ void POMDPLite::Update(Ext_QNode* qnode, double old_child_value, double new_chil
 
 		Update(qnode);
 		if(abs(qnode->value()-value)>1e-4){
-			map<OBS_TYPE, VNode*>& children = qnode->children();
+			FlatMap<OBS_TYPE, VNode*>& children = qnode->children();
 			cout<<  " details: "<< qnode<<" internal reward="<<qnode->internal_reward()
 					<<" #children="<<qnode->children().size()<<" - ";
-			for (map<OBS_TYPE, VNode*>::iterator it = children.begin();
+			for (FlatMap<OBS_TYPE, VNode*>::iterator it = children.begin();
 				it != children.end(); it++) {
 				VNode* vnode = it->second;
 				cout<< vnode->value()<<"("<<vnode->count()<<")"<<", ";
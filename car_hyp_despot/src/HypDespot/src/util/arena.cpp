@@ -0,0 +1,111 @@
+#include <despot/util/arena.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+
+using namespace std;
+
+namespace despot {
+
+/* =============================================================================
+ * Arena class
+ * =============================================================================*/
+
+namespace {
+
+// Epochs are unique across arenas, so a block cached for an arena that was
+// reset, or destroyed and replaced at the same address, is never reused
+atomic<long> next_epoch(1);
+
+struct Cursor {
+	const Arena* arena;
+	long epoch;
+	char* ptr;
+	char* end;
+};
+
+thread_local Cursor cursor = { NULL, 0, NULL, NULL };
+
+char* Align(char* p, size_t align) {
+	uintptr_t addr = reinterpret_cast<uintptr_t>(p);
+	return reinterpret_cast<char*>((addr + align - 1) & ~(uintptr_t) (align - 1));
+}
+
+} // namespace
+
+Arena::Arena(size_t block_size) :
+	block_size_(block_size),
+	epoch_(next_epoch++),
+	next_block_(0),
+	large_bytes_(0) {
+}
+
+Arena::~Arena() {
+	Reset();
+	for (size_t i = 0; i < blocks_.size(); i++)
+		free(blocks_[i]);
+}
+
+void* Arena::Allocate(size_t size, size_t align) {
+	// Requests that would waste much of a block get one of their own
+	if (size + align > block_size_ / 4) {
+		lock_guard<mutex> lck(mutex_);
+		char* block = NewBlock(size + align);
+		large_blocks_.push_back(block);
+		large_bytes_ += size + align;
+		return Align(block, align);
+	}
+
+	if (cursor.arena == this && cursor.epoch == epoch_) {
+		char* p = Align(cursor.ptr, align);
+		if (p + size <= cursor.end) {
+			cursor.ptr = p + size;
+			return p;
+		}
+	}
+
+	char* block;
+	{
+		lock_guard<mutex> lck(mutex_);
+		if (next_block_ == blocks_.size())
+			blocks_.push_back(NewBlock(block_size_));
+		block = blocks_[next_block_++];
+	}
+
+	cursor.arena = this;
+	cursor.epoch = epoch_;
+	char* p = Align(block, align);
+	cursor.ptr = p + size;
+	cursor.end = block + block_size_;
+	return p;
+}
+
+void Arena::Reset() {
+	lock_guard<mutex> lck(mutex_);
+	epoch_ = next_epoch++;
+	next_block_ = 0;
+	for (size_t i = 0; i < large_blocks_.size(); i++)
+		free(large_blocks_[i]);
+	large_blocks_.clear();
+	large_bytes_ = 0;
+}
+
+int Arena::num_used_blocks() const {
+	lock_guard<mutex> lck(mutex_);
+	return next_block_ + large_blocks_.size();
+}
+
+size_t Arena::capacity() const {
+	lock_guard<mutex> lck(mutex_);
+	return blocks_.size() * block_size_ + large_bytes_;
+}
+
+char* Arena::NewBlock(size_t size) {
+	char* block = static_cast<char*>(malloc(size));
+	if (block == NULL)
+		throw bad_alloc();
+	return block;
+}
+
+} // namespace despot
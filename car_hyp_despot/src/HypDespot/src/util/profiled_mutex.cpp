@@ -0,0 +1,59 @@
+#include <despot/util/profiled_mutex.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace std;
+
+namespace despot {
+
+/* =============================================================================
+ * ProfiledMutex class
+ * =============================================================================*/
+
+namespace {
+
+// Only contended acquisitions touch these, so they add no traffic to the
+// uncontended path
+atomic<long> num_waits(0);
+atomic<long> wait_ns(0);
+
+} // namespace
+
+void ProfiledMutex::LockSlow() {
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	mutex_.lock();
+	long ns = chrono::duration_cast<chrono::nanoseconds>(
+		chrono::steady_clock::now() - start).count();
+	num_waits.fetch_add(1, memory_order_relaxed);
+	wait_ns.fetch_add(ns, memory_order_relaxed);
+}
+
+void ProfiledMutex::LockHelping(const function<bool()>& help) {
+	long ns = 0;
+	do {
+		if (help())
+			continue;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		this_thread::yield();
+		ns += chrono::duration_cast<chrono::nanoseconds>(
+			chrono::steady_clock::now() - start).count();
+	} while (!mutex_.try_lock());
+	num_waits.fetch_add(1, memory_order_relaxed);
+	wait_ns.fetch_add(ns, memory_order_relaxed);
+}
+
+ProfiledMutex::Profile ProfiledMutex::Contention() {
+	Profile profile;
+	profile.num_waits = num_waits.load(memory_order_relaxed);
+	profile.wait_time = wait_ns.load(memory_order_relaxed) / 1e9;
+	return profile;
+}
+
+void ProfiledMutex::ResetContention() {
+	num_waits.store(0, memory_order_relaxed);
+	wait_ns.store(0, memory_order_relaxed);
+}
+
+} // namespace despot
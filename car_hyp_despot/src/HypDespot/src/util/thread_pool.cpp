@@ -0,0 +1,101 @@
+#include <despot/util/thread_pool.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+namespace despot {
+
+/* =============================================================================
+ * ThreadPool class
+ * =============================================================================*/
+
+ThreadPool::ThreadPool(bool pin_threads) :
+	pin_threads_(pin_threads),
+	num_jobs_(0),
+	generation_(0),
+	running_(0),
+	stop_(false) {
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		lock_guard<mutex> lck(mutex_);
+		stop_ = true;
+	}
+	start_cond_.notify_all();
+	for (size_t i = 0; i < threads_.size(); i++)
+		threads_[i].join();
+}
+
+void ThreadPool::Run(int num_jobs, const Job& job) {
+	unique_lock<mutex> lck(mutex_);
+	while ((int) threads_.size() < num_jobs) {
+		int worker = threads_.size();
+		threads_.push_back(thread(&ThreadPool::WorkerLoop, this, worker));
+		if (pin_threads_)
+			Pin(threads_.back(), worker);
+	}
+
+	job_ = job;
+	num_jobs_ = num_jobs;
+	running_ = num_jobs;
+	error_ = nullptr;
+	generation_++;
+	start_cond_.notify_all();
+
+	done_cond_.wait(lck, [this] { return running_ == 0; });
+	job_ = nullptr;
+
+	if (error_) {
+		exception_ptr error = error_;
+		error_ = nullptr;
+		rethrow_exception(error);
+	}
+}
+
+void ThreadPool::WorkerLoop(int worker) {
+	unique_lock<mutex> lck(mutex_);
+	// Run spawns workers while holding mutex_ and only releases it once it
+	// waits for the job it has just published, so a new worker first reads
+	// the generation of that job. Start one behind it to pick it up.
+	long seen = generation_ - 1;
+	for (;;) {
+		start_cond_.wait(lck, [this, &seen] { return stop_ || generation_ != seen; });
+		if (stop_)
+			break;
+		seen = generation_;
+		if (worker >= num_jobs_)
+			continue;
+
+		lck.unlock();
+		try {
+			job_(worker);
+		} catch (...) {
+			lock_guard<mutex> err_lck(mutex_);
+			if (!error_)
+				error_ = current_exception();
+		}
+		lck.lock();
+
+		if (--running_ == 0)
+			done_cond_.notify_all();
+	}
+}
+
+void ThreadPool::Pin(thread& t, int worker) {
+#ifdef __linux__
+	int num_cores = thread::hardware_concurrency();
+	if (num_cores <= 0)
+		return;
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(worker % num_cores, &cpus);
+	pthread_setaffinity_np(t.native_handle(), sizeof(cpu_set_t), &cpus);
+#endif
+}
+
+} // namespace despot
@@ -0,0 +1,180 @@
+#include <despot/util/work_stealing.h>
+
+#include <chrono>
+#include <thread>
+
+using namespace std;
+
+namespace despot {
+
+typedef chrono::high_resolution_clock Clock;
+
+static double Seconds(Clock::time_point start, Clock::time_point end) {
+	return chrono::duration<double>(end - start).count();
+}
+
+/* =============================================================================
+ * WorkStealingScheduler class
+ * =============================================================================*/
+
+WorkStealingScheduler::WorkStealingScheduler() :
+	outstanding_(0) {
+}
+
+void WorkStealingScheduler::Reset(int num_workers) {
+	workers_.resize(num_workers);
+	for (int i = 0; i < num_workers; i++) {
+		if (workers_[i] == NULL)
+			workers_[i].reset(new Worker());
+		Worker& w = *workers_[i];
+		w.trials.clear();
+		w.leaves.clear();
+		w.busy_time = 0;
+		w.idle_time = 0;
+		w.num_tasks = 0;
+		w.num_stolen = 0;
+	}
+	outstanding_ = 0;
+}
+
+void WorkStealingScheduler::Submit(int worker, const Task& task, TaskKind kind,
+		atomic<int>* pending) {
+	Entry entry;
+	entry.task = task;
+	entry.pending = pending;
+
+	outstanding_++;
+	Worker& w = *workers_[worker];
+	lock_guard<mutex> lck(w.mutex);
+	if (kind == TRIAL)
+		w.trials.push_back(entry);
+	else
+		w.leaves.push_back(entry);
+}
+
+bool WorkStealingScheduler::Pop(int worker, bool leaf_only, Entry& entry) {
+	Worker& w = *workers_[worker];
+	lock_guard<mutex> lck(w.mutex);
+	if (!w.leaves.empty()) {
+		entry = w.leaves.back();
+		w.leaves.pop_back();
+		return true;
+	}
+	if (!leaf_only && !w.trials.empty()) {
+		entry = w.trials.back();
+		w.trials.pop_back();
+		return true;
+	}
+	return false;
+}
+
+bool WorkStealingScheduler::Steal(int worker, bool leaf_only, Entry& entry) {
+	int n = workers_.size();
+	// Leaf tasks first: they unblock the trials waiting for them
+	for (int pass = 0; pass < (leaf_only ? 1 : 2); pass++) {
+		for (int k = 1; k < n; k++) {
+			Worker& victim = *workers_[(worker + k) % n];
+			lock_guard<mutex> lck(victim.mutex);
+			deque<Entry>& tasks = (pass == 0) ? victim.leaves : victim.trials;
+			if (!tasks.empty()) {
+				entry = tasks.front();
+				tasks.pop_front();
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+bool WorkStealingScheduler::RunOne(int worker, bool leaf_only) {
+	Entry entry;
+	bool stolen = false;
+	if (!Pop(worker, leaf_only, entry)) {
+		if (!Steal(worker, leaf_only, entry))
+			return false;
+		stolen = true;
+	}
+
+	// The task counts as done even if it throws, so that Run and
+	// TaskGroup::Wait do not wait for it forever
+	struct Done {
+		atomic<int>* pending;
+		atomic<int>& outstanding;
+
+		~Done() {
+			if (pending != NULL)
+				(*pending)--;
+			outstanding--;
+		}
+	} done = { entry.pending, outstanding_ };
+
+	Worker& w = *workers_[worker];
+	// Time accounted by tasks run while this one waits is not counted twice
+	double accounted = w.busy_time + w.idle_time;
+	Clock::time_point start = Clock::now();
+	entry.task(worker);
+	double nested = w.busy_time + w.idle_time - accounted;
+	w.busy_time += Seconds(start, Clock::now()) - nested;
+	w.num_tasks++;
+	if (stolen)
+		w.num_stolen++;
+	return true;
+}
+
+void WorkStealingScheduler::Run(int worker) {
+	Clock::time_point idle_start = Clock::now();
+	for (;;) {
+		if (RunOne(worker)) {
+			idle_start = Clock::now();
+			continue;
+		}
+		if (outstanding_ == 0)
+			break;
+		this_thread::yield();
+		AddIdleTime(worker, Seconds(idle_start, Clock::now()));
+		idle_start = Clock::now();
+	}
+	AddIdleTime(worker, Seconds(idle_start, Clock::now()));
+}
+
+void WorkStealingScheduler::AddIdleTime(int worker, double time) {
+	workers_[worker]->idle_time += time;
+}
+
+void WorkStealingScheduler::PrintUtilization(ostream& out) const {
+	for (size_t i = 0; i < workers_.size(); i++) {
+		const Worker& w = *workers_[i];
+		double total = w.busy_time + w.idle_time;
+		out << "worker " << i << ": tasks=" << w.num_tasks
+			<< ", stolen=" << w.num_stolen
+			<< ", busy=" << w.busy_time << "s"
+			<< ", idle=" << w.idle_time << "s";
+		if (total > 0)
+			out << " (" << 100.0 * w.busy_time / total << "% utilized)";
+		out << endl;
+	}
+}
+
+ostream& operator<<(ostream& os, const WorkStealingScheduler& scheduler) {
+	scheduler.PrintUtilization(os);
+	return os;
+}
+
+/* =============================================================================
+ * TaskGroup class
+ * =============================================================================*/
+
+void TaskGroup::Wait() {
+	Clock::time_point idle_start = Clock::now();
+	while (pending_ > 0) {
+		if (scheduler_.RunOne(worker_, true)) {
+			idle_start = Clock::now();
+			continue;
+		}
+		this_thread::yield();
+		scheduler_.AddIdleTime(worker_, Seconds(idle_start, Clock::now()));
+		idle_start = Clock::now();
+	}
+}
+
+} // namespace despot
@@ -39,7 +39,7 @@
 #include <limits>
 
 namespace RVO {
-	Agent::Agent(RVOSimulator *sim) : maxNeighbors_(0), maxSpeed_(0.0f), neighborDist_(0.0f), radius_(0.0f), sim_(sim), timeHorizon_(0.0f), timeHorizonObst_(0.0f), id_(0), frozen(false)
+	Agent::Agent(RVOSimulator *sim) : maxNeighbors_(0), maxSpeed_(0.0f), neighborDist_(0.0f), radius_(0.0f), sim_(sim), timeHorizon_(0.0f), timeHorizonObst_(0.0f), id_(0), frozen(false), scenario_(0)
 	{
 		agent_behavior_type_ = Gamma;
 		use_polygon_ = true;
@@ -48,6 +48,38 @@ namespace RVO {
 		use_dynamic_att_ = true;
 	}
 
+	void Agent::reset()
+	{
+		agentNeighbors_.clear();
+		obstacleNeighbors_.clear();
+		orcaLines_.clear();
+		bounding_corners_.clear();
+		velocity_convex_.clear();
+		tag_.clear();
+
+		maxNeighbors_ = 0;
+		maxSpeed_ = 0.0f;
+		neighborDist_ = 0.0f;
+		radius_ = 0.0f;
+		timeHorizon_ = 0.0f;
+		timeHorizonObst_ = 0.0f;
+		id_ = 0;
+		frozen = false;
+		scenario_ = 0;
+
+		newVelocity_ = Vector2();
+		position_ = Vector2();
+		prefVelocity_ = Vector2();
+		velocity_ = Vector2();
+		heading_ = Vector2();
+
+		agent_behavior_type_ = Gamma;
+		use_polygon_ = true;
+		consider_kinematics_ = true;
+		use_dynamic_resp_ = true;
+		use_dynamic_att_ = true;
+	}
+
 	void Agent::computeNeighbors()
 	{
 		obstacleNeighbors_.clear();
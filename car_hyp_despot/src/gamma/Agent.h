@@ -90,6 +90,13 @@ namespace RVO {
 		 */
 		void update();
 
+		/**
+		 * \brief      Restores the state of a newly constructed agent, keeping
+		 *             the capacity of its neighbor, ORCA-line and polygon
+		 *             buffers for reuse.
+		 */
+		void reset();
+
 
 		void computeObstacleOrcaLinesDisc ();
 		void computeObstacleOrcaLinesPoly ();
@@ -146,6 +153,7 @@ namespace RVO {
 
 
 		bool frozen; // agent position is frozen
+		size_t scenario_; // agents only see neighbors of the same scenario
 
 		friend class KdTree;
 		friend class RVOSimulator;
@@ -57,11 +57,37 @@ namespace RVO {
 			for (size_t i = agents_.size(); i < sim_->agents_.size(); ++i) {
 				agents_.push_back(sim_->agents_[i]);
 			}
+		}
+
+		const std::vector<size_t> &starts = sim_->scenarioStarts_;
+		if (starts.size() <= 1) {
+			scenarioRoots_.clear();
 			agentTree_.resize(2 * agents_.size() - 1);
+			if (!agents_.empty()) {
+				buildAgentTreeRecursive(0, agents_.size(), 0);
+			}
+			return;
 		}
 
-		if (!agents_.empty()) {
-			buildAgentTreeRecursive(0, agents_.size(), 0);
+		// One tree per scenario, stored one after another in agentTree_
+		size_t numNodes = 0;
+		for (size_t s = 0; s < starts.size(); ++s) {
+			const size_t end = (s + 1 < starts.size() ? starts[s + 1] : agents_.size());
+			if (end > starts[s]) {
+				numNodes += 2 * (end - starts[s]) - 1;
+			}
+		}
+		agentTree_.resize(numNodes);
+		scenarioRoots_.resize(starts.size());
+
+		size_t root = 0;
+		for (size_t s = 0; s < starts.size(); ++s) {
+			const size_t end = (s + 1 < starts.size() ? starts[s + 1] : agents_.size());
+			scenarioRoots_[s] = root;
+			if (end > starts[s]) {
+				buildAgentTreeRecursive(starts[s], end, root);
+				root += 2 * (end - starts[s]) - 1;
+			}
 		}
 	}
 
@@ -252,7 +278,8 @@ namespace RVO {
 
 	void KdTree::computeAgentNeighbors(Agent *agent, float &rangeSq) const
 	{
-		queryAgentTreeRecursive(agent, rangeSq, 0);
+		queryAgentTreeRecursive(agent, rangeSq,
+			scenarioRoots_.empty() ? 0 : scenarioRoots_[agent->scenario_]);
 	}
 
 	void KdTree::computeObstacleNeighbors(Agent *agent, float rangeSq) const
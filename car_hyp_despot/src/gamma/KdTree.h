@@ -192,6 +192,7 @@ namespace RVO {
 
 		std::vector<Agent *> agents_;
 		std::vector<AgentTreeNode> agentTree_;
+		std::vector<size_t> scenarioRoots_; // root node of each scenario's tree
 		ObstacleTreeNode *obstacleTree_;
 		RVOSimulator *sim_;
 
@@ -74,6 +74,10 @@ namespace RVO {
 			delete agents_[i];
 		}
 
+		for (size_t i = 0; i < spareAgents_.size(); ++i) {
+			delete spareAgents_[i];
+		}
+
 		for (size_t i = 0; i < obstacles_.size(); ++i) {
 			delete obstacles_[i];
 		}
@@ -91,9 +95,50 @@ namespace RVO {
 			}
 		}
 		agents_.clear();
+
+		for (size_t i = 0; i < spareAgents_.size(); i++)
+			delete spareAgents_[i];
+		spareAgents_.clear();
+		scenarioStarts_.clear();
+
+		kdTree_->clearAllAgents();
+	}
+
+	void RVOSimulator::resetAgents()
+	{
+		// Stacked in reverse so that createAgent pops them in the old order
+		for (size_t i = agents_.size(); i > 0; i--)
+			spareAgents_.push_back(agents_[i - 1]);
+		agents_.clear();
+		scenarioStarts_.clear();
 		kdTree_->clearAllAgents();
 	}
 
+	size_t RVOSimulator::addScenario()
+	{
+		// Agents added before the first scenario form a scenario of their own
+		if (scenarioStarts_.empty() && !agents_.empty())
+			scenarioStarts_.push_back(0);
+		scenarioStarts_.push_back(agents_.size());
+		return agents_.size();
+	}
+
+	Agent *RVOSimulator::createAgent()
+	{
+		Agent *agent;
+		if (spareAgents_.empty())
+			agent = new Agent(this);
+		else {
+			agent = spareAgents_.back();
+			spareAgents_.pop_back();
+			agent->reset();
+		}
+
+		if (!scenarioStarts_.empty())
+			agent->scenario_ = scenarioStarts_.size() - 1;
+		return agent;
+	}
+
 
 	size_t RVOSimulator::addAgent(const Vector2 &position)
 	{
@@ -101,7 +146,7 @@ namespace RVO {
 			return RVO_ERROR;
 		}
 
-		Agent *agent = new Agent(this);
+		Agent *agent = createAgent();
 
 		agent->position_ = position;
 		agent->maxNeighbors_ = defaultAgent_->maxNeighbors_;
@@ -125,7 +170,7 @@ namespace RVO {
 
 	size_t RVOSimulator::addAgent(const Vector2 &position, float neighborDist, size_t maxNeighbors, float timeHorizon, float timeHorizonObst, float radius, float maxSpeed, const Vector2 &velocity)
 	{
-		Agent *agent = new Agent(this);
+		Agent *agent = createAgent();
 
 		agent->position_ = position;
 		agent->maxNeighbors_ = maxNeighbors;
@@ -150,7 +195,7 @@ namespace RVO {
 
 	size_t RVOSimulator::addAgent(const Vector2 &position, float neighborDist, size_t maxNeighbors, float timeHorizon, float timeHorizonObst, float radius, float maxSpeed, const Vector2 &velocity, std::string tag, float max_tracking_angle)
 	{
-		Agent *agent = new Agent(this);
+		Agent *agent = createAgent();
 
 		agent->position_ = position;
 		agent->maxNeighbors_ = maxNeighbors;
@@ -178,7 +223,7 @@ namespace RVO {
 
 	size_t RVOSimulator::addAgent(const Vector2 &position, float neighborDist, size_t maxNeighbors, float timeHorizon, float timeHorizonObst, float radius, float maxSpeed, const Vector2 &velocity, std::string tag, float max_tracking_angle, int tracking_id)
 	{
-		Agent *agent = new Agent(this);
+		Agent *agent = createAgent();
 
 		agent->position_ = position;
 		agent->maxNeighbors_ = maxNeighbors;
@@ -208,7 +253,7 @@ namespace RVO {
 
 	size_t RVOSimulator::addAgent(const AgentParams agt, int tracking_id, bool frozen_agent)
 	{
-		Agent *agent = new Agent(this);
+		Agent *agent = createAgent();
 
 		agent->position_ = agt.position;
 		agent->maxNeighbors_ = static_cast<size_t> (agt.maxNeighbors);
@@ -291,7 +336,7 @@ namespace RVO {
 	{
 		return agents_[static_cast<size_t>(agentNo)]->heading_;
 	}
-	void RVOSimulator::setAgentBoundingBoxCorners(int agentNo, std::vector<Vector2> corners)
+	void RVOSimulator::setAgentBoundingBoxCorners(int agentNo, const std::vector<Vector2> &corners)
 	{
 		agents_[static_cast<size_t>(agentNo)]->bounding_corners_ = corners;
 	}
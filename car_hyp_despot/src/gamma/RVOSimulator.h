@@ -229,7 +229,7 @@ namespace RVO {
 
 		Vector2 getAgentHeading(int agentNo);
 	
-		void setAgentBoundingBoxCorners(int agentNo, std::vector<Vector2> corners);
+		void setAgentBoundingBoxCorners(int agentNo, const std::vector<Vector2> &corners);
 
 		void setAgentHeading(int agentNo, Vector2 heading);
 
@@ -642,8 +642,28 @@ namespace RVO {
 
 		void clearAllAgents();
 
+		/**
+		 * \brief      Removes all agents but keeps them for reuse, so that
+		 *             adding the same number of agents again allocates no
+		 *             memory. Agents come back in the order they were added.
+		 */
+		void resetAgents();
+
+		/**
+		 * \brief      Starts a new scenario. Agents added afterwards only
+		 *             take agents of the same scenario as neighbors, so one
+		 *             doStep advances several independent scenes as if each
+		 *             had its own simulator.
+		 * \return     The number of the first agent of the scenario.
+		 */
+		size_t addScenario();
+
 	private:
+		Agent *createAgent();
+
 		std::vector<Agent *> agents_;
+		std::vector<Agent *> spareAgents_;
+		std::vector<size_t> scenarioStarts_;
 		Agent *defaultAgent_;
 		float globalTime_;
 		KdTree *kdTree_;
@@ -1,6 +1,8 @@
 #include <iostream>
 #include "param.h"
 #include "coord.h"
+#include "collision.h"
+#include <algorithm>
 #include <vector>
 
 using namespace std;
@@ -199,3 +201,124 @@ bool InCollision(std::vector<COORD> rect_1, std::vector<COORD> rect_2) {
 	return false;
 }
 
+/**
+ * Separating-axis test of two boxes given by their centers, unit heading
+ * vectors, half lengths and half widths. t is the vector between the centers.
+ */
+static inline bool OverlapCentered(double tx, double ty,
+		double a_dir_x, double a_dir_y, double a_len, double a_wid,
+		double b_dir_x, double b_dir_y, double b_len, double b_wid) {
+	double c = fabs(a_dir_x * b_dir_x + a_dir_y * b_dir_y);
+	double s = fabs(a_dir_x * b_dir_y - a_dir_y * b_dir_x);
+	double ta_u = fabs(tx * a_dir_x + ty * a_dir_y);
+	double ta_v = fabs(ty * a_dir_x - tx * a_dir_y);
+	double tb_u = fabs(tx * b_dir_x + ty * b_dir_y);
+	double tb_v = fabs(ty * b_dir_x - tx * b_dir_y);
+	return (ta_u <= a_len + b_len * c + b_wid * s)
+			& (ta_v <= a_wid + b_len * s + b_wid * c)
+			& (tb_u <= b_len + a_len * c + a_wid * s)
+			& (tb_v <= b_wid + a_len * s + a_wid * c);
+}
+
+bool InCollisionOBB(double ax, double ay, double a_dir_x, double a_dir_y,
+		double a_front, double a_back, double a_side,
+		double bx, double by, double b_dir_x, double b_dir_y,
+		double b_front, double b_back, double b_side) {
+	// move the reference points to the box centers
+	double a_shift = (a_front - a_back) / 2, b_shift = (b_front - b_back) / 2;
+	double tx = (bx + b_dir_x * b_shift) - (ax + a_dir_x * a_shift);
+	double ty = (by + b_dir_y * b_shift) - (ay + a_dir_y * a_shift);
+	return OverlapCentered(tx, ty, a_dir_x, a_dir_y, (a_front + a_back) / 2,
+			a_side, b_dir_x, b_dir_y, (b_front + b_back) / 2, b_side);
+}
+
+/**
+ * Whether the bearing of a point from the car is within the in-front cone,
+ * i.e. along / dist > cos_limit, without taking the square root of dist2.
+ */
+static inline bool InFrontCone(double along, double dist2, double cos_limit) {
+	if (cos_limit >= 0)
+		return along > 0 && along * along > cos_limit * cos_limit * dist2;
+	return along >= 0 || along * along < cos_limit * cos_limit * dist2;
+}
+
+int FirstAgentInCollision(double car_x, double car_y, double car_heading,
+		const AgentBoxes& agents, int flag, bool check_in_front,
+		double in_front_cos, int begin) {
+	const double ux = cos(car_heading), uy = sin(car_heading);
+	const double car_len = ModelParams::CAR_FRONT;
+	const double car_wid = ModelParams::CAR_WIDTH / 2.0;
+
+	// zone of the car tested against vehicle boxes, and the margins added to
+	// vehicle boxes when testing them against the plain car box
+	double zone_front = car_len, zone_back = car_len, zone_side = car_wid;
+	double margin_front = 0, margin_back = 0, margin_side = 0;
+	// zone of the car tested against pedestrian points
+	double ped_front = car_len + PED_SIZE, ped_back = car_len + PED_SIZE,
+			ped_side = car_wid + PED_SIZE;
+	if (flag == 0) {
+		margin_front = CAR_FRONT_MARGIN;
+		margin_back = CAR_SIDE_MARGIN;
+		margin_side = CAR_SIDE_MARGIN;
+		zone_front += margin_front;
+		zone_back += margin_back;
+		zone_side += margin_side;
+		ped_front += CAR_FRONT_MARGIN;
+		ped_back += CAR_SIDE_MARGIN;
+		ped_side += CAR_SIDE_MARGIN;
+	}
+	const double zone_shift = (zone_front - zone_back) / 2;
+	const double zone_len = (zone_front + zone_back) / 2;
+	const double margin_shift = (margin_front - margin_back) / 2;
+	const double margin_len = (margin_front + margin_back) / 2;
+	const bool test_zones = (flag == 0);
+
+	// vehicles farther than the sum of the radii of the car's zone and the
+	// vehicle's zone around their reference points cannot touch the car
+	const double car_reach = sqrt(max(zone_front, zone_back) * max(zone_front,
+			zone_back) + zone_side * zone_side);
+	const double margin_reach = max(margin_front, margin_back) + margin_side;
+
+	const int n = agents.num;
+	const double* x = agents.x.data();
+	const double* y = agents.y.data();
+	const double* dir_x = agents.dir_x.data();
+	const double* dir_y = agents.dir_y.data();
+	const double* extent_x = agents.extent_x.data();
+	const double* extent_y = agents.extent_y.data();
+	const char* is_vehicle = agents.is_vehicle.data();
+
+	for (int i = begin; i < n; i++) {
+		double dx = x[i] - car_x, dy = y[i] - car_y;
+		double along = dx * ux + dy * uy;
+		if (check_in_front && !InFrontCone(along, dx * dx + dy * dy, in_front_cos))
+			continue;
+
+		if (!is_vehicle[i]) {
+			double side = dy * ux - dx * uy;
+			if (((along >= 0) ? (along <= ped_front) : (-along <= ped_back))
+					&& fabs(side) <= ped_side)
+				return i;
+			continue;
+		}
+
+		// extent_x + extent_y bounds the radius of the vehicle's box
+		double reach = car_reach + extent_x[i] + extent_y[i] + margin_reach;
+		if (dx * dx + dy * dy > reach * reach)
+			continue;
+
+		// car zone against the vehicle box
+		if (OverlapCentered(dx - ux * zone_shift, dy - uy * zone_shift,
+				ux, uy, zone_len, zone_side,
+				dir_x[i], dir_y[i], extent_y[i], extent_x[i]))
+			return i;
+		// car box against the vehicle zone
+		if (test_zones && OverlapCentered(
+				dx + dir_x[i] * margin_shift, dy + dir_y[i] * margin_shift,
+				ux, uy, car_len, car_wid,
+				dir_x[i], dir_y[i], extent_y[i] + margin_len,
+				extent_x[i] + margin_side))
+			return i;
+	}
+	return -1;
+}
@@ -0,0 +1,62 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <vector>
+
+/**
+ * Agents of a state laid out as columns for the batched collision check.
+ * Heading vectors are copied from the vectors the agents cache with their
+ * heading, so gathering needs no trigonometry.
+ */
+struct AgentBoxes {
+	int num;
+	std::vector<double> x, y;
+	std::vector<double> dir_x, dir_y; // unit heading vector
+	std::vector<double> extent_x, extent_y; // half width / half length
+	std::vector<char> is_vehicle;
+
+	AgentBoxes() : num(0) {}
+
+	void Resize(int n) {
+		num = n;
+		x.resize(n);
+		y.resize(n);
+		dir_x.resize(n);
+		dir_y.resize(n);
+		extent_x.resize(n);
+		extent_y.resize(n);
+		is_vehicle.resize(n);
+	}
+};
+
+/**
+ * Separating-axis test between two oriented boxes. Each box is given by a
+ * reference point, a unit heading vector and its reach to the front, back
+ * and sides of the reference point. Touching boxes are in collision.
+ */
+bool InCollisionOBB(double ax, double ay, double a_dir_x, double a_dir_y,
+		double a_front, double a_back, double a_side,
+		double bx, double by, double b_dir_x, double b_dir_y,
+		double b_front, double b_back, double b_side);
+
+/**
+ * Checks the ego car against the agents from index begin on, in one pass
+ * over the columns.
+ *
+ * Pedestrians are tested as points against the car's safety zone expanded by
+ * PED_SIZE, as in InCollision (flag 0) and InRealCollision (flag 1).
+ * Vehicles are tested as boxes against the car with the margins of
+ * inCarlaCollision: in search (flag 0) the car's zone is tested against the
+ * vehicle's box and the car's box against the vehicle's zone; in real
+ * collision checks (flag 1) the two plain boxes are tested.
+ *
+ * Agents not in front of the car (cos of the bearing <= in_front_cos) are
+ * skipped unless check_in_front is false.
+ *
+ * Returns the index of the first agent in collision, or -1.
+ */
+int FirstAgentInCollision(double car_x, double car_y, double car_heading,
+		const AgentBoxes& agents, int flag, bool check_in_front,
+		double in_front_cos, int begin = 0);
+
+#endif
@@ -3,6 +3,7 @@
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <atomic>
 #include <limits>
 #include <map>
 #include <unordered_map>
@@ -16,6 +17,7 @@
 #include <interface/world.h>
 #include <solver/despot.h>
 #include <util/seeds.h>
+#include <util/hash.h>
 #include <despot/util/logging.h>
 
 #include <GammaParams.h>
@@ -35,9 +37,83 @@ using namespace despot;
 double path_look_ahead = 5.0;
 
 
-static std::map<uint64_t, std::vector<int>> Obs_hash_table;
 static PomdpState hashed_state;
 
+/*
+ * Debug-only record of the quantized vector behind each observation, filled
+ * by StateToIndex at DEBUG log level. Open addressing over a fixed number of
+ * slots: a slot is claimed with a CAS on its key and published with a release
+ * store, so recording never locks or allocates. Observations arriving after
+ * the table fills up are not recorded.
+ */
+class ObsDebugTable {
+public:
+	static const int Capacity = 1 << 14;
+	static const int MaxProbes = 64;
+
+	ObsDebugTable() :
+		slots_(new Slot[Capacity]) {
+	}
+
+	~ObsDebugTable() {
+		delete[] slots_;
+	}
+
+	void Record(uint64_t obs, const int* obs_vec, int size) {
+		if (obs == 0)
+			return;
+		for (int k = 0; k < MaxProbes; k++) {
+			Slot& slot = slots_[(obs + k) & (Capacity - 1)];
+			uint64_t key = 0;
+			if (slot.key.compare_exchange_strong(key, obs)) {
+				slot.size = size;
+				std::copy(obs_vec, obs_vec + size, slot.obs_vec);
+				slot.ready.store(true, std::memory_order_release);
+				return;
+			}
+			if (key == obs)
+				return;
+		}
+	}
+
+	bool Lookup(uint64_t obs, std::vector<int>& obs_vec) const {
+		for (int k = 0; k < MaxProbes; k++) {
+			const Slot& slot = slots_[(obs + k) & (Capacity - 1)];
+			uint64_t key = slot.key.load(std::memory_order_acquire);
+			if (key == 0)
+				return false;
+			if (key == obs) {
+				if (!slot.ready.load(std::memory_order_acquire))
+					return false;
+				obs_vec.assign(slot.obs_vec, slot.obs_vec + slot.size);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	static ObsDebugTable& Instance() {
+		static ObsDebugTable table;
+		return table;
+	}
+
+private:
+	struct Slot {
+		std::atomic<uint64_t> key;
+		std::atomic<bool> ready;
+		int size;
+		int obs_vec[ContextPomdp::MAX_OBS_SIZE];
+
+		Slot() :
+			key(0),
+			ready(false),
+			size(0) {
+		}
+	};
+
+	Slot* slots_;
+};
+
 class ContextPomdpParticleLowerBound: public ParticleLowerBound {
 private:
 	const ContextPomdp *context_pomdp_;
@@ -113,6 +189,11 @@ public:
 			History &history) const {
 		return context_pomdp_->world_model.DefaultPolicy(particles);
 	}
+
+protected:
+	bool HistoryIndependent() const {
+		return true;
+	}
 };
 
 class ContextPomdpSmartParticleUpperBound: public ParticleUpperBound {
@@ -131,7 +212,8 @@ public:
 	}
 };
 
-ContextPomdp::ContextPomdp() : world_model(SimulatorBase::world_model),
+ContextPomdp::ContextPomdp() : memory_pool_(true),
+		world_model(SimulatorBase::world_model),
 		random_(Random((unsigned) Seeds::Next())) {
 	InitGammaSetting();
 }
@@ -177,11 +259,8 @@ void ContextPomdp::InitGammaSetting() {
 	}
 }
 
-const std::vector<int> &ContextPomdp::ObserveVector(const State &state_) const {
+int ContextPomdp::ObserveVector(const State &state_, int *obs_vec) const {
 	const PomdpState &state = static_cast<const PomdpState &>(state_);
-	static std::vector<int> obs_vec;
-
-	obs_vec.resize(state.num * 2 + 3);
 
 	int i = 0;
 	obs_vec[i++] = int(state.car.pos.x / ModelParams::POS_RLN);
@@ -194,12 +273,53 @@ const std::vector<int> &ContextPomdp::ObserveVector(const State &state_) const {
 		obs_vec[i++] = int(state.agents[j].pos.y / ModelParams::POS_RLN);
 	}
 
-	return obs_vec;
+	return i;
 }
 
 uint64_t ContextPomdp::Observe(const State &state) const {
-	hash<std::vector<int>> myhash;
-	return myhash(ObserveVector(state));
+	int obs_vec[MAX_OBS_SIZE];
+	int size = ObserveVector(state, obs_vec);
+
+	FNVHash hash;
+	hash.Add(obs_vec, size);
+	return hash.value();
+}
+
+/*
+ * Observations of all active particles in the batch. Quantizes the position
+ * columns in one pass and then hashes them in the order of ObserveVector, so
+ * that the result equals Observe() of each particle.
+ */
+void ContextPomdp::ObserveBatch(const PomdpStateBatch &batch,
+		std::vector<OBS_TYPE> &obs) const {
+	static thread_local std::vector<int> cell_x, cell_y;
+
+	int n_agents = batch.agent_x.size();
+	cell_x.resize(n_agents);
+	cell_y.resize(n_agents);
+	const double *agent_x = batch.agent_x.data();
+	const double *agent_y = batch.agent_y.data();
+	for (int k = 0; k < n_agents; k++) {
+		cell_x[k] = int(agent_x[k] / ModelParams::POS_RLN);
+		cell_y[k] = int(agent_y[k] / ModelParams::POS_RLN);
+	}
+
+	for (int i = 0; i < batch.size; i++) {
+		if (!batch.active[i])
+			continue;
+
+		FNVHash hash;
+		hash.Add(int(batch.car_x[i] / ModelParams::POS_RLN));
+		hash.Add(int(batch.car_y[i] / ModelParams::POS_RLN));
+		hash.Add(int((batch.car_vel[i] + 1e-5) / ModelParams::VEL_RLN));
+
+		int base = i * ModelParams::N_PED_IN;
+		for (int j = 0; j < batch.num[i]; j++) {
+			hash.Add(cell_x[base + j]);
+			hash.Add(cell_y[base + j]);
+		}
+		obs[i] = hash.value();
+	}
 }
 
 std::vector<State *> ContextPomdp::ConstructParticles(
@@ -306,9 +426,6 @@ bool ContextPomdp::Step(State &state_, double rNum, int action, double &reward,
 	PomdpState &state = static_cast<PomdpState &>(state_);
 	reward = 0.0;
 
-	////// NOTE: Using true random number to make results in different qnodes different ////
-	rNum = Random::RANDOM.NextDouble();
-
 	if (FIX_SCENARIO == 1 || DESPOT::Print_nodes) {
 		if (CPUDoPrint && state_.scenario_id == CPUPrintPID) {
 			printf("(CPU) Before step: scenario%d \n", state_.scenario_id);
@@ -358,31 +475,29 @@ bool ContextPomdp::Step(State &state_, double rNum, int action, double &reward,
 	reward += MovementPenalty(state, steering);
 
 	// State transition
-	if (Globals::config.use_multi_thread_) {
-		QuickRandom::SetSeed(INIT_QUICKRANDSEED,
-				Globals::MapThread(this_thread::get_id()));
-	} else
-		QuickRandom::SetSeed(INIT_QUICKRANDSEED, 0);
+	// Noise differs between actions, and between agents, of the same scenario
+	// at the same depth, without touching any shared generator
+	CounterRandom random(rNum, state_.scenario_id, action);
 
 	logv << "[ContextPomdp::" << __FUNCTION__ << "] Refract action" << endl;
 	double acc = GetAcceleration(action);
 
 	world_model.RobStep(state.car, steering, rNum);
-	world_model.RobVelStep(state.car, acc, rNum);
+	world_model.RobVelStep(state.car, acc, random);
 
 	state.time_stamp = state.time_stamp + 1.0 / ModelParams::CONTROL_FREQ;
 
 	if (use_gamma_in_search) {
 		// Attentive pedestrians
-		world_model.GammaAgentStep(state.agents, rNum, state.num, state.car);
+		world_model.GammaAgentStep(state.agents, random, state.num, state.car);
 		for (int i = 0; i < state.num; i++) {
 			//Distracted pedestrians
 			if (state.agents[i].mode == AGENT_DIS)
-				world_model.AgentStep(state.agents[i], rNum);
+				world_model.AgentStep(state.agents[i], random);
 		}
 	} else {
 		for (int i = 0; i < state.num; i++) {
-			world_model.AgentStep(state.agents[i], rNum);
+			world_model.AgentStep(state.agents[i], random);
 			if(isnan(state.agents[i].pos.x))
 				ERR("state.agents[i].pos.x is NAN");
 		}
@@ -414,6 +529,119 @@ bool ContextPomdp::Step(State &state_, double rNum, int action, double &reward,
 	return false;
 }
 
+void ContextPomdp::StepBatch(const std::vector<State *> &particles,
+		ACT_TYPE action, const std::vector<double> &random_nums,
+		std::vector<double> &rewards, std::vector<OBS_TYPE> &obs,
+		std::vector<bool> &terminals) const {
+	if (FIX_SCENARIO == 1 || DESPOT::Print_nodes) {
+		// Keep the per-particle debugging output of Step
+		DSPOMDP::StepBatch(particles, action, random_nums, rewards, obs,
+				terminals);
+		return;
+	}
+
+	static thread_local PomdpStateBatch batch;
+
+	batch.Gather(particles);
+	int num = batch.size;
+	rewards.assign(num, 0.0);
+	obs.assign(num, 0);
+	terminals.assign(num, false);
+
+	for (int i = 0; i < num; i++) {
+		const PomdpState &state = *batch.states[i];
+		// Terminate upon reaching goal
+		if (world_model.IsGlobalGoal(state.car)) {
+			rewards[i] = ModelParams::GOAL_REWARD;
+			ERR("");
+		}
+
+		// Safety control: collision; Terminate upon collision
+		int col_agent = 0;
+		if (state.car.vel > 0.001 && world_model.InCollision(state, col_agent)) {
+			rewards[i] = CrashPenalty(state);
+			terminals[i] = true;
+			batch.active[i] = false;
+		}
+	}
+
+	// Smoothness control and speed control
+	double action_penalty = ActionPenalty(GetAccelerationID(action));
+	const double *car_vel = batch.car_vel.data();
+	for (int i = 0; i < num; i++) {
+		if (batch.active[i])
+			rewards[i] = action_penalty + ModelParams::REWARD_FACTOR_VEL
+					* (car_vel[i] - ModelParams::VEL_MAX) / ModelParams::VEL_MAX;
+	}
+
+	StepBatch(batch, action, random_nums);
+
+	// Observation
+	ObserveBatch(batch, obs);
+}
+
+/*
+ * State transition of the active particles in the batch. The ego-car pose is
+ * advanced on the car columns for all particles together; velocity noise and
+ * agents are then stepped per particle with the same counter-based random
+ * numbers as Step. Car and agent columns are refreshed afterwards.
+ */
+void ContextPomdp::StepBatch(PomdpStateBatch &batch, ACT_TYPE action,
+		const std::vector<double> &rNums) const {
+	double steering = GetSteering(action);
+	double acc = GetAcceleration(action);
+
+	world_model.RobStepBatch(batch, steering);
+
+	// Car velocities first, then agents: the GAMMA step of all particles runs
+	// in between as a single simulation.
+	static thread_local std::vector<int> gamma_ids;
+
+	for (int i = 0; i < batch.size; i++) {
+		if (!batch.active[i])
+			continue;
+
+		PomdpState &state = *batch.states[i];
+		CounterRandom random(rNums[i], state.scenario_id, action);
+
+		batch.ScatterCar(i);
+		world_model.RobVelStep(state.car, acc, random);
+		batch.car_vel[i] = state.car.vel;
+
+		state.time_stamp = state.time_stamp + 1.0 / ModelParams::CONTROL_FREQ;
+	}
+
+	if (use_gamma_in_search)
+		world_model.GammaSimulateAgentsBatch(batch, gamma_ids);
+
+	for (int i = 0; i < batch.size; i++) {
+		if (!batch.active[i])
+			continue;
+
+		PomdpState &state = *batch.states[i];
+		CounterRandom random(rNums[i], state.scenario_id, action);
+
+		if (use_gamma_in_search) {
+			// Attentive pedestrians
+			world_model.ApplyGammaStep(state.agents, random, state.num,
+					gamma_ids[i]);
+			for (int j = 0; j < state.num; j++) {
+				//Distracted pedestrians
+				if (state.agents[j].mode == AGENT_DIS)
+					world_model.AgentStep(state.agents[j], random);
+			}
+		} else {
+			for (int j = 0; j < state.num; j++) {
+				world_model.AgentStep(state.agents[j], random);
+				if(isnan(state.agents[j].pos.x))
+					ERR("state.agents[j].pos.x is NAN");
+			}
+		}
+
+		batch.GatherAgents(i);
+	}
+}
+
 bool ContextPomdp::Step(PomdpStateWorld &state, double rNum, int action,
 		double &reward, uint64_t &obs) const {
 
@@ -466,37 +694,119 @@ void ContextPomdp::ForwardAndVisualize(const State *sample, int step) const {
 
 	for (int i = 0; i < step; i++) {
 		// forward
-		next_state = PredictAgents(next_state);
+		PredictAgentsInPlace(*next_state, Random::RANDOM.NextDouble());
 
 		// print
 		PrintStateCar(*next_state, string_sprintf("predicted_car_%d", i));
 		PrintStateAgents(*next_state, string_sprintf("predicted_agents_%d", i));
 	}
+	Free(next_state);
 }
 
 PomdpState* ContextPomdp::PredictAgents(const PomdpState *ped_state, int acc) const {
 	PomdpState* predicted_state = static_cast<PomdpState*>(Copy(ped_state));
+	PredictAgentsInPlace(*predicted_state, Random::RANDOM.NextDouble(), acc);
+	return predicted_state;
+}
 
-	double steer_to_path = world_model.GetSteerToPath(
-			predicted_state->car);
+void ContextPomdp::PredictAgentsInPlace(PomdpState& state, double rNum, int acc) const {
+	double steer_to_path = world_model.GetSteerToPath(state.car);
 	ACT_TYPE action = GetActionID(GetSteerIDfromSteering(steer_to_path), acc);
 
 	OBS_TYPE dummy_obs;
 	double dummy_reward;
 
-	double rNum = Random::RANDOM.NextDouble();
-	bool terminal = Step(*predicted_state, rNum, action, dummy_reward, dummy_obs);
+	bool terminal = Step(state, rNum, action, dummy_reward, dummy_obs);
 
 	if (terminal)
 		logi << "[PredictAgents] Reach terminal state" << endl;
-
-	return predicted_state;
 }
 
 double ContextPomdp::ObsProb(uint64_t obs, const State &s, int action) const {
 	return obs == Observe(s);
 }
 
+/*
+ * Agents are matched by id. A particle is likely if its car is where the
+ * samples put it, and each of its agents has an intention and mode the
+ * samples give the agent, near where they predict the agent under it.
+ * Agents of the samples that the particle does not have count against it
+ * by how often the samples have them.
+ */
+void ContextPomdp::BeliefLikelihoods(const vector<State*>& particles,
+		const vector<State*>& belief_samples, vector<double>& likelihoods) const {
+	struct HiddenState {
+		HiddenState() : count(0), pos_sum(0, 0) {}
+		int count;
+		COORD pos_sum;
+	};
+	struct AgentBelief {
+		AgentBelief() : count(0) {}
+		int count;
+		map<pair<int, int>, HiddenState> hidden; // by intention and mode
+	};
+
+	int num_samples = belief_samples.size();
+	COORD car_pos(0, 0);
+	double car_vel = 0;
+	map<int, AgentBelief> agents;
+	for (int j = 0; j < num_samples; j++) {
+		const PomdpState* sample = static_cast<const PomdpState*>(belief_samples[j]);
+		car_pos += sample->car.pos;
+		car_vel += sample->car.vel;
+		for (int k = 0; k < sample->num; k++) {
+			const AgentStruct& agent = sample->agents[k];
+			AgentBelief& belief = agents[agent.id];
+			belief.count++;
+			HiddenState& hidden = belief.hidden[make_pair(agent.intention, agent.mode)];
+			hidden.count++;
+			hidden.pos_sum += agent.pos;
+		}
+	}
+	car_pos = car_pos * (1.0 / num_samples);
+	car_vel /= num_samples;
+
+	// Differences within the resolution of the observations are not
+	// told apart by the search either
+	double pos_var2 = 2 * ModelParams::POS_RLN * ModelParams::POS_RLN;
+	double vel_var2 = 2 * ModelParams::VEL_RLN * ModelParams::VEL_RLN;
+
+	likelihoods.resize(particles.size());
+	for (int i = 0; i < particles.size(); i++) {
+		const PomdpState* state = static_cast<const PomdpState*>(particles[i]);
+		double log_likelihood = -(state->car.pos - car_pos).LengthSq() / pos_var2
+			- (state->car.vel - car_vel) * (state->car.vel - car_vel) / vel_var2;
+
+		for (int k = 0; k < state->num; k++) {
+			const AgentStruct& agent = state->agents[k];
+			map<int, AgentBelief>::iterator it = agents.find(agent.id);
+			if (it == agents.end())
+				continue; // no longer tracked
+
+			map<pair<int, int>, HiddenState>::iterator hidden =
+				it->second.hidden.find(make_pair(agent.intention, agent.mode));
+			if (hidden == it->second.hidden.end()) {
+				log_likelihood = -numeric_limits<double>::infinity();
+				break;
+			}
+			COORD mean_pos = hidden->second.pos_sum * (1.0 / hidden->second.count);
+			log_likelihood += log((double) hidden->second.count / it->second.count)
+				- (agent.pos - mean_pos).LengthSq() / pos_var2;
+		}
+
+		for (map<int, AgentBelief>::iterator it = agents.begin();
+				it != agents.end(); it++) {
+			bool found = false;
+			for (int k = 0; k < state->num && !found; k++)
+				found = (state->agents[k].id == it->first);
+			if (!found)
+				log_likelihood += log(1.0 - (double) it->second.count / num_samples);
+		}
+
+		likelihoods[i] = exp(log_likelihood);
+	}
+}
+
 Belief *ContextPomdp::InitialBelief(const State *state, string type) const {
 
 	//Uniform initial distribution
@@ -760,7 +1070,16 @@ void ContextPomdp::PrintWorldState(const PomdpStateWorld &state,
 }
 
 void ContextPomdp::PrintObs(const State &state, uint64_t obs, ostream &out) const {
-	out << obs << endl;
+	out << obs;
+	std::vector<int> obs_vec;
+	if (logging::level() >= logging::DEBUG
+			&& ObsDebugTable::Instance().Lookup(obs, obs_vec)) {
+		out << " (";
+		for (int i = 0; i < obs_vec.size(); i++)
+			out << (i > 0 ? " " : "") << obs_vec[i];
+		out << ")";
+	}
+	out << endl;
 }
 
 void ContextPomdp::PrintAction(int action, ostream &out) const {
@@ -985,10 +1304,14 @@ bool ContextPomdp::ValidateState(const PomdpState &state, const char *msg) const
 }
 
 OBS_TYPE ContextPomdp::StateToIndex(const State *state) const {
-	std::hash<std::vector<int>> myhash;
-	std::vector<int> obs_vec = ObserveVector(*state);
-	OBS_TYPE obs = myhash(obs_vec);
-	Obs_hash_table[obs] = obs_vec;
+	int obs_vec[MAX_OBS_SIZE];
+	int size = ObserveVector(*state, obs_vec);
+
+	FNVHash hash;
+	hash.Add(obs_vec, size);
+	OBS_TYPE obs = hash.value();
+	if (logging::level() >= logging::DEBUG)
+		ObsDebugTable::Instance().Record(obs, obs_vec, size);
 
 	if (obs <= (OBS_TYPE) 140737351976300) {
 		cout << "empty obs: " << obs << endl;
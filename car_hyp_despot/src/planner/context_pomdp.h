@@ -49,6 +49,9 @@ public:
 	}
 	PomdpState* GreateStartState(string type) const;
 	double ObsProb(uint64_t z, const State& s, int action) const;
+	void BeliefLikelihoods(const std::vector<State*>& particles,
+		const std::vector<State*>& belief_samples,
+		std::vector<double>& likelihoods) const;
 	inline int NumActions() const { return (int)(2*ModelParams::NUM_ACC+1) * (ModelParams::NUM_STEER_ANGLE*2 +1); }
 	Belief* InitialBelief(const State* start, string type) const;
 	ValuedAction GetBestAction() const;
@@ -73,6 +76,11 @@ public:
 	bool Step(State& state_, double rNum, int action, double& reward, uint64_t& obs) const;
 	bool Step(PomdpStateWorld& state, double rNum, int action, double& reward, uint64_t& obs) const;
 
+	void StepBatch(const std::vector<State*>& particles, ACT_TYPE action,
+			const std::vector<double>& random_nums, std::vector<double>& rewards,
+			std::vector<OBS_TYPE>& obs, std::vector<bool>& terminals) const;
+	void StepBatch(PomdpStateBatch& batch, ACT_TYPE action, const std::vector<double>& rNums) const;
+
 public:
 	void UpdateVel(int& vel, int action, Random& random) const;
 	void RobStep(int &robY,int &rob_vel, int action, Random& random) const;
@@ -88,7 +96,10 @@ public:
     double MovementPenalty(const PomdpStateWorld& state, float) const;
 
  	uint64_t Observe(const State& ) const;
-	const std::vector<int>& ObserveVector(const State& )   const;
+	/// Quantized car and agent fields behind an observation; returns the size
+	static const int MAX_OBS_SIZE = ModelParams::N_PED_IN * 2 + 3;
+	int ObserveVector(const State& state, int* obs_vec) const;
+	void ObserveBatch(const PomdpStateBatch& batch, std::vector<OBS_TYPE>& obs) const;
 
 	void Statistics(const std::vector<PomdpState*> particles) const;
 	void PrintState(const State& s, ostream& out = cout) const;
@@ -122,6 +133,8 @@ public:
 
 	void ForwardAndVisualize(const State* sample, int step) const;
 	PomdpState* PredictAgents(const PomdpState* ped_state, int acc=2) const;
+	/* Step the state one step ahead, following the path with the given acceleration */
+	void PredictAgentsInPlace(PomdpState& state, double rNum, int acc=2) const;
 
 	void CheckPreCollision(const State*);
 
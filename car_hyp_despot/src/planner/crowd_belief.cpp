@@ -22,226 +22,409 @@
 
 
 int use_att_mode = 2;		// onlu use att mode
-vector<State*> particles_;
+
+// Particles filled by one job of CrowdBelief::Sample
+const int SAMPLE_CHUNK_SIZE = 64;
 
 HiddenStateBelief::HiddenStateBelief(int num_intentions, int num_modes) {
 	Resize(num_intentions, num_modes);
 }
 
 void HiddenStateBelief::Reset() {
-	for (std::vector<double>& intention_probs: probs_) {
-		std::fill(intention_probs.begin(), intention_probs.end(),
-				1.0/intention_probs.size()/probs_.size());
-	}
+	double log_prob = -log(double(num_intentions_ * num_modes_));
+	for (int mode = 0; mode < num_modes_; mode++)
+		std::fill(log_probs_[mode], log_probs_[mode] + num_intentions_, log_prob);
+	dirty_ = true;
 }
 
 void HiddenStateBelief::Resize(int new_intentions) {
-	int mode_size = probs_.size();
-	Resize(new_intentions, mode_size);
+	Resize(new_intentions, num_modes_);
 }
 
 void HiddenStateBelief::Resize(int new_intentions, int new_modes) {
-	probs_.resize(new_modes);
-	for (std::vector<double>& intention_probs: probs_) {
-		intention_probs.resize(new_intentions);
-		std::fill(intention_probs.begin(), intention_probs.end(), 1.0/new_intentions/new_modes);
-	}
+	if (new_intentions > MAX_INTENTIONS || new_modes > MAX_MODES)
+		ERR(string_sprintf("Hidden state belief holds at most %d intentions "
+				"and %d modes, got %d and %d", MAX_INTENTIONS, MAX_MODES,
+				new_intentions, new_modes));
+	num_intentions_ = new_intentions;
+	num_modes_ = new_modes;
+	Reset();
 }
 
-double gaussian_prob(double x, double stddev) {
-	double a = 1.0 / stddev / sqrt(2 * M_PI);
-	double b = -x * x / 2.0 / (stddev * stddev);
-	return a * exp(b);
+/*
+ * Log transition likelihood of hypotheses [begin, end): a Gaussian on the
+ * angle between the observed and the predicted move times a Gaussian on the
+ * difference of their lengths, each floored at K. Straight-line code over
+ * contiguous arrays, so the compiler can vectorize it.
+ */
+void TransitionLogLikelihoods(TransitionBatch& batch, int begin, int end) {
+	const double K = 0.001;
+	const double angle_stddev = ModelParams::NOISE_GOAL_ANGLE;
+	const double dist_stddev = ModelParams::NOISE_PED_VEL / ModelParams::CONTROL_FREQ;
+	const double angle_a = 1.0 / angle_stddev / sqrt(2 * M_PI);
+	const double angle_b = -0.5 / (angle_stddev * angle_stddev);
+	const double dist_a = 1.0 / dist_stddev / sqrt(2 * M_PI);
+	const double dist_b = -0.5 / (dist_stddev * dist_stddev);
+
+	const double* move_x = batch.move_x.data();
+	const double* move_y = batch.move_y.data();
+	const double* pred_x = batch.pred_x.data();
+	const double* pred_y = batch.pred_y.data();
+	double* out = batch.log_likelihoods.data();
+
+	for (int i = begin; i < end; i++) {
+		double move_dist = sqrt(move_x[i] * move_x[i] + move_y[i] * move_y[i]);
+		double goal_dist = sqrt(pred_x[i] * pred_x[i] + pred_y[i] * pred_y[i]);
+
+		double norms = move_dist * goal_dist;
+		double cosa = (move_x[i] * pred_x[i] + move_y[i] * pred_y[i])
+				/ (norms > 0 ? norms : 1.0);
+		cosa = std::max(-1.0, std::min(1.0, cosa));
+		double angle_error = norms > 0 ? acos(cosa) : 0.0;
+		double dist_error = move_dist - goal_dist;
+
+		out[i] = log(angle_a * exp(angle_b * angle_error * angle_error) + K)
+				+ log(dist_a * exp(dist_b * dist_error * dist_error) + K);
+	}
 }
 
-double TransitionLikelihood(const COORD& past_pos, const COORD& cur_pos, const COORD& pred_pos) {
-	const double K = 0.001;
+void HiddenStateBelief::Update(const double* log_likelihoods) {
+	for (int mode = 0; mode < num_modes_; mode++) {
+		for (int intention = 0; intention < num_intentions_; intention++)
+			log_probs_[mode][intention] += log_likelihoods[intention];
+	}
+	dirty_ = true;
+}
 
-	double goal_dist = (pred_pos - past_pos).Length();
-	double move_dist = (cur_pos - past_pos).Length();
+/*
+ * Normalize the log-probabilities, which keeps them from drifting towards
+ * -inf over many updates, and rebuild the CDFs. No-op if nothing changed
+ * since the last call.
+ */
+void HiddenStateBelief::Normalize() {
+	if (!dirty_)
+		return;
 
-	double angle_error = COORD::Angle(past_pos, cur_pos, pred_pos, 0.0);
-	double angle_prob = gaussian_prob(angle_error,
-			ModelParams::NOISE_GOAL_ANGLE) + K;
+	double max_log_prob = -std::numeric_limits<double>::infinity();
+	for (int mode = 0; mode < num_modes_; mode++)
+		for (int intention = 0; intention < num_intentions_; intention++)
+			max_log_prob = std::max(max_log_prob, log_probs_[mode][intention]);
 
-	double dist_error = move_dist - goal_dist;
-	double dist_prob = gaussian_prob(dist_error,
-			ModelParams::NOISE_PED_VEL / ModelParams::CONTROL_FREQ) + K;
+	double total_prob = 0;
+	for (int mode = 0; mode < num_modes_; mode++)
+		for (int intention = 0; intention < num_intentions_; intention++)
+			total_prob += exp(log_probs_[mode][intention] - max_log_prob);
 
-	if (isnan(angle_prob) || isnan(dist_prob))
-		ERR("Get transition likelihood as NAN");
+	if (!(total_prob > 0) || std::isinf(max_log_prob))
+		ERR("total_prob == 0");
 
-	return angle_prob * dist_prob;
+	double log_total = max_log_prob + log(total_prob);
+	double joint = 0;
+	for (int mode = 0; mode < num_modes_; mode++) {
+		double* log_probs = log_probs_[mode];
+		double mode_total = 0;
+		for (int intention = 0; intention < num_intentions_; intention++) {
+			log_probs[intention] -= log_total;
+			double prob = exp(log_probs[intention]);
+			joint += prob;
+			mode_total += prob;
+			joint_cdf_[mode * num_intentions_ + intention] = joint;
+			mode_cdf_[mode][intention] = mode_total;
+		}
+		for (int intention = 0; intention < num_intentions_; intention++)
+			mode_cdf_[mode][intention] /= mode_total;
+	}
+	dirty_ = false;
 }
 
-void HiddenStateBelief::Update(WorldModel& model, AgentStruct& past_agent, const AgentStruct& cur_agent,
-		int intention_id, int mode_id) {
+void HiddenStateBelief::Sample(Random& random, int& intention_id, int& mode_id) {
+	Normalize();
+
+	// Pick the first entry whose cumulative probability reaches r, with a
+	// tolerance of 0.001 for rounding
+	double r = random.NextDouble() - 0.001;
+
+	if (use_att_mode == 0) {
+		const double* cdf = joint_cdf_;
+		const double* end = cdf + num_modes_ * num_intentions_;
+		const double* it = std::lower_bound(cdf, end, r);
+		if (it == end)
+			ERR("Sampling belief failed");
+		mode_id = (it - cdf) / num_intentions_;
+		intention_id = (it - cdf) % num_intentions_;
+	} else {
+		int mode = (use_att_mode <= 1) ? AGENT_DIS : AGENT_ATT;
+		const double* cdf = mode_cdf_[mode];
+		const double* it = std::lower_bound(cdf, cdf + num_intentions_, r);
+		if (it == cdf + num_intentions_)
+			ERR("Sampling belief failed");
+		mode_id = mode;
+		intention_id = it - cdf;
+	}
+}
 
-	AgentStruct predicted_agent = past_agent;
-	if (past_agent.type == AGENT_ATT)
-		model.GammaAgentStep(predicted_agent, intention_id);
+void AgentBelief::Reset(int new_intentions) {
+	if (new_intentions != belief_.size(1))
+		belief_.Resize(new_intentions);
 	else
+		belief_.Reset();
+}
+
+void AgentBelief::Sample(Random& random, int& intention, int& mode) {
+	belief_.Sample(random, intention, mode);
+}
+
+void AgentBelief::Predict(WorldModel& model, std::vector<COORD>& positions) const {
+	// The prediction does not depend on the mode, and only the GAMMA step
+	// depends on the intention
+	int num_intentions = belief_.size(1);
+	positions.resize(num_intentions);
+	if (observable_.type == AGENT_ATT) {
+		for (int intention = 0; intention < num_intentions; intention++) {
+			AgentStruct predicted_agent = observable_;
+			model.GammaAgentStep(predicted_agent, intention);
+			positions[intention] = predicted_agent.pos;
+		}
+	} else {
+		AgentStruct predicted_agent = observable_;
 		model.AgentStepPath(predicted_agent);
+		std::fill(positions.begin(), positions.end(), predicted_agent.pos);
+	}
+}
 
-	double likelihood = TransitionLikelihood(past_agent.pos, cur_agent.pos, predicted_agent.pos);
+void AgentBelief::Update(const AgentStruct& cur_agent, const double* log_likelihoods) {
+	belief_.Update(log_likelihoods);
+	observable_ = cur_agent;
+	time_stamp = Globals::ElapsedTime();
+}
 
-	probs_[mode_id][intention_id] = likelihood * probs_[mode_id][intention_id];
+AgentBeliefTable::AgentBeliefTable() :
+		buckets_(64, -1) {
 }
 
-void HiddenStateBelief::Normalize() {
-	double total_prob = 0;
-	for (auto& intention_probs: probs_) {
-		total_prob += std::accumulate(intention_probs.begin(), intention_probs.end(), 0.0);
-	}
+AgentBeliefTable::AgentBeliefTable(const AgentBeliefTable& other) :
+		slots_(other.slots_),
+		free_slots_(other.free_slots_),
+		buckets_(other.buckets_),
+		order_(other.order_) {
+	for (Slot& slot: slots_)
+		if (slot.belief != NULL)
+			slot.belief = new AgentBelief(*slot.belief);
+	for (auto it = order_.begin(); it != order_.end(); ++it)
+		slots_[*it].order = it;
+}
 
-	if(total_prob == 0)
-		ERR("total_prob == 0");
+AgentBeliefTable& AgentBeliefTable::operator=(AgentBeliefTable other) {
+	swap(other);
+	return *this;
+}
 
-	for (auto& intention_probs: probs_) {
-		std::transform(intention_probs.begin(), intention_probs.end(), intention_probs.begin(),
-		               std::bind(std::multiplies<double>(), std::placeholders::_1, 1.0/total_prob));
-	}
+void AgentBeliefTable::swap(AgentBeliefTable& other) {
+	// Swapping lists keeps their iterators valid
+	slots_.swap(other.slots_);
+	free_slots_.swap(other.free_slots_);
+	buckets_.swap(other.buckets_);
+	order_.swap(other.order_);
 }
 
-void HiddenStateBelief::Sample(int& intention_id, int& mode_id) {
-	this->Normalize();
+AgentBeliefTable::~AgentBeliefTable() {
+	for (Slot& slot: slots_)
+		delete slot.belief;
+}
 
-	double r = Random::RANDOM.NextDouble();
+int AgentBeliefTable::Find(int id) const {
+	for (size_t b = Home(id);; b = (b + 1) & (buckets_.size() - 1)) {
+		int slot = buckets_[b];
+		if (slot == -1)
+			return -1;
+		if (slots_[slot].id == id)
+			return slot;
+	}
+}
 
-	if (use_att_mode == 0) {
-		for (int mode = 0; mode < probs_.size(); mode++) {
-			auto& goal_probs = probs_[mode];
-			for (int intention = 0; intention < goal_probs.size(); intention++) {
-				r -= probs_[mode][intention];
-				if (r <= 0.001) {
-					intention_id = intention;
-					mode_id = mode;
-					break;
-				}
-			}
-			if (r <= 0.001)
-				break;
-		}
+int AgentBeliefTable::Insert(int id, int num_intentions, int num_modes) {
+	if (2 * (order_.size() + 1) > buckets_.size())
+		Grow();
+
+	int slot;
+	if (free_slots_.empty()) {
+		slot = slots_.size();
+		slots_.push_back(Slot());
 	} else {
-		int mode = (use_att_mode <= 1) ? AGENT_DIS : AGENT_ATT;
-		auto& goal_probs = probs_[mode];
-		double total_prob = std::accumulate(goal_probs.begin(), goal_probs.end(), 0.0);
-		for (int intention = 0; intention < goal_probs.size(); intention++) {
-			r -= probs_[mode][intention] / total_prob;
-			if (r <= 0.001) {
-				intention_id = intention;
-				mode_id = mode;
-				break;
-			}
-		}
+		slot = free_slots_.back();
+		free_slots_.pop_back();
 	}
-
-	if (r > 0.001)
-		ERR("Sampling belief failed");
+	slots_[slot].id = id;
+	slots_[slot].belief = new AgentBelief(num_intentions, num_modes);
+	slots_[slot].order = order_.insert(order_.end(), slot);
+
+	size_t b = Home(id);
+	while (buckets_[b] != -1)
+		b = (b + 1) & (buckets_.size() - 1);
+	buckets_[b] = slot;
+	return slot;
 }
 
-void AgentBelief::Reset(int new_intentions) {
-	if (new_intentions != belief_->size(1))
-		belief_->Resize(new_intentions);
-	else
-		belief_->Reset();
+void AgentBeliefTable::Touch(int slot) {
+	order_.splice(order_.end(), order_, slots_[slot].order);
 }
 
-void AgentBelief::Sample(int& intention, int& mode) const {
-	belief_->Sample(intention, mode);
+void AgentBeliefTable::EvictOutDated(double cur_time_stamp) {
+	while (!order_.empty()) {
+		Slot& slot = slots_[order_.front()];
+		if (!slot.belief->OutDated(cur_time_stamp))
+			break;
+		logd << "[AgentBeliefTable::EvictOutDated] " << "cur time_stamp = " << cur_time_stamp
+				<< ", belief time_stamp="<< slot.belief->time_stamp << endl;
+
+		EraseBucket(slot.id);
+		delete slot.belief;
+		slot.belief = NULL;
+		free_slots_.push_back(order_.front());
+		order_.pop_front();
+	}
 }
 
-void AgentBelief::Update(WorldModel& model, const AgentStruct& cur_agent, int num_intentions) {
-	if (num_intentions != belief_->size(1))
-		belief_->Resize(num_intentions);
+void AgentBeliefTable::Grow() {
+	std::vector<int> buckets(buckets_.size() * 2, -1);
+	buckets_.swap(buckets);
+	for (int slot: buckets) {
+		if (slot == -1)
+			continue;
+		size_t b = Home(slots_[slot].id);
+		while (buckets_[b] != -1)
+			b = (b + 1) & (buckets_.size() - 1);
+		buckets_[b] = slot;
+	}
+}
 
-	AgentStruct past_agent = observable_;
-	for (int mode = 0; mode < belief_->size(0); mode++)
-		for (int intention = 0; intention < belief_->size(1); intention++) {
-			belief_->Update(model, past_agent, cur_agent, intention, mode);
+void AgentBeliefTable::EraseBucket(int id) {
+	size_t mask = buckets_.size() - 1;
+	size_t hole = Home(id);
+	while (slots_[buckets_[hole]].id != id)
+		hole = (hole + 1) & mask;
+
+	// Shift later entries of the probe run back into the hole, unless their
+	// home bucket lies cyclically in (hole, b]
+	for (size_t b = (hole + 1) & mask; buckets_[b] != -1; b = (b + 1) & mask) {
+		size_t home = Home(slots_[buckets_[b]].id);
+		if (((b - home) & mask) >= ((b - hole) & mask)) {
+			buckets_[hole] = buckets_[b];
+			hole = b;
 		}
-	observable_ = cur_agent;
-	time_stamp = Globals::ElapsedTime();
+	}
+	buckets_[hole] = -1;
 }
 
 CrowdBelief::CrowdBelief(const DSPOMDP* model): Belief(model),
 		world_model_(SimulatorBase::world_model){
 }
 
-CrowdBelief::CrowdBelief(const DSPOMDP* model, History history,
-		std::map<double, AgentBelief*> sorted_belief_) : Belief(model),
-	sorted_belief_(sorted_belief_),	world_model_(SimulatorBase::world_model) {
+CrowdBelief::CrowdBelief(const CrowdBelief& other): Belief(other),
+		agents_(other.agents_), nearest_(other.nearest_), car_(other.car_),
+		world_model_(other.world_model_) {
 }
 
 CrowdBelief::~CrowdBelief() {
-	for (std::map<double,AgentBelief*>::iterator it=sorted_belief_.begin();
-			it!=sorted_belief_.end(); ++it) {
-		AgentBelief* b = it->second;
-		delete b;
-	}
+	for (State* particle: particles_)
+		model_->Free(particle);
 }
 
 Belief* CrowdBelief::MakeCopy() const {
-	return new CrowdBelief(model_, history_, sorted_belief_);
+	return new CrowdBelief(*this);
 }
 
 
 std::vector<State*> CrowdBelief::Sample(int num) const {
+	return Sample(num, false);
+}
+
+std::vector<State*> CrowdBelief::Sample(int num, bool predict) const {
 	logi << "Sample particles from belief" << endl;
 	const ContextPomdp* context_pomdp = static_cast<const ContextPomdp*>(model_);
 
-	if (DESPOT::Debug_mode)
-		std::srand(0);
-
-	for (auto* particle: particles_) {
-		if (particle->IsAllocated())
-			model_->Free(particle);
+	// Resize the buffer; states kept from the last call are overwritten
+	while (particles_.size() > num) {
+		model_->Free(particles_.back());
+		particles_.pop_back();
 	}
-	particles_.resize(num);
+	while (particles_.size() < num)
+		particles_.push_back(model_->Allocate(particles_.size(), 0));
 
-	for (int i = 0; i < num; i++) {
-		particles_[i] = model_->Allocate(i, 1.0/num);
-	}
+	int num_agents = nearest_.size();
+	logd << "[CrowdBelief::Sample] state->num=" << num_agents <<
+			", agents_.size()=" << agents_.size() << endl;
 
-	for(auto* particle: particles_) {
-		PomdpState* state = static_cast<PomdpState*>(particle);
-		state->car = car_;
-		state->num = min<int>(ModelParams::N_PED_IN, sorted_belief_.size());
+	// Normalizing writes to the beliefs, so it is done before the parallel
+	// pass, which only reads them
+	for (int slot: nearest_)
+		agents_[slot].belief_.Normalize();
 
-		cout << "state->num=" << state->num <<
-				", sorted_belief_.size()=" << sorted_belief_.size() << endl;
-
-		state->time_stamp = Globals::ElapsedTime();
-
-		int agent_id = 0;
-		for (std::map<double,AgentBelief*>::const_iterator it=sorted_belief_.begin(); it!=sorted_belief_.end(); ++it) {
-			if (agent_id < state->num) {
-				AgentBelief* b = it->second;
-				state->agents[agent_id] = b->observable_;
-				b->Sample(state->agents[agent_id].intention, state->agents[agent_id].mode);
-
-				logd << "[Sample] agent " << state->agents[agent_id].id <<
-						" num_intentions=" <<
-						world_model_.GetNumIntentions(state->agents[agent_id].id) << endl;
-
-				world_model_.ValidateIntention(state->agents[agent_id].id, state->agents[agent_id].intention,
-						__FUNCTION__, __LINE__);
+	// Each chunk draws from its own generator, seeded independently of the
+	// number of threads
+	unsigned seed = Random::RANDOM.NextUnsigned();
+	double time_stamp = Globals::ElapsedTime();
+	int num_chunks = (num + SAMPLE_CHUNK_SIZE - 1) / SAMPLE_CHUNK_SIZE;
+
+	DESPOT::ParallelFor(num_chunks, [&](int chunk) {
+		Random random(seed + chunk);
+		int end = min(num, (chunk + 1) * SAMPLE_CHUNK_SIZE);
+		for (int i = chunk * SAMPLE_CHUNK_SIZE; i < end; i++) {
+			PomdpState* state = static_cast<PomdpState*>(particles_[i]);
+			state->scenario_id = i;
+			state->weight = 1.0 / num;
+			state->car = car_;
+			state->num = num_agents;
+			state->time_stamp = time_stamp;
+
+			for (int agent_id = 0; agent_id < num_agents; agent_id++) {
+				AgentBelief& b = agents_[nearest_[agent_id]];
+				state->agents[agent_id] = b.observable_;
+				b.Sample(random, state->agents[agent_id].intention,
+						state->agents[agent_id].mode);
+
+				world_model_.ValidateIntention(state->agents[agent_id].id,
+						state->agents[agent_id].intention, __FUNCTION__, __LINE__);
+			}
 
-				agent_id++;
-			} else
-				break;
+			if (predict)
+				context_pomdp->PredictAgentsInPlace(*state, random.NextDouble(), 0);
 		}
-	}
+	});
+
+	return particles_;
+}
 
-	if (abs(State::Weight(particles_) - 1.0) > 1e-6) {
-		cerr << "[CrowdBelief::CrowdBelief] Particle weights sum to "
-				<< State::Weight(particles_) << " instead of 1" << endl;
-		ERR("particle sampling error");
+/*
+ * Weigh the hidden states of the given agents by how well each explains the
+ * agent's observed move. The predictions lazily extend world-model tables,
+ * so the batch runs on the calling thread: the likelihood kernel alone is
+ * too cheap to pay for a dispatch to the search threads.
+ */
+void CrowdBelief::UpdateHiddenStates(
+		const std::vector<std::pair<AgentBelief*, const AgentStruct*>>& updates) {
+	TransitionBatch& batch = transition_batch_;
+	std::vector<COORD>& positions = predicted_positions_;
+
+	batch.Clear();
+	for (auto& update: updates) {
+		AgentBelief* agent_belief = update.first;
+		agent_belief->Predict(world_model_, positions);
+		for (const COORD& pos: positions)
+			batch.Add(agent_belief->observable_.pos, update.second->pos, pos);
+		batch.offsets.push_back(batch.move_x.size());
 	}
+	batch.log_likelihoods.resize(batch.move_x.size());
 
-	random_shuffle(particles_.begin(), particles_.end());
+	TransitionLogLikelihoods(batch, 0, batch.move_x.size());
 
-	return particles_;
+	for (int i = 0; i < updates.size(); i++) {
+		const double* log_likelihoods = &batch.log_likelihoods[batch.offsets[i]];
+		for (int j = 0; j < batch.offsets[i + 1] - batch.offsets[i]; j++)
+			if (isnan(log_likelihoods[j]))
+				ERR("Get transition likelihood as NAN");
+		updates[i].first->Update(*updates[i].second, log_likelihoods);
+	}
 }
 
 void CrowdBelief::Update(ACT_TYPE action, OBS_TYPE obs) {
@@ -252,74 +435,64 @@ void CrowdBelief::Update(ACT_TYPE action, const State* state) {
 	const PomdpStateWorld* observed = static_cast<const PomdpStateWorld*>(state);
 
 	logd << "[CrowdBelief::Update] " << "observed->num=" << observed->num << endl;
-	std::map<int, const AgentStruct*> src_agent_map;
-	for (int i=0;i < observed->num; i++) {
-		src_agent_map[observed->agents[i].id] = &(observed->agents[i]);
-	}
-
-	// new container for belief update
-	std::map<int,AgentBelief*> indexed_belief;
-	for (std::map<double,AgentBelief*>::iterator it=sorted_belief_.begin(); it!=sorted_belief_.end(); ++it) {
-		AgentBelief* agent_belief = it->second;
-		indexed_belief[agent_belief->observable_.id] = agent_belief;
-	}
-	logd << "[CrowdBelief::Update] " << "indexed_belief.size()=" << indexed_belief.size() << endl;
+	logd << "[CrowdBelief::Update] " << "agents_.size()=" << agents_.size() << endl;
 
 	// update belief
-	int n = 0;
+	std::vector<std::pair<AgentBelief*, const AgentStruct*>> updates;
 	car_ = observed->car;
 	world_model_.PrepareAttentiveAgentMeanDirs(state);
-	for (auto it=src_agent_map.begin(); it!=src_agent_map.end(); ++it) {
-		int id = it->first;
-		const AgentStruct& agent = *(it->second);
-		auto it1 = indexed_belief.find(id);
+	for (int i = 0; i < observed->num; i++) {
+		const AgentStruct& agent = observed->agents[i];
+		int id = agent.id;
+		int slot = agents_.Find(id);
 		int num_intentions = world_model_.GetNumIntentions(agent.id);
 		logd << "[Update] agent " << agent.id << " num_intentions=" << num_intentions << endl;
-		if (it1 != indexed_belief.end()) { // existing agents
-			AgentBelief* agent_belief = it1->second;
+		if (slot != -1) { // existing agents
+			AgentBelief* agent_belief = &agents_[slot];
 			if (world_model_.NeedBeliefReset(id))
 				agent_belief->Reset(num_intentions);
-			agent_belief->Update(world_model_, agent, num_intentions);
+			else if (num_intentions != agent_belief->belief_.size(1))
+				agent_belief->belief_.Resize(num_intentions);
+			updates.push_back(std::make_pair(agent_belief, &agent));
+			agents_.Touch(slot);
 		} else { // new agent
-			indexed_belief[id] = new AgentBelief(num_intentions, PED_MODES::NUM_AGENT_TYPES);
-			indexed_belief[id]->observable_ = agent;
+			slot = agents_.Insert(id, num_intentions, PED_MODES::NUM_AGENT_TYPES);
+			agents_[slot].observable_ = agent;
 		}
 	}
-	logd << "[CrowdBelief::Update] " << "indexed_belief.size()=" << indexed_belief.size() << endl;
+	UpdateHiddenStates(updates);
+	logd << "[CrowdBelief::Update] " << "agents_.size()=" << agents_.size() << endl;
 
 	// remove out-dated agents
 	double time_stamp = Globals::ElapsedTime();
-	for (std::map<int,AgentBelief*>::iterator it=indexed_belief.begin(); it!=indexed_belief.end(); ++it) {
-		AgentBelief* agent_belief = it->second;
-		if (agent_belief->OutDated(time_stamp)) {
-			logd << "[CrowdBelief::Update] " << "cur time_stamp = " << time_stamp
-					<< ", belief time_stamp="<< agent_belief->time_stamp << endl;
-
-			delete agent_belief;
-			indexed_belief.erase(it);
-		}
-	}
+	agents_.EvictOutDated(time_stamp);
 
 	// agents disappeared less than 2 seconds
-	for (auto it=indexed_belief.begin(); it!=indexed_belief.end(); ++it) {
-		AgentBelief* agent_belief = it->second;
-		if (world_model_.NumPaths(agent_belief->observable_.id) == 0) {
+	for (int slot: agents_.slots()) {
+		AgentBelief& agent_belief = agents_[slot];
+		if (world_model_.NumPaths(agent_belief.observable_.id) == 0) {
 			logd << "[CrowdBelief::Update] " << "cur time_stamp = " << time_stamp
-					<< ", belief time_stamp="<< agent_belief->time_stamp << endl;
-			agent_belief->Reset(world_model_.GetNumIntentions(agent_belief->observable_.id));
+					<< ", belief time_stamp="<< agent_belief.time_stamp << endl;
+			agent_belief.Reset(world_model_.GetNumIntentions(agent_belief.observable_.id));
 		}
 	}
 
-	logd << "[CrowdBelief::Update] " << "indexed_belief.size()=" << indexed_belief.size() << endl;
+	logd << "[CrowdBelief::Update] " << "agents_.size()=" << agents_.size() << endl;
 
-	// regenerate ordered belief
-	sorted_belief_.clear();
-	for (std::map<int,AgentBelief*>::iterator it=indexed_belief.begin(); it!=indexed_belief.end(); ++it) {
-		int id = it->first;
-		AgentBelief* agent_belief = it->second;
-		double dist_to_car = COORD::EuclideanDistance(agent_belief->observable_.pos, car_.pos);
-		sorted_belief_[dist_to_car] = agent_belief;
+	// select the agents nearest to the car
+	std::vector<std::pair<double, int>> by_distance;
+	by_distance.reserve(agents_.size());
+	for (int slot: agents_.slots()) {
+		double dist_to_car = COORD::EuclideanDistance(agents_[slot].observable_.pos, car_.pos);
+		by_distance.push_back(std::make_pair(dist_to_car, slot));
 	}
+	int num_nearest = min<int>(ModelParams::N_PED_IN, by_distance.size());
+	std::partial_sort(by_distance.begin(), by_distance.begin() + num_nearest,
+			by_distance.end());
+
+	nearest_.resize(num_nearest);
+	for (int i = 0; i < num_nearest; i++)
+		nearest_[i] = by_distance[i].second;
 
-	logd << "[CrowdBelief::Update] " << "sorted_belief_.size()=" << sorted_belief_.size() << endl;
+	logd << "[CrowdBelief::Update] " << "nearest_.size()=" << nearest_.size() << endl;
 }
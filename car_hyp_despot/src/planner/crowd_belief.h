@@ -7,6 +7,7 @@
 #include <despot/core/particle_belief.h>
 
 #include <limits>
+#include <list>
 
 #include <nav_msgs/Odometry.h>
 #include <nav_msgs/Path.h>
@@ -31,56 +32,72 @@
 #include <nav_msgs/GetPlan.h>
 
 
+/*
+ * Belief over the (mode, intention) of one agent, stored inline as
+ * unnormalized log-probabilities. Updates only add log-likelihoods; the
+ * table is normalized, and the sampling CDFs rebuilt, on the first Sample
+ * after an update.
+ */
 class HiddenStateBelief {
-	std::vector<std::vector<double>> probs_;
+public:
+	static const int MAX_MODES = NUM_AGENT_TYPES;
+	static const int MAX_INTENTIONS = 32;
+
+private:
+	int num_modes_;
+	int num_intentions_;
+	double log_probs_[MAX_MODES][MAX_INTENTIONS];
+	// Valid while !dirty_: CDF over all (mode, intention) pairs in row-major
+	// order, and CDF over the intentions of each mode
+	double joint_cdf_[MAX_MODES * MAX_INTENTIONS];
+	double mode_cdf_[MAX_MODES][MAX_INTENTIONS];
+	bool dirty_;
+
 public:
 	HiddenStateBelief(int num_intentions, int num_modes);
 	void Resize(int new_intentions);
 	void Resize(int new_intentions, int new_modes);
 	void Reset();
-	void Update(WorldModel&, AgentStruct& past_agent, const AgentStruct& cur_agent,
-			int intention_id, int mode_id);
+	/* Weigh the intentions of every mode by their transition likelihoods */
+	void Update(const double* log_likelihoods);
 	void Normalize();
-	void Sample(int& intention, int& mode);
+	/* Thread-safe once normalized */
+	void Sample(Random& random, int& intention, int& mode);
 	void Text(std::ostream& out) {
-		int mode = 0;
+		Normalize();
 		out << "b: ";
-		for (auto& intention_probs: probs_) {
+		for (int mode = 0; mode < num_modes_; mode++) {
 			out << "mode "<< mode << ":";
-			for (double prob: intention_probs)
-				out << " " << prob;
-			mode++;
+			for (int intention = 0; intention < num_intentions_; intention++)
+				out << " " << exp(log_probs_[mode][intention]);
 		}
 		out << endl;
 	}
 
-	int size(int dim) {
+	int size(int dim) const {
 		if (dim ==0)
-			return probs_.size();
+			return num_modes_;
 		else
-			return probs_[0].size();
+			return num_intentions_;
 	}
 };
 
 struct AgentBelief {
 	AgentStruct observable_;
-	HiddenStateBelief* belief_;
+	HiddenStateBelief belief_;
 	float time_stamp;
 
-	AgentBelief(int num_intentions, int num_modes) {
-		belief_ = new HiddenStateBelief(num_intentions, num_modes);
+	AgentBelief(int num_intentions, int num_modes) :
+			belief_(num_intentions, num_modes) {
 		time_stamp = Globals::ElapsedTime();
-;
 	}
 
-	~AgentBelief() {
-		delete belief_;
-	}
-
-	void Sample(int& goal, int& mode) const;
+	void Sample(Random& random, int& goal, int& mode);
 	void Reset(int new_intention_size);
 
-	void Update(WorldModel& model, const AgentStruct& cur_agent, int num_intentions);
+	/* Position of the agent after one step under each intention */
+	void Predict(WorldModel& model, std::vector<COORD>& positions) const;
+	void Update(const AgentStruct& cur_agent, const double* log_likelihoods);
 	bool OutDated(double cur_time_stamp) {
 		return abs(time_stamp - cur_time_stamp) > 2.0;
 	}
@@ -88,20 +105,111 @@ struct AgentBelief {
 	void Text(std::ostream& out) {
 		out << "Belief ";
 		observable_.ShortText(out);
-		belief_->Text(out);
+		belief_.Text(out);
+	}
+};
+
+
+/*
+ * Agent beliefs indexed by agent ID. The beliefs sit in a slot vector whose
+ * freed slots are reused, and an open-addressing hash table (linear probing)
+ * maps IDs to slots. The slots are also kept in order of their last update,
+ * so out-dated beliefs are evicted from the front of that list.
+ */
+class AgentBeliefTable {
+public:
+	AgentBeliefTable();
+	AgentBeliefTable(const AgentBeliefTable& other);
+	AgentBeliefTable& operator=(AgentBeliefTable other);
+	~AgentBeliefTable();
+
+	void swap(AgentBeliefTable& other);
+
+	/* Slot of the agent's belief, or -1 if the agent is not tracked */
+	int Find(int id) const;
+	/* Start tracking an agent that is not tracked yet; returns its slot */
+	int Insert(int id, int num_intentions, int num_modes);
+	/* Move the slot to the back of the update order */
+	void Touch(int slot);
+	/* Drop the beliefs that are out-dated at the given time */
+	void EvictOutDated(double cur_time_stamp);
+
+	AgentBelief& operator[](int slot) {
+		return *slots_[slot].belief;
+	}
+	const AgentBelief& operator[](int slot) const {
+		return *slots_[slot].belief;
+	}
+
+	/* Slots in use, least recently updated first */
+	const std::list<int>& slots() const {
+		return order_;
 	}
+
+	int size() const {
+		return order_.size();
+	}
+
+private:
+	struct Slot {
+		int id;
+		AgentBelief* belief; // NULL if the slot is free
+		std::list<int>::iterator order;
+	};
+
+	size_t Home(int id) const {
+		return (unsigned(id) * 2654435761u) & (buckets_.size() - 1);
+	}
+	void Grow();
+	void EraseBucket(int id);
+
+	std::vector<Slot> slots_;
+	std::vector<int> free_slots_;
+	std::vector<int> buckets_; // Slot of the agent hashed there, or -1
+	std::list<int> order_;
 };
 
+/*
+ * Transition hypotheses of all agents in structure-of-arrays form: for
+ * hypothesis i, the observed move of its agent and the move predicted under
+ * its intention, both relative to the agent's last position.
+ */
+struct TransitionBatch {
+	std::vector<double> move_x, move_y;
+	std::vector<double> pred_x, pred_y;
+	std::vector<double> log_likelihoods;
+	std::vector<int> offsets; // First hypothesis of each agent; one past the end
+
+	void Clear() {
+		move_x.clear();
+		move_y.clear();
+		pred_x.clear();
+		pred_y.clear();
+		offsets.clear();
+		offsets.push_back(0);
+	}
+
+	void Add(const COORD& past_pos, const COORD& cur_pos, const COORD& pred_pos) {
+		move_x.push_back(cur_pos.x - past_pos.x);
+		move_y.push_back(cur_pos.y - past_pos.y);
+		pred_x.push_back(pred_pos.x - past_pos.x);
+		pred_y.push_back(pred_pos.y - past_pos.y);
+	}
+};
 
 class CrowdBelief: public Belief {
-	std::map<double, AgentBelief*> sorted_belief_;
+	// Mutable since sampling normalizes the agent beliefs lazily
+	mutable AgentBeliefTable agents_;
+	// Slots of the N_PED_IN agents nearest to the car, nearest first
+	std::vector<int> nearest_;
 	CarStruct car_;
+	// States handed out by Sample, reused by the next call
+	mutable std::vector<State*> particles_;
 
 public:
 	CrowdBelief(const DSPOMDP* model);
-	CrowdBelief(const DSPOMDP* model, History history,
-			std::map<double, AgentBelief*> sorted_belief_);
-
+	CrowdBelief(const CrowdBelief& other);
+	CrowdBelief& operator=(const CrowdBelief&) = delete;
 	~CrowdBelief();
 
 	/**
@@ -112,6 +220,13 @@ public:
 	 */
 	std::vector<State*> Sample(int num) const;
 
+	/**
+	 * Sample num states, predicted one step ahead if predict is set. The
+	 * states belong to the belief and are overwritten by the next call.
+	 * They are filled in parallel on the search threads.
+	 */
+	std::vector<State*> Sample(int num, bool predict) const;
+
 	/**
 	 * Update the belief.
 	 *
@@ -129,11 +244,10 @@ public:
 
 	void Text(std::ostream& out) {
 		if (logging::level() >= logging::VERBOSE) {
-			auto& sorted_beliefs = sorted_belief_;
 			for (int i = 0;
-					i < sorted_beliefs.size() && i < min(20, ModelParams::N_PED_IN);
+					i < nearest_.size() && i < min(20, ModelParams::N_PED_IN);
 					i++) {
-				auto& p = *sorted_beliefs[i];
+				auto& p = agents_[nearest_[i]];
 				p.Text(out);
 				out << endl;
 			}
@@ -142,6 +256,12 @@ public:
 
 
 private:
+	void UpdateHiddenStates(
+			const std::vector<std::pair<AgentBelief*, const AgentStruct*>>& updates);
+
+	// Scratch buffers of UpdateHiddenStates, kept to reuse their capacity
+	TransitionBatch transition_batch_;
+	std::vector<COORD> predicted_positions_;
 
 	WorldModel& world_model_;
 };
@@ -2,9 +2,162 @@
 #include "path.h"
 #include<iostream>
 #include <fstream>
+#include <limits>
+#include <algorithm>
 using namespace std;
 
+/* Grid cell size in meters; grown for long paths to bound the grid */
+static const double PATH_GRID_CELL = 2.0;
+static const int PATH_GRID_MAX_CELLS = 256; // per side
+/* Points scanned past the best one in a warm-started search */
+static const int WARM_START_WINDOW = int(1.0 / ModelParams::PATH_STEP);
+/* Warm starts ending farther than this from the path are re-run globally */
+static const double WARM_START_MAX_DIST = 3.0;
+
+/**
+ * Uniform grid over the bounding box of a path. Cells list the indices of
+ * the points inside them in increasing order, so that a query only visits
+ * the cells around it.
+ */
+struct PathIndex {
+	int num_points;
+	double min_x, min_y, cell_size;
+	int nx, ny;
+	std::vector<int> cell_start; // offsets into points, nx * ny + 1 entries
+	std::vector<int> points;
+
+	int CellX(double x) const {
+		return int(floor((x - min_x) / cell_size));
+	}
+	int CellY(double y) const {
+		return int(floor((y - min_y) / cell_size));
+	}
+};
+
+static inline double DistSq(const COORD& a, const COORD& b) {
+	double dx = a.x - b.x, dy = a.y - b.y;
+	return dx * dx + dy * dy;
+}
+
+void Path::BuildIndex() {
+	auto& path = *this;
+	if (path.size() == 0) {
+		index_.reset();
+		return;
+	}
+
+	PathIndex* index = new PathIndex;
+	double max_x = path[0].x, max_y = path[0].y;
+	index->min_x = path[0].x;
+	index->min_y = path[0].y;
+	for (int i = 1; i < path.size(); i++) {
+		index->min_x = min(index->min_x, path[i].x);
+		index->min_y = min(index->min_y, path[i].y);
+		max_x = max(max_x, path[i].x);
+		max_y = max(max_y, path[i].y);
+	}
+	double extent = max(max_x - index->min_x, max_y - index->min_y);
+	index->cell_size = max(PATH_GRID_CELL, extent / PATH_GRID_MAX_CELLS);
+	index->nx = index->CellX(max_x) + 1;
+	index->ny = index->CellY(max_y) + 1;
+	index->num_points = path.size();
+
+	// Counting sort of the points by cell keeps each cell in index order
+	vector<int> cells(path.size());
+	index->cell_start.assign(index->nx * index->ny + 1, 0);
+	for (int i = 0; i < path.size(); i++) {
+		cells[i] = index->CellY(path[i].y) * index->nx
+				+ index->CellX(path[i].x);
+		index->cell_start[cells[i] + 1]++;
+	}
+	for (int c = 0; c < index->nx * index->ny; c++)
+		index->cell_start[c + 1] += index->cell_start[c];
+	vector<int> fill(index->cell_start.begin(), index->cell_start.end() - 1);
+	index->points.resize(path.size());
+	for (int i = 0; i < path.size(); i++)
+		index->points[fill[cells[i]]++] = i;
+
+	index_.reset(index);
+}
+
 int Path::Nearest(const COORD pos) const {
+	if (!index_ || index_->num_points != size())
+		return NearestLinear(pos);
+
+	auto& path = *this;
+	const PathIndex& index = *index_;
+	int cx = index.CellX(pos.x), cy = index.CellY(pos.y);
+
+	int best = -1;
+	double best_d = numeric_limits<double>::infinity();
+	auto visit_cell = [&](int x, int y) {
+		if (x < 0 || x >= index.nx || y < 0 || y >= index.ny)
+			return;
+		int c = y * index.nx + x;
+		for (int k = index.cell_start[c]; k < index.cell_start[c + 1]; k++) {
+			int i = index.points[k];
+			double d = DistSq(pos, path[i]);
+			if (d < best_d || (d == best_d && i < best)) {
+				best_d = d;
+				best = i;
+			}
+		}
+	};
+
+	// Visit rings of cells around the query; points in ring r + 1 and beyond
+	// are at least r cells away. Rings before r_min lie outside the grid.
+	int r_min = max(0, max(max(-cx, cx - (index.nx - 1)),
+			max(-cy, cy - (index.ny - 1))));
+	int r_max = max(max(cx, index.nx - 1 - cx), max(cy, index.ny - 1 - cy));
+	for (int r = r_min; r <= r_max; r++) {
+		if (r == 0)
+			visit_cell(cx, cy);
+		else {
+			for (int x = cx - r; x <= cx + r; x++) {
+				visit_cell(x, cy - r);
+				visit_cell(x, cy + r);
+			}
+			for (int y = cy - r + 1; y <= cy + r - 1; y++) {
+				visit_cell(cx - r, y);
+				visit_cell(cx + r, y);
+			}
+		}
+
+		double reach = r * index.cell_size;
+		if (best >= 0 && best_d < reach * reach)
+			break;
+	}
+	return best;
+}
+
+int Path::Nearest(const COORD pos, int hint) const {
+	auto& path = *this;
+	if (hint < 0 || hint >= path.size())
+		return Nearest(pos);
+
+	// Walk both ways from the hint, up to a window past the best point
+	int best = hint;
+	double best_d = DistSq(pos, path[hint]);
+	for (int dir = 1; dir >= -1; dir -= 2) {
+		int misses = 0;
+		for (int i = hint + dir; i >= 0 && i < path.size()
+				&& misses < WARM_START_WINDOW; i += dir) {
+			double d = DistSq(pos, path[i]);
+			if (d < best_d || (d == best_d && i < best)) {
+				best_d = d;
+				best = i;
+				misses = 0;
+			} else
+				misses++;
+		}
+	}
+
+	if (best_d > WARM_START_MAX_DIST * WARM_START_MAX_DIST)
+		return Nearest(pos);
+	return best;
+}
+
+int Path::NearestLinear(const COORD& pos) const {
     auto& path = *this;
     double dmin = COORD::EuclideanDistance(pos, path[0]);
     int imin = 0;
@@ -83,6 +236,7 @@ Path Path::Interpolate(double max_len) const {
 		ti += d;
 	}
 	p.push_back(path[path.size()-1]);
+	p.BuildIndex();
 	return p;
 }
 
@@ -90,6 +244,7 @@ void Path::CutJoin(const Path& p) {
 	int i = max(0, Nearest(p[0])-1);
 	erase(begin()+i, end());
 	insert(end(), p.begin()/*+1*/, p.end());
+	BuildIndex();
 }
 
 double Path::GetLength(int start){
@@ -1,10 +1,18 @@
 #pragma once
 #include<vector>
+#include<memory>
 #include"coord.h"
 #include"param.h"
 
+struct PathIndex;
+
 struct Path : std::vector<COORD> {
     int Nearest(const COORD pos) const;
+    /**
+     * Nearest point around a previous index along the path (e.g.
+     * pos_along_path). Falls back to the global search when the hint is stale.
+     */
+    int Nearest(const COORD pos, int hint) const;
     double MinDist(COORD pos);
     int Forward(double i, double len) const;
 	double GetYaw(int i) const;
@@ -17,9 +25,21 @@ struct Path : std::vector<COORD> {
 
 	void Text();
 
+	/**
+	 * Build the spatial grid used by Nearest. Interpolate() returns indexed
+	 * paths; call it again after changing the points of a path in place.
+	 */
+	void BuildIndex();
+
 	void CopyTo(Path& des){
 		des.assign(begin(),end());
+		des.index_ = index_;
 	}
+
+private:
+	int NearestLinear(const COORD& pos) const;
+
+	std::shared_ptr<const PathIndex> index_;
 };
 
 double CapAngle(double x);
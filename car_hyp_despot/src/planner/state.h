@@ -46,9 +46,16 @@ struct AgentStruct {
 		bb_extent_x = 0;
 		bb_extent_y = 0;
 		heading_dir = 0;
+		heading_vec = COORD(1, 0);
 		cross_dir = 0;
 	}
 
+	// Keeps heading_vec, read by the collision check, in sync
+	void set_heading_dir(double dir) {
+		heading_dir = dir;
+		heading_vec = COORD(cos(dir), sin(dir));
+	}
+
 	COORD pos;
     int mode;
 	int intention; // intended path
@@ -59,6 +66,7 @@ struct AgentStruct {
     double speed;
     COORD vel;
     double heading_dir;
+    COORD heading_vec; // (cos, sin) of heading_dir
     double bb_extent_x, bb_extent_y;
 
     void Text(std::ostream& out) const {
@@ -139,9 +147,78 @@ public:
 			agents[i].bb_extent_x = src.agents[i].bb_extent_x;
 			agents[i].bb_extent_y = src.agents[i].bb_extent_y;
 			agents[i].heading_dir = src.agents[i].heading_dir;
+			agents[i].heading_vec = src.agents[i].heading_vec;
 		}
 		time_stamp = src.time_stamp;
 	}
 };
 
+/**
+ * Structure-of-arrays view of a set of PomdpState particles, used to step all
+ * particles of a search node at once. Car columns are indexed by particle;
+ * agent columns by particle * N_PED_IN + agent.
+ */
+struct PomdpStateBatch {
+	int size;
+	std::vector<PomdpState*> states;
+
+	std::vector<double> car_x, car_y, car_vel, car_heading;
+	std::vector<int> num;
+	std::vector<char> active;
+
+	// Agent positions, read by the observation hash; agents are stepped on
+	// the states themselves
+	std::vector<double> agent_x, agent_y;
+
+	PomdpStateBatch() : size(0) {}
+
+	void Resize(int n) {
+		size = n;
+		states.resize(n);
+		car_x.resize(n);
+		car_y.resize(n);
+		car_vel.resize(n);
+		car_heading.resize(n);
+		num.resize(n);
+		active.resize(n);
+
+		int n_agents = n * ModelParams::N_PED_IN;
+		agent_x.resize(n_agents);
+		agent_y.resize(n_agents);
+	}
+
+	void Gather(const std::vector<State*>& particles) {
+		Resize(particles.size());
+		for (int i = 0; i < size; i++) {
+			PomdpState* state = static_cast<PomdpState*>(particles[i]);
+			states[i] = state;
+			car_x[i] = state->car.pos.x;
+			car_y[i] = state->car.pos.y;
+			car_vel[i] = state->car.vel;
+			car_heading[i] = state->car.heading_dir;
+			num[i] = state->num;
+			active[i] = true;
+			GatherAgents(i);
+		}
+	}
+
+	void GatherAgents(int i) {
+		const PomdpState* state = states[i];
+		int base = i * ModelParams::N_PED_IN;
+		for (int j = 0; j < state->num; j++) {
+			const AgentStruct& agent = state->agents[j];
+			agent_x[base + j] = agent.pos.x;
+			agent_y[base + j] = agent.pos.y;
+		}
+	}
+
+	void ScatterCar(int i) {
+		CarStruct& car = states[i]->car;
+		car.pos.x = car_x[i];
+		car.pos.y = car_y[i];
+		car.vel = car_vel[i];
+		car.heading_dir = car_heading[i];
+	}
+};
+
 #endif
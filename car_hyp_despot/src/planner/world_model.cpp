@@ -9,6 +9,7 @@
 
 #include "coord.h"
 #include "path.h"
+#include "collision.h"
 #include "world_model.h"
 #include "context_pomdp.h"
 
@@ -59,6 +60,12 @@ WorldModel::~WorldModel() {
 void WorldModel::SetPath(Path path) {
 	this->path = path;
 	ModelParams::GOAL_TRAVELLED = path.GetLength();
+	car_path_hint = -1;
+}
+
+void WorldModel::UpdateCarPathHint(const CarStruct& car) {
+	if (path.size() > 0)
+		car_path_hint = path.Nearest(car.pos, car_path_hint);
 }
 
 ACT_TYPE WorldModel::DefaultStatePolicy(const State* _state) const {
@@ -141,7 +148,7 @@ int WorldModel::DefaultPolicy(const std::vector<State*>& particles) {
 }
 
 int WorldModel::MinStepToGoal(const PomdpState& state) {
-	double d = path.GetLength(path.Nearest(state.car.pos));
+	double d = path.GetLength(path.Nearest(state.car.pos, car_path_hint));
 	if (d < 0)
 		d = 0;
 	return int(ceil(d / (ModelParams::VEL_MAX / freq)));
@@ -156,13 +163,9 @@ void WorldModel::AgentStep(AgentStruct &agent, Random& random) {
 	}
 }
 
-void WorldModel::AgentStep(AgentStruct &agent, double& random) {
-
-	double noise = sqrt(-2 * log(random));
-	if (FIX_SCENARIO != 1 && !CPUDoPrint) {
-		random = QuickRandom::RandGeneration(random);
-	}
-	noise *= cos(2 * M_PI * random) * ModelParams::NOISE_GOAL_ANGLE;
+void WorldModel::AgentStep(AgentStruct &agent, const CounterRandom& random) {
+	CounterRandom agent_random = random.ForAgent(agent.id);
+	double noise = agent_random.NextGaussian() * ModelParams::NOISE_GOAL_ANGLE;
 
 	if (goal_mode == "cur_vel") {
 		AgentStepCurVel(agent, 1, noise);
@@ -177,6 +180,12 @@ void WorldModel::GammaAgentStep(AgentStruct& agent, int intention_id) {
 	agent.pos = ped_mean_dirs[agent_id][intention_id] + agent.pos;
 }
 
+void WorldModel::GammaAgentStep(AgentStruct agents[],
+		const CounterRandom& random, int num_agents, CarStruct car) {
+	GammaSimulateAgents(agents, num_agents, car);
+	ApplyGammaStep(agents, random, num_agents, 0);
+}
+
 double GenerateGaussian(double rNum) {
 	if (FIX_SCENARIO != 1 && !CPUDoPrint)
 		rNum = QuickRandom::RandGeneration(rNum);
@@ -207,6 +216,28 @@ void WorldModel::GammaAgentStep(AgentStruct agents[], double& random,
 	}
 }
 
+/*
+ * Moves the attentive agents to their GAMMA positions. first_id is the
+ * number of the first agent in the simulator.
+ */
+void WorldModel::ApplyGammaStep(AgentStruct agents[],
+		const CounterRandom& random, int num_agents, int first_id) {
+	for (int i = 0; i < num_agents; ++i) {
+		auto& agent = agents[i];
+		if (agent.mode == AGENT_ATT) {
+			COORD rvo_vel = GetGammaVel(agent, first_id + i);
+			AgentApplyGammaVel(agent, rvo_vel);
+			if (use_noise_in_rvo) {
+				CounterRandom agent_random = random.ForAgent(agent.id);
+				agent.pos.x += agent_random.NextGaussian()
+						* ModelParams::NOISE_PED_POS / freq;
+				agent.pos.y += agent_random.NextGaussian()
+						* ModelParams::NOISE_PED_POS / freq;
+			}
+		}
+	}
+}
+
 void WorldModel::AgentStepCurVel(AgentStruct& agent, int step, double noise) {
 	if (noise != 0) {
 		double a = agent.vel.GetAngle();
@@ -279,7 +310,7 @@ void WorldModel::VehStepPath(AgentStruct& agent, int step, double noise,
 		double steering = PControlAngle<AgentStruct>(agent, pursuit_point) + noise;
 		BicycleModel(agent, steering, agent.speed);
 
-		agent.pos_along_path = path.Nearest(agent.pos);
+		agent.pos_along_path = path.Nearest(agent.pos, agent.pos_along_path);
 		agent.vel = (agent.pos - old_pos) * freq;
 
 		if (doPrint && agent.pos_along_path == old_path_pos)
@@ -328,12 +359,11 @@ void WorldModel::RobVelStep(CarStruct &car, double acc, Random& random) {
 	return;
 }
 
-void WorldModel::RobVelStep(CarStruct &car, double acc, double& random) {
+void WorldModel::RobVelStep(CarStruct &car, double acc,
+		const CounterRandom& random) {
 	const double N = ModelParams::NOISE_ROBVEL;
 	if (N > 0) {
-		if (FIX_SCENARIO != 1 && !CPUDoPrint)
-			random = QuickRandom::RandGeneration(random);
-		double prob = random;
+		double prob = random.ForAgent(CounterRandom::CAR).NextDouble();
 		if (prob > N) {
 			car.vel += acc / freq;
 		}
@@ -344,6 +374,69 @@ void WorldModel::RobVelStep(CarStruct &car, double acc, double& random) {
 	return;
 }
 
+/*
+ * Same as RobStep(car, steering, random) for every particle of the batch,
+ * written over the car columns. The particles of a node share the car state
+ * except where velocity noise split them, and the observation includes the
+ * car's position and speed, so runs of particles repeat the same inputs;
+ * the result of the previous particle is reused for them.
+ */
+void WorldModel::RobStepBatch(PomdpStateBatch& batch, double steering) {
+	const int n = batch.size;
+	double* x = batch.car_x.data();
+	double* y = batch.car_y.data();
+	double* heading = batch.car_heading.data();
+	const double* vel = batch.car_vel.data();
+
+	// inputs and outputs of the last particle stepped
+	double in_x = 0, in_y = 0, in_heading = 0, in_vel = 0;
+	double out_x = 0, out_y = 0, out_heading = 0;
+
+	if (steering != 0) {
+		double TurningRadius = ModelParams::CAR_WHEEL_DIST / tan(steering);
+		for (int i = 0; i < n; i++) {
+			if (i > 0 && x[i] == in_x && y[i] == in_y && heading[i] == in_heading
+					&& vel[i] == in_vel) {
+				x[i] = out_x;
+				y[i] = out_y;
+				heading[i] = out_heading;
+				continue;
+			}
+			in_x = x[i];
+			in_y = y[i];
+			in_heading = heading[i];
+			in_vel = vel[i];
+
+			double beta = vel[i] / freq / TurningRadius;
+			double rear_x = x[i] - ModelParams::CAR_REAR * cos(heading[i]);
+			double rear_y = y[i] - ModelParams::CAR_REAR * sin(heading[i]);
+			rear_x += TurningRadius * (sin(heading[i] + beta) - sin(heading[i]));
+			rear_y += TurningRadius * (cos(heading[i]) - cos(heading[i] + beta));
+			double h = fmod(heading[i] + beta, 2 * M_PI);
+			h = (h < 0) ? h + 2 * M_PI : h;
+			heading[i] = out_heading = h;
+			x[i] = out_x = rear_x + ModelParams::CAR_REAR * cos(h);
+			y[i] = out_y = rear_y + ModelParams::CAR_REAR * sin(h);
+		}
+	} else {
+		for (int i = 0; i < n; i++) {
+			if (i > 0 && x[i] == in_x && y[i] == in_y && heading[i] == in_heading
+					&& vel[i] == in_vel) {
+				x[i] = out_x;
+				y[i] = out_y;
+				continue;
+			}
+			in_x = x[i];
+			in_y = y[i];
+			in_heading = heading[i];
+			in_vel = vel[i];
+
+			x[i] = out_x = x[i] + (vel[i] / freq) * cos(heading[i]);
+			y[i] = out_y = y[i] + (vel[i] / freq) * sin(heading[i]);
+		}
+	}
+}
+
 void WorldModel::RobStepCurVel(CarStruct &car) {
 	car.pos.x += (car.vel / freq) * cos(car.heading_dir);
 	car.pos.y += (car.vel / freq) * sin(car.heading_dir);
@@ -352,7 +445,8 @@ void WorldModel::RobStepCurVel(CarStruct &car) {
 void WorldModel::RobStepCurAction(CarStruct &car, double acc, double steering) {
 	double det_prob = 1;
 	RobStep(car, steering, det_prob);
-	RobVelStep(car, acc, det_prob);
+	// No velocity noise
+	car.vel = max(min(car.vel + acc / freq, ModelParams::VEL_MAX), 0.0);
 }
 
 COORD WorldModel::GetGoalPos(const AgentStruct& agent, int intention_id) {
@@ -495,236 +589,109 @@ std::vector<COORD> ComputeRect(COORD pos, double heading,
 		double ref_front_side_angle, double ref_back_side_angle);
 bool InCollision(std::vector<COORD> rect_1, std::vector<COORD> rect_2);
 
-bool WorldModel::InCollision(const PomdpState& state) const {
-	const COORD& car_pos = state.car.pos;
-
-	int i = 0;
-	for (auto& agent : state.agents) {
-		if (i >= state.num)
-			break;
-		i++;
+static thread_local AgentBoxes agent_boxes;
 
-		if (!InFront(agent.pos, state.car))
-			continue;
+/*
+ * Collects the agents of a state into the columns used by the batched
+ * collision check.
+ */
+static AgentBoxes& GatherAgentBoxes(const AgentStruct agents[], int num) {
+	AgentBoxes& boxes = agent_boxes;
 
-		if (agent.type == AgentType::ped) {
-			const COORD& pedpos = agent.pos;
-			if (::InCollision(pedpos.x, pedpos.y, car_pos.x, car_pos.y,
-					state.car.heading_dir)) {
-				return true;
-			}
-		} else if (agent.type == AgentType::car) {
-			if (CheckCarWithVehicle(state.car, agent, 0))
-				return true;
-		} else {
+	boxes.Resize(num);
+	for (int i = 0; i < num; i++) {
+		const AgentStruct& agent = agents[i];
+		if (agent.type != AgentType::ped && agent.type != AgentType::car)
 			ERR(string_sprintf("unsupported agent type"));
-		}
+
+		boxes.x[i] = agent.pos.x;
+		boxes.y[i] = agent.pos.y;
+		boxes.dir_x[i] = agent.heading_vec.x;
+		boxes.dir_y[i] = agent.heading_vec.y;
+		boxes.extent_x[i] = agent.bb_extent_x;
+		boxes.extent_y[i] = agent.bb_extent_y;
+		boxes.is_vehicle[i] = (agent.type == AgentType::car);
 	}
+	return boxes;
+}
 
-	return false;
+int WorldModel::FirstAgentInCollision(const CarStruct& car,
+		const AgentStruct agents[], int num, int flag,
+		double in_front_angle_deg) const {
+	if (in_front_angle_deg == -1)
+		in_front_angle_deg = ModelParams::IN_FRONT_ANGLE_DEG;
+	// inFront check is disabled for angles >= 180
+	bool check_in_front = (in_front_angle_deg < 180.0);
+
+	AgentBoxes& boxes = GatherAgentBoxes(agents, num);
+	return ::FirstAgentInCollision(car.pos.x, car.pos.y, car.heading_dir,
+			boxes, flag, check_in_front, in_front_angle_cos);
+}
+
+bool WorldModel::InCollision(const PomdpState& state) const {
+	return FirstAgentInCollision(state.car, state.agents, state.num, 0) != -1;
 }
 
 bool WorldModel::InRealCollision(const PomdpStateWorld& state, int &id,
 		double infront_angle) const {
 	id = -1;
-	if (infront_angle == -1) {
-		infront_angle = ModelParams::IN_FRONT_ANGLE_DEG;
-	}
+	int i = FirstAgentInCollision(state.car, state.agents, state.num, 1,
+			infront_angle);
+	if (i == -1)
+		return false;
 
 	const COORD& car_pos = state.car.pos;
-
-	int i = 0;
-	for (auto& agent : state.agents) {
-		if (i >= state.num)
-			break;
-		i++;
-
-		if (!InFront(agent.pos, state.car, infront_angle))
-			continue;
-
-		if (agent.type == AgentType::ped) {
-			const COORD& pedpos = agent.pos;
-			if (::InRealCollision(pedpos.x, pedpos.y, car_pos.x, car_pos.y,
-					state.car.heading_dir)) {
-				id = agent.id;
-			}
-		} else if (agent.type == AgentType::car) {
-			if (CheckCarWithVehicle(state.car, agent, 1)) {
-				id = agent.id;
-			}
-		} else {
-			ERR(string_sprintf("unsupported agent type"));
-		}
-
-		if (id != -1) {
-			logv << "[WorldModel::InRealCollision] car_pos: (" << car_pos.x
-					<< "," << car_pos.y << "), heading: ("
-					<< std::cos(state.car.heading_dir) << ","
-					<< std::sin(state.car.heading_dir) << "), agent_pos: ("
-					<< agent.pos.x << "," << agent.pos.y << ")\n";
-			return true;
-		}
-	}
-
-	return false;
+	const AgentStruct& agent = state.agents[i];
+	id = agent.id;
+	logv << "[WorldModel::InRealCollision] car_pos: (" << car_pos.x
+			<< "," << car_pos.y << "), heading: ("
+			<< std::cos(state.car.heading_dir) << ","
+			<< std::sin(state.car.heading_dir) << "), agent_pos: ("
+			<< agent.pos.x << "," << agent.pos.y << ")\n";
+	return true;
 }
 
 bool WorldModel::InRealCollision(const PomdpStateWorld& state,
 		double infront_angle_deg) const {
-	const COORD& car_pos = state.car.pos;
-	int id = -1;
-	if (infront_angle_deg == -1) {
-		infront_angle_deg = ModelParams::IN_FRONT_ANGLE_DEG;
-	}
-
-	int i = 0;
-	for (auto& agent : state.agents) {
-		if (i >= state.num)
-			break;
-		i++;
-
-		if (!InFront(agent.pos, state.car, infront_angle_deg))
-			continue;
-
-		if (agent.type == AgentType::ped) {
-			const COORD& pedpos = agent.pos;
-			if (::InRealCollision(pedpos.x, pedpos.y, car_pos.x, car_pos.y,
-					state.car.heading_dir)) {
-				id = agent.id;
-			}
-		} else if (agent.type == AgentType::car) {
-			if (CheckCarWithVehicle(state.car, agent, 1)) {
-				id = agent.id;
-			}
-		} else {
-			ERR(string_sprintf("unsupported agent type"));
-		}
-
-		if (id != -1) {
-			logv << "[WorldModel::InRealCollision] car_pos: (" << car_pos.x
-					<< "," << car_pos.y << "), heading: ("
-					<< std::cos(state.car.heading_dir) << ","
-					<< std::sin(state.car.heading_dir) << "), agent_pos: ("
-					<< agent.pos.x << "," << agent.pos.y << ")\n";
-			return true;
-		}
-	}
-
-	return false;
+	int id;
+	return InRealCollision(state, id, infront_angle_deg);
 }
 
 bool WorldModel::InCollision(const PomdpStateWorld& state, double in_front_angle_deg) const {
-	const COORD& car_pos = state.car.pos;
-
-	if (in_front_angle_deg == -1) {
-		in_front_angle_deg = ModelParams::IN_FRONT_ANGLE_DEG;
-	}
-
-	int i = 0;
-	for (auto& agent : state.agents) {
-		if (i >= state.num)
-			break;
-		i++;
-
-		if (!InFront(agent.pos, state.car, in_front_angle_deg))
-			continue;
-
-		if (agent.type == AgentType::ped) {
-			const COORD& pedpos = agent.pos;
-			if (::InCollision(pedpos.x, pedpos.y, car_pos.x, car_pos.y,
-					state.car.heading_dir)) {
-				return true;
-			}
-		} else if (agent.type == AgentType::car) {
-			if (CheckCarWithVehicle(state.car, agent, 0))
-				return true;
-		} else {
-			ERR(string_sprintf("unsupported agent type"));
-		}
-	}
-
-	return false;
+	return FirstAgentInCollision(state.car, state.agents, state.num, 0,
+			in_front_angle_deg) != -1;
 }
 
 bool WorldModel::InCollision(const PomdpState& state, int &id) const {
 	id = -1;
-	const COORD& car_pos = state.car.pos;
-
-	int i = 0;
-	for (auto& agent : state.agents) {
-		if (i >= state.num)
-			break;
-		i++;
-
-		if (!InFront(agent.pos, state.car))
-			continue;
-
-		if (agent.type == AgentType::ped) {
-			const COORD& pedpos = agent.pos;
-			if (::InCollision(pedpos.x, pedpos.y, car_pos.x, car_pos.y,
-					state.car.heading_dir)) {
-				id = agent.id;
-				return true;
-			}
-
-		} else if (agent.type == AgentType::car) {
-			if (CheckCarWithVehicle(state.car, agent, 0)) {
-				id = agent.id;
-				return true;
-			}
-		} else {
-			ERR(string_sprintf("unsupported agent type"));
-		}
-	}
-
-	if (id != -1) {
-		return true;
-	}
-
-	return false;
+	int i = FirstAgentInCollision(state.car, state.agents, state.num, 0);
+	if (i != -1)
+		id = state.agents[i].id;
+	return id != -1;
 }
 
 bool WorldModel::InCollision(const PomdpStateWorld& state, int &id) const {
 	id = -1;
-	const COORD& car_pos = state.car.pos;
-
-	int i = 0;
-	for (auto& agent : state.agents) {
-		if (i >= state.num)
-			break;
-		i++;
-
-		if (!InFront(agent.pos, state.car))
-			continue;
-
-		if (agent.type == AgentType::ped) {
-			const COORD& pedpos = agent.pos;
-			if (::InCollision(pedpos.x, pedpos.y, car_pos.x, car_pos.y,
-					state.car.heading_dir)) {
-				id = agent.id;
-			}
-
-		} else if (agent.type == AgentType::car) {
-			if (CheckCarWithVehicle(state.car, agent, 0)) {
-				id = agent.id;
-			}
-		} else {
-			ERR(string_sprintf("unsupported agent type"));
-		}
-
-		if (id != -1)
-			logv << "[WorldModel::InRealCollision] car_pos: (" << car_pos.x
-					<< "," << car_pos.y << "), heading: ("
-					<< std::cos(state.car.heading_dir) << ","
-					<< std::sin(state.car.heading_dir) << "), agent_pos: ("
-					<< agent.pos.x << "," << agent.pos.y << ")\n";
-	}
-
-	if (id != -1) {
-		return true;
-	}
+	int i = FirstAgentInCollision(state.car, state.agents, state.num, 0);
+	if (i == -1)
+		return false;
 
-	return false;
+	// report the last agent in collision
+	const AgentBoxes& boxes = agent_boxes;
+	const COORD& car_pos = state.car.pos;
+	bool check_in_front = (ModelParams::IN_FRONT_ANGLE_DEG < 180.0);
+	for (; i != -1; i = ::FirstAgentInCollision(car_pos.x, car_pos.y,
+			state.car.heading_dir, boxes, 0, check_in_front, in_front_angle_cos,
+			i + 1)) {
+		const AgentStruct& agent = state.agents[i];
+		id = agent.id;
+		logv << "[WorldModel::InRealCollision] car_pos: (" << car_pos.x
+				<< "," << car_pos.y << "), heading: ("
+				<< std::cos(state.car.heading_dir) << ","
+				<< std::sin(state.car.heading_dir) << "), agent_pos: ("
+				<< agent.pos.x << "," << agent.pos.y << ")\n";
+	}
+	return true;
 }
 
 bool WorldModel::CheckCarWithVehicle(const CarStruct& car,
@@ -1066,7 +1033,7 @@ void WorldModel::BicycleModel(AgentStruct &agent, double steering,
 				* (sin(agent.heading_dir + beta) - sin(agent.heading_dir));
 		rear_pos.y += TurningRadius
 				* (cos(agent.heading_dir) - cos(agent.heading_dir + beta));
-		agent.heading_dir = CapAngle(agent.heading_dir + beta);
+		agent.set_heading_dir(CapAngle(agent.heading_dir + beta));
 		agent.pos.x = rear_pos.x
 				+ agent.bb_extent_y * 2 * 0.4 * cos(agent.heading_dir);
 		agent.pos.y = rear_pos.y
@@ -1079,8 +1046,11 @@ void WorldModel::BicycleModel(AgentStruct &agent, double steering,
 
 #include "Vector2.h"
 
-std::vector<RVO::Vector2> WorldModel::GetBoundingBoxCorners(
-		AgentStruct& agent) {
+/* Corner buffer of the GAMMA agents being set up by this thread */
+static thread_local std::vector<RVO::Vector2> bb_corners;
+
+void WorldModel::GetBoundingBoxCorners(AgentStruct& agent,
+		std::vector<RVO::Vector2>& corners) {
 	RVO::Vector2 forward_vec = RVO::Vector2(cos(agent.heading_dir),
 			sin(agent.heading_dir));
 	RVO::Vector2 sideward_vec = RVO::Vector2(-sin(agent.heading_dir),
@@ -1096,22 +1066,18 @@ std::vector<RVO::Vector2> WorldModel::GetBoundingBoxCorners(
 
 	RVO::Vector2 pos = RVO::Vector2(agent.pos.x, agent.pos.y);
 
-	return std::vector<RVO::Vector2>(
-			{ pos + forward_vec * forward_len + sideward_vec * side_len, pos
-					- forward_vec * forward_len + sideward_vec * side_len, pos
-					- forward_vec * forward_len - sideward_vec * side_len, pos
-					+ forward_vec * forward_len - sideward_vec * side_len });
+	GetBoundingBoxCorners(forward_vec, sideward_vec, pos, forward_len,
+			side_len, corners);
 }
 
-std::vector<RVO::Vector2> WorldModel::GetBoundingBoxCorners(
+void WorldModel::GetBoundingBoxCorners(
 		RVO::Vector2 forward_vec, RVO::Vector2 sideward_vec, RVO::Vector2 pos,
-		double forward_len, double side_len) {
-
-	return std::vector<RVO::Vector2>(
-			{ pos + forward_vec * forward_len + sideward_vec * side_len, pos
-					- forward_vec * forward_len + sideward_vec * side_len, pos
-					- forward_vec * forward_len - sideward_vec * side_len, pos
-					+ forward_vec * forward_len - sideward_vec * side_len });
+		double forward_len, double side_len, std::vector<RVO::Vector2>& corners) {
+	corners.resize(4);
+	corners[0] = pos + forward_vec * forward_len + sideward_vec * side_len;
+	corners[1] = pos - forward_vec * forward_len + sideward_vec * side_len;
+	corners[2] = pos - forward_vec * forward_len - sideward_vec * side_len;
+	corners[3] = pos + forward_vec * forward_len - sideward_vec * side_len;
 }
 
 void WorldModel::InitGamma() {
@@ -1153,9 +1119,10 @@ void WorldModel::AddEgoGammaAgent(int id_in_sim, const CarStruct& car) {
 
 	// set agent bounding box corners
 	RVO::Vector2 sideward_vec = RVO::Vector2(-agt_heading.y(), agt_heading.x()); // rotate 90 degree counter-clockwise
+	GetBoundingBoxCorners(agt_heading, sideward_vec, RVO::Vector2(car_x, car_y),
+			ModelParams::CAR_FRONT, ModelParams::CAR_WIDTH/2.0, bb_corners);
 	traffic_agent_sim_[threadID]->setAgentBoundingBoxCorners(id_in_sim,
-			GetBoundingBoxCorners(agt_heading, sideward_vec,
-					RVO::Vector2(car_x, car_y), ModelParams::CAR_FRONT, ModelParams::CAR_WIDTH/2.0));
+			bb_corners);
 }
 
 void WorldModel::AddGammaAgent(const AgentStruct& agent, int id_in_sim) {
@@ -1191,9 +1158,10 @@ void WorldModel::AddGammaAgent(const AgentStruct& agent, int id_in_sim) {
 	assert(bb_x > 0);
 	assert(bb_y > 0);
 
+	GetBoundingBoxCorners(agt_heading, sideward_vec, RVO::Vector2(car_x, car_y),
+			bb_y, bb_x, bb_corners);
 	traffic_agent_sim_[threadID]->setAgentBoundingBoxCorners(id_in_sim,
-			GetBoundingBoxCorners(agt_heading, sideward_vec,
-					RVO::Vector2(car_x, car_y), bb_y, bb_x));
+			bb_corners);
 }
 
 void WorldModel::GammaSimulateAgents(AgentStruct agents[], int num_agents,
@@ -1201,11 +1169,44 @@ void WorldModel::GammaSimulateAgents(AgentStruct agents[], int num_agents,
 
 	int threadID = GetThreadID();
 
-	// Construct a new set of agents every time
-	traffic_agent_sim_[threadID]->clearAllAgents();
+	// Refill the agents of the last step in place
+	traffic_agent_sim_[threadID]->resetAgents();
+	AddGammaAgents(agents, num_agents, car, 0);
+
+	traffic_agent_sim_[threadID]->doStep();
+}
+
+/*
+ * GAMMA simulation of the active particles of a batch in one doStep. Each
+ * particle is a scenario of the simulator, so its agents only react to each
+ * other and to its ego car, as in GammaSimulateAgents. first_ids receives the
+ * simulator number of each particle's first agent, for ApplyGammaStep.
+ */
+void WorldModel::GammaSimulateAgentsBatch(PomdpStateBatch& batch,
+		std::vector<int>& first_ids) {
+	int threadID = GetThreadID();
+
+	traffic_agent_sim_[threadID]->resetAgents();
+	first_ids.resize(batch.size);
+	for (int i = 0; i < batch.size; i++) {
+		if (!batch.active[i])
+			continue;
+
+		PomdpState& state = *batch.states[i];
+		first_ids[i] = traffic_agent_sim_[threadID]->addScenario();
+		AddGammaAgents(state.agents, state.num, state.car, first_ids[i]);
+	}
+
+	traffic_agent_sim_[threadID]->doStep();
+}
+
+void WorldModel::AddGammaAgents(AgentStruct agents[], int num_agents,
+		CarStruct& car, int first_id) {
+	int threadID = GetThreadID();
 
 	// adding pedestrians
 	for (int i = 0; i < num_agents; i++) {
+		int id = first_id + i; // number in the simulator
 		bool frozen_agent = (agents[i].mode == AGENT_DIS);
 		if (agents[i].type == AgentType::car) {
 			traffic_agent_sim_[threadID]->addAgent(default_car_, i,
@@ -1218,12 +1219,12 @@ void WorldModel::GammaSimulateAgents(AgentStruct agents[], int num_agents,
 					frozen_agent);
 		}
 
-		traffic_agent_sim_[threadID]->setAgentPosition(i,
+		traffic_agent_sim_[threadID]->setAgentPosition(id,
 				RVO::Vector2(agents[i].pos.x, agents[i].pos.y));
 		RVO::Vector2 agt_heading(cos(agents[i].heading_dir),
 				sin(agents[i].heading_dir));
-		traffic_agent_sim_[threadID]->setAgentHeading(i, agt_heading);
-		traffic_agent_sim_[threadID]->setAgentVelocity(i,
+		traffic_agent_sim_[threadID]->setAgentHeading(id, agt_heading);
+		traffic_agent_sim_[threadID]->setAgentVelocity(id,
 				RVO::Vector2(agents[i].vel.x, agents[i].vel.y));
 
 		int intention_id = agents[i].intention;
@@ -1231,25 +1232,23 @@ void WorldModel::GammaSimulateAgents(AgentStruct agents[], int num_agents,
 
 		auto goal_pos = GetGoalPos(agents[i], intention_id);
 		RVO::Vector2 goal(goal_pos.x, goal_pos.y);
-		if (RVO::abs(goal - traffic_agent_sim_[threadID]->getAgentPosition(i)) < 0.5) {
+		if (RVO::abs(goal - traffic_agent_sim_[threadID]->getAgentPosition(id)) < 0.5) {
 			// Agent is within 0.5 meter of its goal, set preferred velocity to zero
-			traffic_agent_sim_[threadID]->setAgentPrefVelocity(i,
+			traffic_agent_sim_[threadID]->setAgentPrefVelocity(id,
 					RVO::Vector2(0.0f, 0.0f));
 		} else {
 			double pref_speed = 0.0;
 			pref_speed = agents[i].speed;
-			traffic_agent_sim_[threadID]->setAgentPrefVelocity(i,
-					normalize(goal - traffic_agent_sim_[threadID]->getAgentPosition(i)) * pref_speed);
+			traffic_agent_sim_[threadID]->setAgentPrefVelocity(id,
+					normalize(goal - traffic_agent_sim_[threadID]->getAgentPosition(id)) * pref_speed);
 		}
 
-		traffic_agent_sim_[threadID]->setAgentBoundingBoxCorners(i,
-				GetBoundingBoxCorners(agents[i]));
+		GetBoundingBoxCorners(agents[i], bb_corners);
+		traffic_agent_sim_[threadID]->setAgentBoundingBoxCorners(id, bb_corners);
 	}
 
 	// adding car as a "special" pedestrian
-	AddEgoGammaAgent(num_agents, car);
-
-	traffic_agent_sim_[threadID]->doStep();
+	AddEgoGammaAgent(first_id + num_agents, car);
 }
 
 COORD WorldModel::GetGammaVel(AgentStruct& agent, int i) {
@@ -1283,7 +1282,7 @@ void WorldModel::AgentApplyGammaVel(AgentStruct& agent, COORD& rvo_vel) {
 	if (!IsStopIntention(agent.intention, agent.id)
 			&& !IsCurVelIntention(agent.intention, agent.id)) {
 		auto& path = PathCandidates(agent.id)[agent.intention];
-		agent.pos_along_path = path.Nearest(agent.pos);
+		agent.pos_along_path = path.Nearest(agent.pos, agent.pos_along_path);
 	}
 	agent.vel = (agent.pos - old_pos) * freq;
 	agent.speed = agent.vel.Length();
@@ -1330,7 +1329,7 @@ void WorldModel::PrepareAttentiveAgentMeanDirs(const State* state) {
 	else {
 		int threadID = GetThreadID();
 
-		traffic_agent_sim_[threadID]->clearAllAgents();
+		traffic_agent_sim_[threadID]->resetAgents();
 
 		std::vector<int> agent_ids;
 		int gamma_id = 0;
@@ -7,6 +7,7 @@
 #include <msg_builder/LaneSeg.h>
 #include <geometry_msgs/Polygon.h>
 #include "despot/core/prior.h"
+#include "despot/util/philox.h"
 
 using namespace despot;
 
@@ -21,6 +22,10 @@ public:
 	Path path;
 	void SetPath(Path path);
 
+	/// Index of the real car along path, the warm-start hint of path queries
+	int car_path_hint = -1;
+	void UpdateCarPathHint(const CarStruct& car);
+
 public:
 	/// Default policy
 	const double in_front_angle_cos;
@@ -35,11 +40,15 @@ public:
 public:
 	// step function elements
 	void AgentStep(AgentStruct &ped, Random& random);
-	void AgentStep(AgentStruct &ped, double& random);
+	void AgentStep(AgentStruct &ped, const CounterRandom& random);
 
+	void GammaAgentStep(AgentStruct peds[], const CounterRandom& random,
+			int num_ped, CarStruct car); //pedestrian also need to consider car when moving
 	void GammaAgentStep(AgentStruct peds[], double& random, int num_ped,
-			CarStruct car); //pedestrian also need to consider car when moving
+			CarStruct car); // world step: noise from a seed advanced by QuickRandom
 	void GammaAgentStep(AgentStruct& agent, int intention_id);
+	void ApplyGammaStep(AgentStruct agents[], const CounterRandom& random,
+			int num_agents, int first_id);
 	void AgentStepCurVel(AgentStruct& ped, int step = 1, double noise = 0.0);
 	void AgentStepPath(AgentStruct& agent, int step = 1, double noise = 0.0,
 			bool doPrint = false);
@@ -53,9 +62,10 @@ public:
 	void RobStep(CarStruct &car, double& random, double acc, double steering);
 	void RobStep(CarStruct &car, Random& random, double acc, double steering);
 	void RobVelStep(CarStruct &car, double acc, Random& random);
-	void RobVelStep(CarStruct &car, double acc, double& random);
+	void RobVelStep(CarStruct &car, double acc, const CounterRandom& random);
 	double ISRobVelStep(CarStruct &car, double acc, Random& random); //importance sampling RobvelStep
 
+	void RobStepBatch(PomdpStateBatch& batch, double steering);
 	void RobStepCurVel(CarStruct &car);
 	void RobStepCurAction(CarStruct &car, double acc, double steering);
 
@@ -106,13 +116,15 @@ public:
 			COORD obs_first_point, int flag) const; // 0 in search, 1 real check
 	bool CheckCarWithVehicle(const CarStruct& car, const AgentStruct& veh,
 			int flag) const;
+	int FirstAgentInCollision(const CarStruct& car, const AgentStruct agents[],
+			int num, int flag, double in_front_angle_deg = -1) const; // 0 in search, 1 real check
 	bool CheckCarWithVehicleReal(const CarStruct& car, const AgentStruct& veh,
 			int flag) const;
 
 public:
 	/// Dynamics
 	double GetSteerToPath(const CarStruct& car) const {
-		COORD car_goal = path[path.Forward(path.Nearest(car.pos), 5.0)];
+		COORD car_goal = path[path.Forward(path.Nearest(car.pos, car_path_hint), 5.0)];
 		return PurepursuitAngle(car, car_goal);
 	}
 
@@ -161,18 +173,23 @@ public:
 		return Globals::MapThread(this_thread::get_id());
 	}
 
-	std::vector<RVO::Vector2> GetBoundingBoxCorners(AgentStruct& agent);
-	std::vector<RVO::Vector2> GetBoundingBoxCorners(RVO::Vector2 forward_vec,
+	void GetBoundingBoxCorners(AgentStruct& agent,
+			std::vector<RVO::Vector2>& corners);
+	void GetBoundingBoxCorners(RVO::Vector2 forward_vec,
 			RVO::Vector2 sideward_vec, RVO::Vector2 pos, double forward_len,
-			double side_len);
+			double side_len, std::vector<RVO::Vector2>& corners);
 
 	void InitGamma();
 	void AddEgoGammaAgent(int num_peds, const CarStruct& car);
 	void AddGammaAgent(const AgentStruct& agent, int id_in_sim);
 
 	// to be used in step function
+	void AddGammaAgents(AgentStruct agents[], int num_agents,
+			CarStruct& car, int first_id);
 	void GammaSimulateAgents(AgentStruct agents[], int num_agents,
 			CarStruct& car);
+	void GammaSimulateAgentsBatch(PomdpStateBatch& batch,
+			std::vector<int>& first_ids);
 	COORD GetGammaVel(AgentStruct& agent, int i);
 	void AgentApplyGammaVel(AgentStruct& agent, COORD& rvo_vel);
 
@@ -0,0 +1,153 @@
+/*
+ * Checks how DESPOT picks the subtree to resume the next search from among
+ * the subtrees kept under the executed action, and how it reweights the
+ * subtree by the updated belief. Builds the trees by hand, so it needs
+ * neither ROS nor a problem definition.
+ *
+ * usage: tree_reuse_test
+ */
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include <despot/core/node.h>
+#include <despot/solver/despot.h>
+
+using namespace std;
+using namespace despot;
+
+static int failures = 0;
+
+static void Check(bool passed, const char* what) {
+	cout << (passed ? "passed: " : "FAILED: ") << what << endl;
+	if (!passed)
+		failures++;
+}
+
+/*
+ * Children of one action of a root holding num_particles equally weighted
+ * particles, with sizes[o] of them under observation o.
+ */
+static vector<VNode*> BuildSubtrees(vector<State>& states,
+		const vector<int>& sizes) {
+	int num_particles = states.size();
+	vector<VNode*> subtrees;
+	int next = 0;
+	for (int o = 0; o < sizes.size(); o++) {
+		vector<State*> particles;
+		vector<int> particle_ids;
+		for (int i = 0; i < sizes[o]; i++, next++) {
+			states[next].state_id = next;
+			states[next].scenario_id = next;
+			states[next].weight = 1.0 / num_particles;
+			particles.push_back(&states[next]);
+			particle_ids.push_back(next);
+		}
+		subtrees.push_back(new VNode(particles, particle_ids, 1, NULL, o));
+	}
+	return subtrees;
+}
+
+/*
+ * likelihoods[k][i] for the particles of subtrees[k]: matched for those of
+ * subtrees[matched], other for the rest
+ */
+static vector<vector<double> > Likelihoods(const vector<VNode*>& subtrees,
+		int matched, double other) {
+	vector<vector<double> > likelihoods(subtrees.size());
+	for (int k = 0; k < subtrees.size(); k++)
+		likelihoods[k].assign(subtrees[k]->particles().size(),
+			k == matched ? 1.0 : other);
+	return likelihoods;
+}
+
+static bool Near(double a, double b) {
+	return fabs(a - b) < 1e-9;
+}
+
+/*
+ * A root with two particles, one action and one observation branch for
+ * each particle, as resumed from the last search.
+ */
+static void CheckReweight() {
+	vector<State> states(4);
+	for (int i = 0; i < states.size(); i++) {
+		states[i].scenario_id = i % 2;
+		states[i].weight = 0.5;
+	}
+	vector<State*> particles;
+	vector<int> particle_ids;
+	particles.push_back(&states[0]);
+	particles.push_back(&states[1]);
+	particle_ids.push_back(0);
+	particle_ids.push_back(1);
+	VNode* root = new VNode(particles, particle_ids);
+	root->default_move(ValuedAction(0, 1.0));
+
+	QNode* qnode = new QNode(root, 0);
+	qnode->step_reward = 0.5;
+	root->children().push_back(qnode);
+	root->legal_actions(vector<ACT_TYPE>(1, 0));
+	for (int o = 0; o < 2; o++) {
+		vector<State*> child_particles(1, &states[2 + o]);
+		vector<int> child_ids(1, o);
+		VNode* child = new VNode(child_particles, child_ids, 1, qnode, o);
+		child->lower_bound(1.0 + 2 * o);
+		child->upper_bound(2.0 + 2 * o);
+		qnode->children()[o] = child;
+	}
+
+	// Scenario 0 became three times as likely as scenario 1
+	vector<double> scales;
+	scales.push_back(3.0);
+	scales.push_back(1.0);
+	DESPOT::ReweightSubtree(root, scales);
+
+	Check(Near(states[0].weight, 0.75) && Near(states[1].weight, 0.25)
+		&& Near(states[2].weight, 0.75) && Near(states[3].weight, 0.25),
+		"particles are reweighted by scenario throughout the tree");
+	Check(Near(qnode->children()[0]->lower_bound(), 1.5)
+		&& Near(qnode->children()[1]->upper_bound(), 2.0),
+		"leaf bounds follow the weight of their particles");
+	Check(Near(qnode->lower_bound(), 0.5 + 1.5 + 1.5)
+		&& Near(qnode->upper_bound(), 0.5 + 3.0 + 2.0)
+		&& Near(root->lower_bound(), 3.5) && Near(root->upper_bound(), 5.5),
+		"bounds are backed up to the root");
+
+	delete root;
+}
+
+int main(int argc, char* argv[]) {
+	vector<int> sizes;
+	sizes.push_back(6);
+	sizes.push_back(3);
+	sizes.push_back(1);
+	vector<State> states(10);
+	vector<VNode*> subtrees = BuildSubtrees(states, sizes);
+
+	Check(DESPOT::SelectRetainedSubtree(subtrees, Likelihoods(subtrees, -1, 1.0), 0) == 0,
+		"without information from the belief, the most likely subtree is resumed");
+	Check(DESPOT::SelectRetainedSubtree(subtrees, Likelihoods(subtrees, 1, 0.01), 0) == 1,
+		"the subtree that matches the updated belief is resumed");
+	Check(DESPOT::SelectRetainedSubtree(subtrees, Likelihoods(subtrees, 2, 0.0), 0) == 2,
+		"a light subtree is resumed if the belief rules out the others");
+	Check(DESPOT::SelectRetainedSubtree(subtrees, Likelihoods(subtrees, -1, 0.0), 0) == -1,
+		"no subtree is resumed if the belief rules out all of them");
+
+	// The belief keeps only one of the six particles of the first subtree
+	vector<vector<double> > likelihoods = Likelihoods(subtrees, -1, 0.0);
+	likelihoods[0][0] = 1.0;
+	Check(DESPOT::SelectRetainedSubtree(subtrees, likelihoods, 3) == -1,
+		"no subtree is resumed if the belief has moved away from it");
+	Check(DESPOT::SelectRetainedSubtree(subtrees, Likelihoods(subtrees, 0, 0.0), 3) == 0,
+		"a subtree the belief agrees with is resumed");
+
+	for (int k = 0; k < subtrees.size(); k++)
+		delete subtrees[k];
+
+	CheckReweight();
+
+	cout << failures << " failures" << endl;
+	return failures == 0 ? 0 : 1;
+}
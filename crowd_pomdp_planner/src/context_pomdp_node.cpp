@@ -43,12 +43,14 @@ ContextPomdpNode::ContextPomdpNode(int argc, char** argv) {
 	n.param<int>("summit_port", Controller::summit_port, 0);
 	n.param<float>("time_scale", Controller::time_scale, 1.0);
 	n.param<std::string>("map_location", Controller::map_location, "");
+	n.param("reuse_tree", Globals::config.reuse_tree, false);
 
 	cerr << "DEBUG: Params list: " << endl;
 	cerr << "-drive_mode " << Controller::b_drive_mode << endl;
 	cerr << "-time_scale " << Controller::time_scale << endl;
 	cerr << "-summit_port " << Controller::summit_port << endl;
 	cerr << "-map_location " << Controller::map_location << endl;
+	cerr << "-reuse_tree " << Globals::config.reuse_tree << endl;
 
 	controller = new Controller(nh, fixed_path);
 
@@ -213,28 +213,29 @@ bool Controller::RunStep(despot::Solver* solver, World* world, Logger* logger) {
 	const State* cur_state = world->GetCurrentState();
 	if (cur_state == NULL)
 		ERR("cur_state is NULL");
+	static_cast<ContextPomdp*>(model_)->world_model.UpdateCarPathHint(
+			static_cast<const PomdpStateWorld*>(cur_state)->car);
 
 	cerr << "DEBUG: Updating belief" << endl;
 	ped_belief_->Update(last_action_, cur_state);
 	ped_belief_->Text(cout);
 
-	std::vector<State*> particles = ped_belief_->Sample(Globals::config.num_scenarios * 2);
+	// sample states for search, predicted one step ahead
+	std::vector<State*> predicted = ped_belief_->Sample(
+			Globals::config.num_scenarios * 2, true);
 	if (logging::level() >= logging::INFO) {
 		logi << "Planning for POMDP state:" << endl;
 		static_cast<ContextPomdp*>(model_)->PrintWorldState(
-				*static_cast<const PomdpStateWorld*>(particles[0]));
+				*static_cast<const PomdpStateWorld*>(predicted[0]));
 	}
 	// print future predictions for visualization purpose
 	static_cast<const ContextPomdp*>(model_)->ForwardAndVisualize(
-					particles[0], 10);
-	// predict states for search
-	for (int i=0; i<particles.size(); i++){
-		particles[i]=
-		static_cast<const ContextPomdp*>(model_)->PredictAgents(
-				static_cast<const PomdpState*>(particles[i]),0);
-	}
-
-	ParticleBelief particle_belief(particles, model_);
+					predicted[0], 10);
+	// the search resamples its scenarios from these particles, so splitting
+	// them into thousands of equally weighted copies would gain nothing. The
+	// sampled states stay with ped_belief_ until its next Sample, so the
+	// particle belief borrows them instead of copying.
+	ParticleBelief particle_belief(predicted, model_, NULL, false, false);
 	solver->belief(&particle_belief);
 	logi << "[RunStep] Time spent in Update(): "
 			<< Globals::ElapsedTime(start_t) << endl;
@@ -261,6 +262,16 @@ bool Controller::RunStep(despot::Solver* solver, World* world, Logger* logger) {
 	logi << "[RunStep] Time spent in ExecuteAction(): "
 			<< Globals::ElapsedTime(start_t) << endl;
 
+	// the belief is re-sampled every step, so the tree is carried over here
+	// instead of in BeliefUpdate. obs describes the state before the action
+	// took effect, so all subtrees of the action are kept and the next search
+	// resumes the one that matches its updated belief.
+	if (Globals::config.reuse_tree) {
+		DESPOT* despot = dynamic_cast<DESPOT*>(solver);
+		if (despot != NULL)
+			despot->RetainSubtree(action);
+	}
+
 	cerr << "DEBUG: Ending step" << endl;
 	return logger->SummarizeStep(step_++, round_, terminal, action, obs,
 			step_start_t);
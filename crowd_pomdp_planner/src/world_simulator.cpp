@@ -467,7 +467,7 @@ void WorldSimulator::AgentArrayCallback(msg_builder::TrafficAgentArray data) {
 				agent.pose.position.y);
 		exo_agents_[id].vel = COORD(agent.vel.x, agent.vel.y);
 		exo_agents_[id].speed = exo_agents_[id].vel.Length();
-		exo_agents_[id].heading_dir = navposeToHeadingDir(agent.pose);
+		exo_agents_[id].set_heading_dir(navposeToHeadingDir(agent.pose));
 
 		std::vector<COORD> bb;
 		for (auto& corner : agent.bbox.points) {